@@ -0,0 +1,552 @@
+#ifndef TRACE_READER_H
+#define TRACE_READER_H
+
+#include <bits/stdc++.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef CACHESIM_ZLIB
+#include <zlib.h>
+#endif
+using namespace std;
+
+// One memory reference of a trace. Formats that do not record the
+// instruction address or the core leave pc and core at 0.
+enum AccessType : unsigned char
+{
+    ACCESS_READ,
+    ACCESS_WRITE,
+    ACCESS_FETCH
+};
+
+struct MemoryAccess
+{
+    unsigned long long address;
+    unsigned long long pc;
+    unsigned short core;
+    unsigned char type;
+};
+
+// Trace file formats:
+//   TEXT    addresses, decimal or 0x-prefixed hex, separated by white
+//           space; # starts a comment
+//   BIN32   little-endian 32-bit addresses back to back
+//   BIN64   little-endian 64-bit addresses back to back
+//   LACKEY  valgrind --tool=lackey --trace-mem=yes: "I  addr,size",
+//           " L addr,size", " S addr,size", " M addr,size" (hex); M is
+//           a read then a write, other lines are skipped
+//   PIN     Pin's pinatrace: "0xpc: R 0xaddr" or "0xpc: W 0xaddr"
+//   DINERO  Dinero III din: "label addr" with label 0 read, 1 write,
+//           2 instruction fetch, and a hex address
+//   CORES   one access of a multi-core run per line: "core R|W|I addr",
+//           the address decimal or 0x-prefixed hex
+enum class TraceFormat
+{
+    AUTO,
+    TEXT,
+    BIN32,
+    BIN64,
+    LACKEY,
+    PIN,
+    DINERO,
+    CORES
+};
+
+inline bool parseTraceFormat(string name, TraceFormat &format)
+{
+    for (auto &c : name)
+        c = toupper(c);
+    if (name == "AUTO")
+        format = TraceFormat::AUTO;
+    else if (name == "TEXT")
+        format = TraceFormat::TEXT;
+    else if (name == "BIN32")
+        format = TraceFormat::BIN32;
+    else if (name == "BIN64" || name == "BIN")
+        format = TraceFormat::BIN64;
+    else if (name == "LACKEY" || name == "VALGRIND")
+        format = TraceFormat::LACKEY;
+    else if (name == "PIN")
+        format = TraceFormat::PIN;
+    else if (name == "DINERO" || name == "DIN")
+        format = TraceFormat::DINERO;
+    else if (name == "CORES")
+        format = TraceFormat::CORES;
+    else
+        return false;
+    return true;
+}
+
+// The format of a file by its extension (after any .gz): .bin32, .bin or
+// .bin64, .lackey or .vg, .pin, .din, .cores; anything else is TEXT.
+inline TraceFormat formatFromName(string path)
+{
+    for (auto &c : path)
+        c = tolower(c);
+    auto endsWith = [&path](const string &suffix)
+    {
+        return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (endsWith(".gz"))
+        path.resize(path.size() - 3);
+    if (endsWith(".bin32"))
+        return TraceFormat::BIN32;
+    if (endsWith(".bin") || endsWith(".bin64"))
+        return TraceFormat::BIN64;
+    if (endsWith(".lackey") || endsWith(".vg"))
+        return TraceFormat::LACKEY;
+    if (endsWith(".pin") || endsWith("pinatrace.out"))
+        return TraceFormat::PIN;
+    if (endsWith(".din"))
+        return TraceFormat::DINERO;
+    if (endsWith(".cores"))
+        return TraceFormat::CORES;
+    return TraceFormat::TEXT;
+}
+
+// A whole file mapped read-only into memory.
+class MappedFile
+{
+    const char *data;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#else
+    int fd;
+#endif
+
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+public:
+#ifdef _WIN32
+    MappedFile() : data(nullptr), length(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+#else
+    MappedFile() : data(nullptr), length(0), fd(-1) {}
+#endif
+    ~MappedFile() { close(); }
+
+    bool open(const string &path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        GetFileSizeEx(file, &size);
+        length = (size_t)size.QuadPart;
+        if (length == 0)
+            return true;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+        {
+            close();
+            return false;
+        }
+        data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data)
+        {
+            close();
+            return false;
+        }
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close();
+            return false;
+        }
+        length = (size_t)st.st_size;
+        if (length == 0)
+            return true;
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        data = (const char *)p;
+        madvise(p, length, MADV_SEQUENTIAL);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap((void *)data, length);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        length = 0;
+    }
+
+    const char *bytes() const { return data; }
+    size_t size() const { return length; }
+};
+
+// Bytes of decompressed trace held at a time.
+const size_t TRACE_WINDOW_BYTES = 4 << 20;
+
+// Streams the accesses of a trace file in batches. A plain file is
+// mapped into memory and parsed where it lies; a .gz file (built with
+// CACHESIM_ZLIB and -lz) is inflated a window at a time. Either way
+// memory use does not depend on the trace length.
+class TraceReader
+{
+    MappedFile file;
+    TraceFormat format;
+    const char *pos, *end; // unread input
+    string window;         // inflated input, for a .gz file
+#ifdef CACHESIM_ZLIB
+    gzFile gz;
+#endif
+    bool compressed, exhausted;
+    unsigned long long line; // of pos, for error messages
+    string error;
+
+    TraceReader(const TraceReader &);
+    TraceReader &operator=(const TraceReader &);
+
+    // Keeps the unread input and appends the next piece of a .gz file.
+    // False once there is no more.
+    bool refill()
+    {
+        if (!compressed || exhausted)
+            return false;
+#ifdef CACHESIM_ZLIB
+        string rest(pos, end);
+        window.assign(rest);
+        window.resize(rest.size() + TRACE_WINDOW_BYTES);
+        int got = gzread(gz, &window[rest.size()], (unsigned)TRACE_WINDOW_BYTES);
+        if (got < 0)
+            error = "cannot decompress the trace";
+        if (got <= 0)
+            exhausted = true;
+        window.resize(rest.size() + max(got, 0));
+        pos = window.data();
+        end = pos + window.size();
+        return got > 0;
+#else
+        return false;
+#endif
+    }
+
+    static bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static int hexDigit(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    // Reads a hex number, with or without 0x, at p; false if there is none.
+    static bool hexNumber(const char *&p, const char *e, unsigned long long &value)
+    {
+        if (e - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+            p += 2;
+        const char *start = p;
+        value = 0;
+        for (int d; p < e && (d = hexDigit(*p)) >= 0; p++)
+            value = value << 4 | (unsigned long long)d;
+        return p != start;
+    }
+
+    // Reads a decimal number, or a hex one written with 0x.
+    static bool number(const char *&p, const char *e, unsigned long long &value)
+    {
+        if (e - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+            return hexNumber(p, e, value);
+        const char *start = p;
+        value = 0;
+        for (; p < e && *p >= '0' && *p <= '9'; p++)
+            value = value * 10 + (unsigned long long)(*p - '0');
+        return p != start;
+    }
+
+    static void skipBlanks(const char *&p, const char *e)
+    {
+        while (p < e && isBlank(*p))
+            p++;
+    }
+
+    // Parses the line [p, e) into out (which has room for two); returns
+    // the accesses it held, or -1 if it is malformed.
+    int parseLine(const char *p, const char *e, MemoryAccess *out) const
+    {
+        skipBlanks(p, e);
+        if (p == e)
+            return 0;
+        MemoryAccess a = {0, 0, 0, ACCESS_READ};
+        switch (format)
+        {
+        case TraceFormat::LACKEY:
+        {
+            // Columns of the record kind differ: "I  addr" but " L addr".
+            char kind = *p++;
+            if ((kind != 'I' && kind != 'L' && kind != 'S' && kind != 'M') || p == e || !isBlank(*p))
+                return 0; // valgrind's own messages
+            skipBlanks(p, e);
+            if (!hexNumber(p, e, a.address))
+                return -1;
+            a.type = kind == 'I' ? ACCESS_FETCH : (kind == 'S' ? ACCESS_WRITE : ACCESS_READ);
+            out[0] = a;
+            if (kind != 'M')
+                return 1;
+            a.type = ACCESS_WRITE;
+            out[1] = a;
+            return 2;
+        }
+        case TraceFormat::PIN:
+        {
+            if (*p == '#')
+                return 0; // "#eof"
+            if (!hexNumber(p, e, a.pc) || p == e || *p++ != ':')
+                return -1;
+            skipBlanks(p, e);
+            if (p == e || (*p != 'R' && *p != 'W'))
+                return -1;
+            a.type = *p++ == 'W' ? ACCESS_WRITE : ACCESS_READ;
+            skipBlanks(p, e);
+            if (!hexNumber(p, e, a.address))
+                return -1;
+            out[0] = a;
+            return 1;
+        }
+        case TraceFormat::DINERO:
+        {
+            if (*p < '0' || *p > '2')
+                return -1;
+            a.type = *p == '1' ? ACCESS_WRITE : (*p == '2' ? ACCESS_FETCH : ACCESS_READ);
+            p++;
+            skipBlanks(p, e);
+            if (!hexNumber(p, e, a.address))
+                return -1;
+            out[0] = a;
+            return 1;
+        }
+        case TraceFormat::CORES:
+        {
+            if (*p == '#')
+                return 0;
+            unsigned long long core;
+            if (!number(p, e, core) || core > 0xffff)
+                return -1;
+            a.core = (unsigned short)core;
+            skipBlanks(p, e);
+            if (p == e || (*p != 'R' && *p != 'W' && *p != 'I'))
+                return -1;
+            a.type = *p == 'W' ? ACCESS_WRITE : (*p == 'I' ? ACCESS_FETCH : ACCESS_READ);
+            p++;
+            skipBlanks(p, e);
+            if (!number(p, e, a.address))
+                return -1;
+            out[0] = a;
+            return 1;
+        }
+        default:
+            return -1;
+        }
+    }
+
+    size_t readBinary(MemoryAccess *out, size_t max)
+    {
+        size_t width = format == TraceFormat::BIN32 ? 4 : 8;
+        size_t n = 0;
+        while (n < max)
+        {
+            size_t count = min(max - n, (size_t)(end - pos) / width);
+            if (count == 0)
+            {
+                if (refill())
+                    continue;
+                if (end != pos)
+                    error = "the trace ends inside an address";
+                break;
+            }
+            const uint16_t probe = 1;
+            bool littleEndian = *(const unsigned char *)&probe == 1;
+            for (size_t i = 0; i < count; i++, pos += width)
+            {
+                unsigned long long address = 0;
+                if (littleEndian && width == 8)
+                    memcpy(&address, pos, 8);
+                else if (littleEndian)
+                {
+                    uint32_t low;
+                    memcpy(&low, pos, 4);
+                    address = low;
+                }
+                else
+                    for (size_t k = width; k-- > 0;)
+                        address = address << 8 | (unsigned char)pos[k];
+                out[n++] = {address, 0, 0, ACCESS_READ};
+            }
+        }
+        return n;
+    }
+
+    // TEXT: every number on every line is an address.
+    size_t readText(MemoryAccess *out, size_t max)
+    {
+        size_t n = 0;
+        while (n < max)
+        {
+            while (pos < end && (isBlank(*pos) || *pos == '\n'))
+                line += *pos++ == '\n';
+            if (pos < end && *pos == '#')
+            {
+                const char *eol = (const char *)memchr(pos, '\n', end - pos);
+                if (!eol && refill())
+                    continue;
+                pos = eol ? eol : end;
+                continue;
+            }
+            if (pos == end)
+            {
+                if (refill())
+                    continue;
+                break;
+            }
+            // A number cut off at the end of the window is finished
+            // after the next piece arrives.
+            const char *p = pos;
+            while (p < end && !isBlank(*p) && *p != '\n' && *p != '#')
+                p++;
+            if (p == end && !exhausted && compressed && refill())
+                continue;
+            const char *q = pos;
+            unsigned long long address;
+            if (!number(q, p, address) || q != p)
+            {
+                error = "line " + to_string(line) + ": '" + string(pos, p) + "' is not an address";
+                break;
+            }
+            out[n++] = {address, 0, 0, ACCESS_READ};
+            pos = p;
+        }
+        return n;
+    }
+
+    size_t readLines(MemoryAccess *out, size_t max)
+    {
+        size_t n = 0;
+        while (n + 2 <= max)
+        {
+            const char *eol = (const char *)memchr(pos, '\n', end - pos);
+            if (!eol && refill())
+                continue;
+            if (pos == end)
+                break;
+            const char *stop = eol ? eol : end;
+            int got = parseLine(pos, stop, out + n);
+            if (got < 0)
+            {
+                error = "line " + to_string(line) + ": malformed record '" + string(pos, stop) + "'";
+                break;
+            }
+            n += got;
+            pos = eol ? eol + 1 : end;
+            line++;
+        }
+        return n;
+    }
+
+public:
+    TraceReader() : format(TraceFormat::TEXT), pos(nullptr), end(nullptr),
+#ifdef CACHESIM_ZLIB
+                    gz(nullptr),
+#endif
+                    compressed(false), exhausted(true), line(1)
+    {
+    }
+
+    ~TraceReader()
+    {
+#ifdef CACHESIM_ZLIB
+        if (gz)
+            gzclose(gz);
+#endif
+    }
+
+    // Opens path as a trace of the given format (AUTO: by its name).
+    bool open(const string &path, TraceFormat traceFormat, string &err)
+    {
+        format = traceFormat == TraceFormat::AUTO ? formatFromName(path) : traceFormat;
+        compressed = path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0;
+        if (compressed)
+        {
+#ifdef CACHESIM_ZLIB
+            gz = gzopen(path.c_str(), "rb");
+            if (!gz)
+            {
+                err = "cannot open " + path;
+                return false;
+            }
+            gzbuffer(gz, 1 << 20);
+            exhausted = false;
+            pos = end = window.data();
+            refill();
+            return true;
+#else
+            err = path + " is compressed; build with -DCACHESIM_ZLIB -lz to read it";
+            return false;
+#endif
+        }
+        if (!file.open(path))
+        {
+            err = "cannot open " + path;
+            return false;
+        }
+        pos = file.bytes();
+        end = pos + file.size();
+        return true;
+    }
+
+    // Reads up to max accesses (max >= 2) into out; returns how many. 0
+    // means the trace is over, or broken if getError() is set.
+    size_t read(MemoryAccess *out, size_t max)
+    {
+        if (!error.empty())
+            return 0;
+        if (format == TraceFormat::BIN32 || format == TraceFormat::BIN64)
+            return readBinary(out, max);
+        if (format == TraceFormat::TEXT)
+            return readText(out, max);
+        return readLines(out, max);
+    }
+
+    const string &getError() const { return error; }
+    TraceFormat getFormat() const { return format; }
+};
+
+#endif // TRACE_READER_H
@@ -1,12 +1,29 @@
 #include <bits/stdc++.h>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+#include "TraceReader.h"
 using namespace std;
 
-//  Cache Block
-struct CacheBlock
+//  Cache Lines
+// A line's tag word is its tag with VALID_TAG set, or 0 while the line is
+// invalid, so one compare tells both. (Tags never reach bit 63 unless the
+// blocks are single bytes in a single set.) Its other state is in flags.
+const unsigned long long VALID_TAG = 1ULL << 63;
+enum LineFlag : unsigned char
+{
+    LINE_DIRTY = 1,      // written since it was filled (write-back caches)
+    LINE_SHARED = 2,     // other caches may hold it too (coherent caches)
+    LINE_PREFETCHED = 4  // brought in by the prefetcher and not used since
+};
+
+// A block pushed out of a cache to make room for another.
+struct Eviction
 {
-    unsigned long long tag;
     bool valid;
-    CacheBlock() : tag(0), valid(false) {}
+    unsigned long long address;
+    bool dirty;
+    Eviction() : valid(false), address(0), dirty(false) {}
 };
 
 // REPLACEMENT POLICY INTERFACE
@@ -20,271 +37,2133 @@ public:
     virtual ~ReplacementPolicy() {}
 };
 
-// FIRST IN FIRST OUT (FIFO) ALGORITHM
-class FIFOReplacement : public ReplacementPolicy
+// Doubly linked lists threaded through the lines of every set, so that
+// moving a line costs O(1) and nothing is allocated per access. Lines are
+// numbered set * ways + way and lists are numbered by their owner; a line
+// is on at most one list at a time.
+class LineLists
 {
-    vector<vector<int>> order;
+    int ways;
+    vector<int> prev, next, owner; // per line; -1 when none
+    vector<int> head, tail;        // per list
 
 public:
-    FIFOReplacement(int sets, int ways) { order.assign(sets, {}); }
-    int chooseVictim(int setIndex, const vector<unsigned long long> & = {})
+    LineLists(int sets, int w, int listsPerSet)
+        : ways(w), prev(sets * w, -1), next(sets * w, -1), owner(sets * w, -1),
+          head(sets * listsPerSet, -1), tail(sets * listsPerSet, -1) {}
+
+    int line(int setIndex, int way) const { return setIndex * ways + way; }
+    bool empty(int list) const { return head[list] < 0; }
+    int frontWay(int list) const { return head[list] % ways; }
+    int listOf(int l) const { return owner[l]; }
+
+    void remove(int l)
     {
-        int victim = order[setIndex].front();
-        order[setIndex].erase(order[setIndex].begin());
-        return victim;
+        int list = owner[l];
+        if (list < 0)
+            return;
+        (prev[l] < 0 ? head[list] : next[prev[l]]) = next[l];
+        (next[l] < 0 ? tail[list] : prev[next[l]]) = prev[l];
+        prev[l] = next[l] = owner[l] = -1;
     }
+
+    void pushBack(int list, int l)
+    {
+        remove(l);
+        prev[l] = tail[list];
+        (tail[list] < 0 ? head[list] : next[tail[list]]) = l;
+        tail[list] = l;
+        owner[l] = list;
+    }
+
+    void clear()
+    {
+        fill(prev.begin(), prev.end(), -1);
+        fill(next.begin(), next.end(), -1);
+        fill(owner.begin(), owner.end(), -1);
+        fill(head.begin(), head.end(), -1);
+        fill(tail.begin(), tail.end(), -1);
+    }
+};
+
+// FIRST IN FIRST OUT (FIFO) ALGORITHM
+// Each set keeps its lines in the order they were filled.
+class FIFOReplacement : public ReplacementPolicy
+{
+    int sets, ways;
+    LineLists order;
+
+public:
+    FIFOReplacement(int s, int w) : sets(s), ways(w), order(s, w, 1) { reset(); }
+    int chooseVictim(int setIndex, const vector<unsigned long long> & = {}) { return order.frontWay(setIndex); }
     void onAccess(int, int) {}
-    void onInsert(int setIndex, int lineIndex) { order[setIndex].push_back(lineIndex); }
+    void onInsert(int setIndex, int lineIndex) { order.pushBack(setIndex, order.line(setIndex, lineIndex)); }
     void reset()
     {
-        for (auto &v : order)
-            v.clear();
+        order.clear();
+        for (int s = 0; s < sets; s++)
+            for (int w = 0; w < ways; w++)
+                order.pushBack(s, order.line(s, w));
     }
 };
 
 // LEAST RECENTLY USED (LRU) ALGORITHM
+// Each set keeps its lines from least to most recently used.
 class LRUReplacement : public ReplacementPolicy
 {
-    vector<vector<int>> recent;
+    int sets, ways;
+    LineLists recent;
+
+public:
+    LRUReplacement(int s, int w) : sets(s), ways(w), recent(s, w, 1) { reset(); }
+    int chooseVictim(int setIndex, const vector<unsigned long long> & = {}) { return recent.frontWay(setIndex); }
+    void onAccess(int setIndex, int lineIndex) { recent.pushBack(setIndex, recent.line(setIndex, lineIndex)); }
+    void onInsert(int setIndex, int lineIndex) { onAccess(setIndex, lineIndex); }
+    void reset()
+    {
+        recent.clear();
+        for (int s = 0; s < sets; s++)
+            for (int w = 0; w < ways; w++)
+                recent.pushBack(s, recent.line(s, w));
+    }
+};
+
+// LEAST FREQUENTLY USED (LFU) ALGORITHM
+// Lines with the same use count share a bucket, and each set keeps its
+// buckets in increasing count order, so a use moves a line at most one
+// bucket along. A bucket holds its ways as a bitmask, so the victim is
+// the lowest way with the lowest count, found with a word scan. A set
+// never has more non-empty buckets than ways, so bucket s * ways + k
+// (k < ways) belongs to set s.
+class LFUReplacement : public ReplacementPolicy
+{
+    int sets, ways, words; // words of a bucket's bitmask
+    vector<unsigned long long> members; // per bucket, words of it
+    vector<int> size;                   // per bucket
+    vector<int> owner;                  // per line, its bucket
+    vector<unsigned long long> count;   // per bucket
+    vector<int> prevBucket, nextBucket, firstBucket;
+    vector<int> spare; // per set, its unused buckets as a stack
+    vector<int> spareCount;
+
+    void add(int b, int way)
+    {
+        members[(size_t)b * words + way / 64] |= 1ULL << (way % 64);
+        size[b]++;
+    }
+    void remove(int b, int way)
+    {
+        members[(size_t)b * words + way / 64] &= ~(1ULL << (way % 64));
+        size[b]--;
+    }
+    int takeBucket(int setIndex) { return spare[setIndex * ways + --spareCount[setIndex]]; }
+    void freeBucket(int setIndex, int b)
+    {
+        (prevBucket[b] < 0 ? firstBucket[setIndex] : nextBucket[prevBucket[b]]) = nextBucket[b];
+        if (nextBucket[b] >= 0)
+            prevBucket[nextBucket[b]] = prevBucket[b];
+        spare[setIndex * ways + spareCount[setIndex]++] = b;
+    }
+
+    // Moves a line to the bucket for uses, searching from bucket from
+    // (-1: the front), whose count is at most uses.
+    void setCount(int setIndex, int lineIndex, unsigned long long uses, int from)
+    {
+        int l = setIndex * ways + lineIndex;
+        int old = owner[l];
+        int before = from, after = from < 0 ? firstBucket[setIndex] : nextBucket[from];
+        while (after >= 0 && count[after] <= uses)
+        {
+            before = after;
+            after = nextBucket[after];
+        }
+        if (old == before && count[old] == uses)
+            return;
+        if (old >= 0)
+            remove(old, lineIndex);
+        owner[l] = -1;
+        if (before >= 0 && count[before] == uses)
+        {
+            add(owner[l] = before, lineIndex);
+            if (old >= 0 && size[old] == 0)
+                freeBucket(setIndex, old);
+            return;
+        }
+        if (old >= 0 && size[old] == 0)
+        {
+            if (old == before) // alone in the bucket just below: relabel it
+            {
+                count[old] = uses;
+                add(owner[l] = old, lineIndex);
+                return;
+            }
+            if (old == after)
+                after = nextBucket[old];
+            freeBucket(setIndex, old);
+        }
+        int b = takeBucket(setIndex);
+        count[b] = uses;
+        prevBucket[b] = before;
+        nextBucket[b] = after;
+        (before < 0 ? firstBucket[setIndex] : nextBucket[before]) = b;
+        if (after >= 0)
+            prevBucket[after] = b;
+        add(owner[l] = b, lineIndex);
+    }
 
 public:
-    LRUReplacement(int sets, int ways) { recent.assign(sets, {}); }
+    LFUReplacement(int s, int w)
+        : sets(s), ways(w), words((w + 63) / 64), members((size_t)s * w * words), size(s * w), owner(s * w),
+          count(s * w), prevBucket(s * w), nextBucket(s * w), firstBucket(s), spare(s * w), spareCount(s)
+    {
+        reset();
+    }
     int chooseVictim(int setIndex, const vector<unsigned long long> & = {})
     {
-        int victim = recent[setIndex].front();
-        recent[setIndex].erase(recent[setIndex].begin());
-        return victim;
+        const unsigned long long *mask = &members[(size_t)firstBucket[setIndex] * words];
+        int word = 0;
+        while (mask[word] == 0)
+            word++;
+        return word * 64 + __builtin_ctzll(mask[word]);
     }
     void onAccess(int setIndex, int lineIndex)
     {
-        auto &r = recent[setIndex];
-        r.erase(remove(r.begin(), r.end(), lineIndex), r.end());
-        r.push_back(lineIndex);
+        int b = owner[setIndex * ways + lineIndex];
+        setCount(setIndex, lineIndex, count[b] + 1, b);
     }
-    void onInsert(int setIndex, int lineIndex) { onAccess(setIndex, lineIndex); }
+    void onInsert(int setIndex, int lineIndex) { setCount(setIndex, lineIndex, 1, -1); }
     void reset()
     {
-        for (auto &r : recent)
-            r.clear();
+        fill(members.begin(), members.end(), 0);
+        fill(size.begin(), size.end(), 0);
+        for (int s = 0; s < sets; s++)
+        {
+            // Every line starts unused in the set's first bucket.
+            int first = s * ways;
+            for (int k = 0; k < ways - 1; k++)
+                spare[s * ways + k] = first + ways - 1 - k;
+            spareCount[s] = ways - 1;
+            firstBucket[s] = first;
+            prevBucket[first] = nextBucket[first] = -1;
+            count[first] = 0;
+            for (int w = 0; w < ways; w++)
+            {
+                owner[s * ways + w] = first;
+                add(first, w);
+            }
+        }
     }
 };
 
-// LEAST FREQUENTLY USED (LFU) ALGORITHM
-class LFUReplacement : public ReplacementPolicy
+// TREE PSEUDO-LRU (PLRU) ALGORITHM
+// Each set is a binary tree over its ways with one bit per inner node
+// pointing towards the half that was used less recently; a use turns the
+// bits on its path away from it. Needs a power-of-two associativity.
+class PLRUReplacement : public ReplacementPolicy
 {
-    vector<vector<int>> freq;
+    int ways, words;
+    vector<unsigned long long> bits; // node n of set s is bit n of the set's words
+
+    bool bit(int setIndex, int node) const { return bits[setIndex * words + node / 64] >> (node % 64) & 1; }
+    void setBit(int setIndex, int node, bool value)
+    {
+        unsigned long long &word = bits[setIndex * words + node / 64];
+        word = (word & ~(1ULL << (node % 64))) | ((unsigned long long)value << (node % 64));
+    }
 
 public:
-    LFUReplacement(int sets, int ways) { freq.assign(sets, vector<int>(ways, 0)); }
+    PLRUReplacement(int s, int w) : ways(w), words(w / 64 + 1), bits(s * (w / 64 + 1), 0) {}
     int chooseVictim(int setIndex, const vector<unsigned long long> & = {})
     {
-        int victim = 0, minFreq = freq[setIndex][0];
-        for (int i = 1; i < (int)freq[setIndex].size(); i++)
-            if (freq[setIndex][i] < minFreq)
-            {
-                minFreq = freq[setIndex][i];
-                victim = i;
-            }
-        return victim;
+        int node = 1;
+        while (node < ways)
+            node = 2 * node + bit(setIndex, node);
+        return node - ways;
+    }
+    void onAccess(int setIndex, int lineIndex)
+    {
+        for (int node = lineIndex + ways; node > 1; node /= 2)
+            setBit(setIndex, node / 2, !(node & 1));
+    }
+    void onInsert(int setIndex, int lineIndex) { onAccess(setIndex, lineIndex); }
+    void reset() { fill(bits.begin(), bits.end(), 0); }
+};
+
+// RE-REFERENCE INTERVAL PREDICTION (SRRIP / BRRIP / DRRIP) ALGORITHMS
+// Every line has a 2-bit re-reference prediction value (RRPV): 0 means
+// it is expected again soon, 3 in the distant future. Hits set it to 0;
+// the victim is a line at 3, and when there is none every line of the
+// set ages by one. SRRIP inserts at 2, BRRIP at 3 but at 2 for one
+// insertion in 32, and DRRIP duels the two on leader sets and follows
+// whichever misses less.
+//
+// The lines of a set sit on four lists, one per RRPV. Ageing only happens
+// when the RRPV 3 list is empty, so it just relabels the lists: the
+// physical list of value v is (v + rotation) % 4.
+const int MAX_RRPV = 3;
+const int BIMODAL_PERIOD = 32;
+const int PSEL_MAX = 1023; // DRRIP's 10-bit policy selector
+
+class RRIPReplacement : public ReplacementPolicy
+{
+public:
+    enum Mode
+    {
+        STATIC,
+        BIMODAL,
+        DYNAMIC
+    };
+
+private:
+    int sets, ways;
+    Mode mode;
+    LineLists rrpv;
+    vector<unsigned char> rotation;
+    int bimodalCount;
+    int psel, leaderStride;
+
+    int list(int setIndex, int value) const { return setIndex * 4 + ((value + rotation[setIndex]) & 3); }
+
+    // For DRRIP: 1 if the set always uses SRRIP, 2 if BRRIP, 0 if it follows.
+    int leader(int setIndex) const
+    {
+        if (mode != DYNAMIC || leaderStride == 0)
+            return 0;
+        if (setIndex % leaderStride == 0)
+            return 1;
+        return setIndex % leaderStride == leaderStride / 2 ? 2 : 0;
+    }
+
+public:
+    RRIPReplacement(int s, int w, Mode m)
+        : sets(s), ways(w), mode(m), rrpv(s, w, 4), rotation(s, 0), bimodalCount(0), psel(PSEL_MAX / 2),
+          leaderStride(s >= 64 ? s / 32 : (s >= 2 ? 2 : 0))
+    {
+        reset();
+    }
+    int chooseVictim(int setIndex, const vector<unsigned long long> & = {})
+    {
+        while (rrpv.empty(list(setIndex, MAX_RRPV)))
+            rotation[setIndex] = (rotation[setIndex] + 3) & 3;
+        return rrpv.frontWay(list(setIndex, MAX_RRPV));
+    }
+    void onAccess(int setIndex, int lineIndex) { rrpv.pushBack(list(setIndex, 0), rrpv.line(setIndex, lineIndex)); }
+    void onInsert(int setIndex, int lineIndex)
+    {
+        // Every insertion follows a miss; leader sets count them.
+        int role = leader(setIndex);
+        if (role == 1)
+            psel = min(psel + 1, PSEL_MAX);
+        else if (role == 2)
+            psel = max(psel - 1, 0);
+        bool bimodal = mode == BIMODAL || (mode == DYNAMIC && (role == 2 || (role == 0 && psel > PSEL_MAX / 2)));
+        int value = MAX_RRPV - 1;
+        if (bimodal && ++bimodalCount % BIMODAL_PERIOD != 0)
+            value = MAX_RRPV;
+        rrpv.pushBack(list(setIndex, value), rrpv.line(setIndex, lineIndex));
     }
-    void onAccess(int setIndex, int lineIndex) { freq[setIndex][lineIndex]++; }
-    void onInsert(int setIndex, int lineIndex) { freq[setIndex][lineIndex] = 1; }
     void reset()
     {
-        for (auto &f : freq)
-            fill(f.begin(), f.end(), 0);
+        rrpv.clear();
+        fill(rotation.begin(), rotation.end(), 0);
+        bimodalCount = 0;
+        psel = PSEL_MAX / 2;
+        for (int s = 0; s < sets; s++)
+            for (int w = 0; w < ways; w++)
+                rrpv.pushBack(list(s, MAX_RRPV), rrpv.line(s, w));
     }
 };
 
 // BELADY (Optimal) ALGORITHM
+// Evicts the line whose next use lies farthest ahead in the trace. One
+// backward pass over the trace finds, for every access, the position of
+// the next access to the same block; each set then keeps its lines in a
+// max-heap keyed by their next use, so eviction is O(log ways).
 class BeladyReplacement : public ReplacementPolicy
 {
-    vector<vector<unsigned long long>> *cacheRefs;
-    vector<vector<CacheBlock>> *cacheSets;
+    int ways, blockSize;
     vector<unsigned long long> *trace;
     size_t currentIndex;
+    vector<size_t> nextUse;  // per access: position of the next access to its block, NEVER if none
+    vector<size_t> key;      // per line: the next use of its block
+    vector<int> heap;        // per set, ways entries: lines, farthest next use first
+    vector<int> heapPos;     // per line: its place in the set's heap, -1 if not there
+    vector<int> heapSize;    // per set
 
-public:
-    BeladyReplacement(int, int, vector<vector<unsigned long long>> *refs,
-                      vector<vector<CacheBlock>> *sets,
-                      vector<unsigned long long> *t)
-        : cacheRefs(refs), cacheSets(sets), trace(t), currentIndex(0) {}
+    static constexpr size_t NEVER = SIZE_MAX;
 
-    void setCurrentIndex(size_t idx) { currentIndex = idx; }
+    void prepare()
+    {
+        size_t n = trace->size();
+        nextUse.assign(n, NEVER);
+        unordered_map<unsigned long long, size_t> seen;
+        seen.reserve(min(n, (size_t)1 << 24));
+        for (size_t i = n; i-- > 0;)
+        {
+            auto it = seen.emplace((*trace)[i] / blockSize, i);
+            if (!it.second)
+            {
+                nextUse[i] = it.first->second;
+                it.first->second = i;
+            }
+        }
+    }
 
-    int chooseVictim(int setIndex, const vector<unsigned long long> & = {}) override
+    bool before(int a, int b) const { return key[a] > key[b]; }
+    void place(int setIndex, int at, int line)
+    {
+        heap[setIndex * ways + at] = line;
+        heapPos[line] = at;
+    }
+    void siftUp(int setIndex, int at)
+    {
+        int line = heap[setIndex * ways + at];
+        while (at > 0 && before(line, heap[setIndex * ways + (at - 1) / 2]))
+        {
+            place(setIndex, at, heap[setIndex * ways + (at - 1) / 2]);
+            at = (at - 1) / 2;
+        }
+        place(setIndex, at, line);
+    }
+    void siftDown(int setIndex, int at)
     {
-        auto &set = (*cacheSets)[setIndex];
-        int victim = -1;
-        size_t farthest = 0;
+        int line = heap[setIndex * ways + at], size = heapSize[setIndex];
+        for (int child; (child = 2 * at + 1) < size; at = child)
+        {
+            if (child + 1 < size && before(heap[setIndex * ways + child + 1], heap[setIndex * ways + child]))
+                child++;
+            if (!before(heap[setIndex * ways + child], line))
+                break;
+            place(setIndex, at, heap[setIndex * ways + child]);
+        }
+        place(setIndex, at, line);
+    }
 
-        for (int i = 0; i < (int)set.size(); i++)
+    // Keys the line by the next use of the block now being accessed.
+    void touch(int setIndex, int lineIndex)
+    {
+        int line = setIndex * ways + lineIndex;
+        key[line] = currentIndex < nextUse.size() ? nextUse[currentIndex] : NEVER;
+        if (heapPos[line] < 0)
         {
-            unsigned long long tag = set[i].tag;
-            size_t nextUse = SIZE_MAX;
+            place(setIndex, heapSize[setIndex]++, line);
+            siftUp(setIndex, heapPos[line]);
+            return;
+        }
+        siftUp(setIndex, heapPos[line]);
+        siftDown(setIndex, heapPos[line]);
+    }
 
-            for (size_t j = currentIndex + 1; j < trace->size(); j++)
-            {
-                unsigned long long addr = (*trace)[j];
-                unsigned long long block = addr / cacheRefs->at(0).size();
-                unsigned long long tagFuture = block / cacheRefs->size();
-                int setFuture = block % cacheRefs->size();
+public:
+    BeladyReplacement(int sets, int w, int block, vector<unsigned long long> *t)
+        : ways(w), blockSize(block), trace(t), currentIndex(0),
+          key(sets * w, NEVER), heap(sets * w, 0), heapPos(sets * w, -1), heapSize(sets, 0) {}
 
-                if (setFuture == setIndex && tagFuture == tag)
-                {
-                    nextUse = j;
-                    break;
-                }
-            }
-            if (nextUse == SIZE_MAX)
-                return i; // never used again
-            if (nextUse > farthest)
-            {
-                farthest = nextUse;
-                victim = i;
-            }
-        }
-        return victim == -1 ? 0 : victim;
+    // Called before each access with its position in the trace. The
+    // next-use index is built on the first call, once the trace is loaded.
+    void setCurrentIndex(size_t idx)
+    {
+        if (nextUse.size() != trace->size())
+            prepare();
+        currentIndex = idx;
     }
 
-    void onAccess(int, int) {}
-    void onInsert(int, int) {}
-    void reset() {}
+    int chooseVictim(int setIndex, const vector<unsigned long long> & = {}) override
+    {
+        return heap[setIndex * ways] - setIndex * ways;
+    }
+
+    void onAccess(int setIndex, int lineIndex) { touch(setIndex, lineIndex); }
+    void onInsert(int setIndex, int lineIndex) { touch(setIndex, lineIndex); }
+    void reset()
+    {
+        fill(key.begin(), key.end(), NEVER);
+        fill(heapPos.begin(), heapPos.end(), -1);
+        fill(heapSize.begin(), heapSize.end(), 0);
+    }
 };
 
-//CACHE CLASS
-class Cache
+// PREFETCHER INTERFACE
+// Watches the demand accesses of a cache and names blocks to bring in
+// before they are asked for. Addresses are block numbers (address /
+// block size); pc is 0 when the trace does not record it.
+class Prefetcher
 {
-private:
-    int cacheSize, blockSize, associativity, numSets;
-    vector<vector<CacheBlock>> sets;
-    ReplacementPolicy *policy;
-    unsigned long long hits, misses, accesses;
-    string policyName;
+public:
+    // Called after every demand access. hit is whether the block was in
+    // the cache and prefetchHit whether it was there only because it was
+    // prefetched. Pushes the blocks to prefetch onto out.
+    virtual void onAccess(unsigned long long block, unsigned long long pc, bool hit, bool prefetchHit,
+                          vector<unsigned long long> &out) = 0;
+    virtual ~Prefetcher() {}
+};
+
+// Tagged next-line prefetching: a miss, or the first use of a prefetched
+// block, brings in the degree blocks after it.
+class NextLinePrefetcher : public Prefetcher
+{
+    int degree;
 
 public:
-    Cache(int c, int b, int a, string policyType, vector<unsigned long long> *trace = nullptr)
-        : cacheSize(c), blockSize(b), associativity(a),
-          hits(0), misses(0), accesses(0), policyName(policyType)
+    NextLinePrefetcher(int d) : degree(d) {}
+
+    void onAccess(unsigned long long block, unsigned long long, bool hit, bool prefetchHit,
+                  vector<unsigned long long> &out) override
     {
-        numSets = cacheSize / (blockSize * associativity);
-        sets.resize(numSets, vector<CacheBlock>(associativity));
+        if (hit && !prefetchHit)
+            return;
+        for (int k = 1; k <= degree; k++)
+            out.push_back(block + k);
+    }
+};
 
-        for (auto &c : policyType)
-            c = toupper(c);
-        if (policyType == "FIFO")
-            policy = new FIFOReplacement(numSets, associativity);
-        else if (policyType == "LRU")
-            policy = new LRUReplacement(numSets, associativity);
-        else if (policyType == "LFU")
-            policy = new LFUReplacement(numSets, associativity);
+const int STRIDE_TABLE = 256;  // reference prediction table entries
+const int STRIDE_CONFIDENT = 2; // matching strides seen before prefetching
+
+// Stride prefetching by instruction (a reference prediction table): each
+// load or store PC remembers its last address and stride, and once the
+// stride has repeated it prefetches degree strides ahead. Strides within
+// a block step a whole block instead. Without PCs every access shares one
+// entry, which still catches a single global stride.
+class StridePrefetcher : public Prefetcher
+{
+    struct Entry
+    {
+        unsigned long long pc, last;
+        long long stride;
+        int confidence;
+        bool valid;
+    };
+    int degree;
+    vector<Entry> table;
+
+public:
+    StridePrefetcher(int d) : degree(d), table(STRIDE_TABLE, Entry{0, 0, 0, 0, false}) {}
+
+    void onAccess(unsigned long long block, unsigned long long pc, bool, bool,
+                  vector<unsigned long long> &out) override
+    {
+        Entry &e = table[(pc ^ (pc >> 8)) % STRIDE_TABLE];
+        if (!e.valid || e.pc != pc)
+        {
+            e = Entry{pc, block, 0, 0, true};
+            return;
+        }
+        long long stride = (long long)(block - e.last);
+        if (stride == 0)
+            return;
+        if (stride == e.stride)
+            e.confidence = min(e.confidence + 1, 3);
+        else if (e.confidence > 0)
+            e.confidence--;
         else
-            policy = new BeladyReplacement(numSets, associativity, nullptr, &sets, trace);
+            e.stride = stride;
+        e.last = block;
+        if (e.confidence < STRIDE_CONFIDENT)
+            return;
+        for (int k = 1; k <= degree; k++)
+            out.push_back(block + k * e.stride);
     }
+};
 
-    pair<int, unsigned long long> decode(unsigned long long address)
+const int STREAM_COUNT = 8;   // streams followed at once
+const int STREAM_FILTER = 32; // recent misses a new stream must follow on from
+
+// Stream buffers (Jouppi, with Palacharla and Kessler's allocation
+// filter): a miss next to a recent miss that is in no stream starts one,
+// replacing the least recently used, going up or down from that miss.
+// A stream runs degree blocks ahead of the accesses, and every access to
+// one of its blocks moves it on. The blocks go into the cache.
+class StreamPrefetcher : public Prefetcher
+{
+    struct Stream
     {
-        unsigned long long blockNumber = address / blockSize;
-        int setIndex = blockNumber % numSets;
-        unsigned long long tag = blockNumber / numSets;
-        return {setIndex, tag};
-    }
+        unsigned long long next, end; // next block expected; last block prefetched
+        int direction;                // +1 or -1
+        unsigned long long lastUse;
+        bool valid;
+    };
+    int degree;
+    vector<Stream> streams;
+    vector<unsigned long long> recent; // the last STREAM_FILTER misses in no stream
+    int recentHead;
+    unsigned long long clock;
 
-    bool access(unsigned long long address, size_t index, vector<unsigned long long> *trace = nullptr)
+    // Whether block lies between the stream's next and end blocks.
+    static bool within(const Stream &s, unsigned long long block)
     {
-        accesses++;
-        auto decoded = decode(address);
-        int setIndex = decoded.first;
-        unsigned long long tag = decoded.second;
+        return s.valid && (long long)(block - s.next) * s.direction >= 0 && (long long)(s.end - block) * s.direction >= 0;
+    }
 
-        auto &set = sets[setIndex];
+public:
+    StreamPrefetcher(int d)
+        : degree(d), streams(STREAM_COUNT, Stream{0, 0, 1, 0, false}), recent(STREAM_FILTER, ~0ULL), recentHead(0), clock(0) {}
 
-        // Check for hit
-        for (int i = 0; i < associativity; i++)
+    void onAccess(unsigned long long block, unsigned long long, bool hit, bool prefetchHit,
+                  vector<unsigned long long> &out) override
+    {
+        if (hit && !prefetchHit)
+            return;
+        clock++;
+        Stream *stream = nullptr;
+        for (auto &s : streams)
+            if (within(s, block))
+                stream = &s;
+        if (!stream)
         {
-            if (set[i].valid && set[i].tag == tag)
+            int direction = 0;
+            for (unsigned long long r : recent)
+                if (r + 1 == block)
+                    direction = 1;
+                else if (r == block + 1 && direction == 0)
+                    direction = -1;
+            if (direction == 0)
             {
-                hits++;
-                policy->onAccess(setIndex, i);
-                return true;
+                recent[recentHead] = block;
+                recentHead = (recentHead + 1) % STREAM_FILTER;
+                return;
             }
+            stream = &streams[0];
+            for (auto &s : streams)
+                if (!s.valid || s.lastUse < stream->lastUse)
+                    stream = &s;
+            *stream = Stream{block, block, direction, 0, true};
+        }
+        stream->next = block + stream->direction;
+        stream->lastUse = clock;
+        while ((long long)(block - stream->end) * stream->direction + degree > 0)
+        {
+            stream->end += stream->direction;
+            out.push_back(stream->end);
         }
+    }
+};
 
-        // Miss
-        misses++;
-        int victim = -1;
-        for (int i = 0; i < associativity; i++)
-            if (!set[i].valid)
-            {
-                victim = i;
-                break;
-            }
+const int GHB_ENTRIES = 256; // global history buffer
+const int GHB_INDEX = 256;   // PCs with a history
+const int GHB_HISTORY = 16;  // misses of one PC looked back over
 
-        if (victim == -1)
+// A global history buffer with PC-localised delta correlation (Nesbit and
+// Smith's PC/DC). The buffer is a FIFO of recent misses, each linked to
+// the previous miss by the same PC. On a miss the PC's last few addresses
+// give a list of deltas; where the last two deltas occurred together
+// before, the deltas that followed them then are replayed from here.
+class GHBPrefetcher : public Prefetcher
+{
+    struct Entry
+    {
+        unsigned long long block;
+        long long previous; // position of the PC's miss before, -1 if none
+    };
+    struct IndexEntry
+    {
+        unsigned long long pc;
+        long long last; // position of the PC's latest miss, -1 if none
+    };
+    int degree;
+    vector<Entry> buffer;
+    vector<IndexEntry> index;
+    long long head; // position of the next entry; entry p is buffer[p % GHB_ENTRIES]
+    vector<unsigned long long> history;
+    vector<long long> deltas;
+
+    bool live(long long position) const { return position >= 0 && position >= head - GHB_ENTRIES; }
+
+public:
+    GHBPrefetcher(int d) : degree(d), buffer(GHB_ENTRIES), index(GHB_INDEX, IndexEntry{0, -1}), head(0) {}
+
+    void onAccess(unsigned long long block, unsigned long long pc, bool hit, bool prefetchHit,
+                  vector<unsigned long long> &out) override
+    {
+        if (hit && !prefetchHit)
+            return;
+        IndexEntry &ie = index[(pc ^ (pc >> 8)) % GHB_INDEX];
+        long long previous = ie.pc == pc && live(ie.last) ? ie.last : -1;
+        buffer[head % GHB_ENTRIES] = Entry{block, previous};
+        ie.pc = pc;
+        ie.last = head++;
+
+        history.clear();
+        for (long long p = ie.last; live(p) && (int)history.size() < GHB_HISTORY; p = buffer[p % GHB_ENTRIES].previous)
+            history.push_back(buffer[p % GHB_ENTRIES].block);
+        if (history.size() < 4)
+            return;
+        deltas.clear(); // newest first
+        for (size_t i = 0; i + 1 < history.size(); i++)
+            deltas.push_back((long long)(history[i] - history[i + 1]));
+
+        for (size_t k = 1; k + 1 < deltas.size(); k++)
         {
-            if (policyName == "BELADY")
+            if (deltas[k] != deltas[0] || deltas[k + 1] != deltas[1])
+                continue;
+            // deltas[k - 1] ... deltas[0] followed the pair last time.
+            unsigned long long next = block;
+            for (int n = 0; n < degree; n++)
             {
-                ((BeladyReplacement *)policy)->setCurrentIndex(index);
+                next += deltas[k - 1 - n % k];
+                out.push_back(next);
             }
-            victim = policy->chooseVictim(setIndex);
+            return;
         }
+    }
+};
 
-        set[victim].valid = true;
-        set[victim].tag = tag;
-        policy->onInsert(setIndex, victim);
-        return false;
+// Mattson's stack distances: the distance of an access is the number of
+// other blocks used since the last access to its block, and it hits in a
+// fully associative LRU cache of C blocks exactly when the distance is
+// below C. One pass therefore gives the miss ratio of every cache size.
+//
+// Distances are counted with a Fenwick tree over access times holding a 1
+// at the time each block was last used, so an access costs O(log n). The
+// times are renumbered whenever they outgrow the tree.
+class StackDistance
+{
+    int blockSize;
+    unordered_map<unsigned long long, size_t> last; // block -> time of its last access
+    vector<unsigned> tree;                          // Fenwick tree over times
+    size_t now;
+    vector<unsigned long long> histogram; // accesses by distance
+    unsigned long long accesses, coldMisses;
+
+    void add(size_t time, int delta)
+    {
+        for (size_t i = time + 1; i < tree.size(); i += i & (0 - i))
+            tree[i] += delta;
     }
 
-    void printCacheState()
+    // Blocks last used before time.
+    unsigned long long countBefore(size_t time) const
     {
-        for (int s = 0; s < numSets; s++)
+        unsigned long long sum = 0;
+        for (size_t i = time; i > 0; i -= i & (0 - i))
+            sum += tree[i];
+        return sum;
+    }
+
+    // Gives the blocks times 0, 1, ... in the order they were last used.
+    void renumber()
+    {
+        vector<pair<size_t, unsigned long long>> order;
+        order.reserve(last.size());
+        for (const auto &entry : last)
+            order.push_back({entry.second, entry.first});
+        sort(order.begin(), order.end());
+        tree.assign(max((size_t)1 << 20, 2 * order.size()) + 1, 0);
+        for (size_t t = 0; t < order.size(); t++)
         {
-            cout << "Set " << setw(2) << s << ": ";
-            for (int w = 0; w < associativity; w++)
-                cout << (sets[s][w].valid ? "[T" + to_string(sets[s][w].tag) + "] " : "[ ] ");
-            cout << "\n";
+            last[order[t].second] = t;
+            add(t, 1);
         }
+        now = order.size();
     }
 
-    void showStats()
+public:
+    static const unsigned long long COLD = ULLONG_MAX; // the distance of a first use
+
+    StackDistance(int block) : blockSize(block), tree(((size_t)1 << 20) + 1, 0), now(0), accesses(0), coldMisses(0) {}
+
+    // Records the access and returns its distance.
+    unsigned long long access(unsigned long long address)
     {
-        double missRate = (double)misses / max(accesses, 1ULL);
-        double hitRate = 1.0 - missRate;
-        double AMAT = 1 + missRate * 100; // let us assume miss penalty 100 cycles
+        if (now + 1 >= tree.size())
+            renumber();
+        accesses++;
+        auto it = last.emplace(address / blockSize, now);
+        unsigned long long distance = COLD;
+        if (it.second)
+            coldMisses++;
+        else
+        {
+            size_t previous = it.first->second;
+            distance = countBefore(now) - countBefore(previous + 1);
+            if (distance >= histogram.size())
+                histogram.resize(distance + 1, 0);
+            histogram[distance]++;
+            add(previous, -1);
+            it.first->second = now;
+        }
+        add(now, 1);
+        now++;
+        return distance;
+    }
 
+    const vector<unsigned long long> &getHistogram() const { return histogram; }
+    unsigned long long getColdMisses() const { return coldMisses; }
+
+    // The miss ratio of LRU caches of every power-of-two size up to the
+    // footprint of the trace.
+    void showCurve()
+    {
+        cout << "\nMISS RATIO CURVE (fully associative LRU, " << blockSize << "B blocks)\n";
+        cout << "Accesses: " << accesses << " | Distinct blocks: " << last.size()
+             << " | Cold misses: " << coldMisses << "\n";
+        cout << right << setw(14) << "Cache Size" << setw(12) << "Blocks" << setw(14) << "Misses" << setw(12) << "Miss Rate" << "\n";
         cout << fixed << setprecision(2);
-        cout << "\nAccesses: " << accesses
-             << " | Hits: " << hits
-             << " | Misses: " << misses << endl;
-        cout << "Hit Rate: " << hitRate * 100 << "%  Miss Rate: " << missRate * 100 << "%\n";
-        cout << "Average Memory Access Time (AMAT): " << AMAT << " cycles\n";
+        unsigned long long hits = 0;
+        size_t counted = 0;
+        for (unsigned long long blocks = 1;; blocks *= 2)
+        {
+            for (; counted < blocks && counted < histogram.size(); counted++)
+                hits += histogram[counted];
+            unsigned long long misses = accesses - hits;
+            cout << setw(13) << blocks * blockSize << "B" << setw(12) << blocks << setw(14) << misses
+                 << setw(11) << 100.0 * misses / max(accesses, 1ULL) << "%\n";
+            if (blocks >= last.size())
+                break;
+        }
     }
 };
 
-// Simulator starts from here
-class CacheSimulator
+// Misses of one part of a cache, split by cause (see MissReport).
+struct MissCounts
 {
-private:
-    int cacheSize, blockSize, associativity;
-    string policyName;
-    vector<unsigned long long> trace;
+    unsigned long long accesses, misses, compulsory, capacity, conflict;
+    MissCounts() : accesses(0), misses(0), compulsory(0), capacity(0), conflict(0) {}
+};
 
-public:
-    bool loadFromFile(string filename)
+// Where the misses of a cache come from: per set, per region of memory
+// and per PC. Each miss is classified with a shadow fully associative LRU
+// cache of the same capacity, kept as stack distances: a first access to
+// a block is compulsory, a miss the shadow would also take is capacity,
+// and a miss the shadow would hit is conflict. The distances also give
+// the reuse-distance histogram.
+class MissReport
+{
+    int regionSize;
+    unsigned long long capacity; // blocks
+    StackDistance shadow;
+    MissCounts total;
+    vector<MissCounts> sets;
+    unordered_map<unsigned long long, MissCounts> regions, pcs;
+    bool hasPCs;
+
+    typedef vector<pair<unsigned long long, MissCounts>> Table;
+
+    static Table byMisses(const unordered_map<unsigned long long, MissCounts> &counts)
     {
-        ifstream fin(filename);
-        if (!fin.is_open())
+        Table table;
+        for (const auto &entry : counts)
+            if (entry.second.misses > 0)
+                table.push_back(entry);
+        sort(table.begin(), table.end(), [](const Table::value_type &a, const Table::value_type &b)
+             { return a.second.misses != b.second.misses ? a.second.misses > b.second.misses : a.first < b.first; });
+        return table;
+    }
+
+    // Reuse distances in power-of-two ranges: [0, 0], [1, 1], [2, 3], ...
+    vector<unsigned long long> reuseBuckets() const
+    {
+        vector<unsigned long long> buckets;
+        const vector<unsigned long long> &histogram = shadow.getHistogram();
+        for (size_t d = 0; d < histogram.size(); d++)
         {
-            cerr << "Error: Could not open " << filename << endl;
-            return false;
+            size_t b = d == 0 ? 0 : 64 - __builtin_clzll(d);
+            if (b >= buckets.size())
+                buckets.resize(b + 1, 0);
+            buckets[b] += histogram[d];
         }
-        string token;
-        while (fin >> token)
-        {
-            if (token == "CACHE_SIZE")
-                fin >> cacheSize;
-            else if (token == "BLOCK_SIZE")
-                fin >> blockSize;
+        return buckets;
+    }
+
+    static unsigned long long bucketLow(size_t b) { return b == 0 ? 0 : 1ULL << (b - 1); }
+    static unsigned long long bucketHigh(size_t b) { return b == 0 ? 0 : (1ULL << b) - 1; }
+
+    static string hex(unsigned long long value)
+    {
+        ostringstream out;
+        out << "0x" << std::hex << value;
+        return out.str();
+    }
+
+    static void csvCounts(ostream &out, const MissCounts &c)
+    {
+        out << "," << c.accesses << "," << c.misses << "," << c.compulsory << "," << c.capacity << "," << c.conflict << "\n";
+    }
+
+    static void jsonCounts(ostream &out, const MissCounts &c)
+    {
+        out << "\"accesses\": " << c.accesses << ", \"misses\": " << c.misses << ", \"compulsory\": " << c.compulsory
+            << ", \"capacity\": " << c.capacity << ", \"conflict\": " << c.conflict << "}";
+    }
+
+    static void jsonTable(ostream &out, const char *name, const char *key, const Table &table, unsigned long long scale)
+    {
+        out << ",\n  \"" << name << "\": [";
+        for (size_t i = 0; i < table.size(); i++)
+        {
+            out << (i ? ",\n    {" : "\n    {") << "\"" << key << "\": \"" << hex(table[i].first * scale) << "\", ";
+            jsonCounts(out, table[i].second);
+        }
+        out << "\n  ]";
+    }
+
+    void showTop(const char *title, const char *key, const Table &table, int top, unsigned long long scale) const
+    {
+        cout << "\n"
+             << title << "\n";
+        cout << left << setw(20) << key << right << setw(12) << "Misses" << setw(12) << "Compulsory"
+             << setw(12) << "Capacity" << setw(12) << "Conflict" << setw(10) << "Share" << "\n";
+        for (size_t i = 0; i < table.size() && (int)i < top; i++)
+        {
+            const MissCounts &c = table[i].second;
+            cout << left << setw(20) << hex(table[i].first * scale) << right << setw(12) << c.misses
+                 << setw(12) << c.compulsory << setw(12) << c.capacity << setw(12) << c.conflict
+                 << setw(9) << 100.0 * c.misses / max(total.misses, 1ULL) << "%\n";
+        }
+    }
+
+public:
+    MissReport(int setCount, int blockSize, unsigned long long blocks, int region)
+        : regionSize(region), capacity(blocks), shadow(blockSize), sets(setCount), hasPCs(false) {}
+
+    void record(unsigned long long address, unsigned long long pc, int setIndex, bool hit)
+    {
+        unsigned long long distance = shadow.access(address);
+        hasPCs = hasPCs || pc != 0;
+        MissCounts *counts[] = {&total, &sets[setIndex], &regions[address / regionSize], &pcs[pc]};
+        for (MissCounts *c : counts)
+        {
+            c->accesses++;
+            if (hit)
+                continue;
+            c->misses++;
+            if (distance == StackDistance::COLD)
+                c->compulsory++;
+            else if (distance >= capacity)
+                c->capacity++;
+            else
+                c->conflict++;
+        }
+    }
+
+    // The split of the misses, the busiest sets as a heat strip, and the
+    // top regions and PCs by misses.
+    void show(int top) const
+    {
+        unsigned long long misses = max(total.misses, 1ULL);
+        cout << "\nMISS ATTRIBUTION (shadow: fully associative LRU, " << capacity << " blocks)\n";
+        cout << "Compulsory: " << total.compulsory << " (" << 100.0 * total.compulsory / misses << "%)"
+             << "  Capacity: " << total.capacity << " (" << 100.0 * total.capacity / misses << "%)"
+             << "  Conflict: " << total.conflict << " (" << 100.0 * total.conflict / misses << "%)\n";
+
+        // Sets in 64 groups, each shaded by its misses against the worst.
+        const string shades = " .:-=+*#%@";
+        size_t groups = min<size_t>(64, sets.size());
+        vector<unsigned long long> heat(groups, 0);
+        for (size_t s = 0; s < sets.size(); s++)
+            heat[s * groups / sets.size()] += sets[s].misses;
+        unsigned long long hottest = max(*max_element(heat.begin(), heat.end()), 1ULL);
+        string strip;
+        for (unsigned long long h : heat)
+            strip += shades[h * (shades.size() - 1) / hottest];
+        double mean = (double)total.misses / sets.size();
+        size_t worst = 0;
+        for (size_t s = 0; s < sets.size(); s++)
+            if (sets[s].misses > sets[worst].misses)
+                worst = s;
+        cout << "Set misses |" << strip << "| (" << groups << " groups of " << sets.size() << " sets)\n";
+        cout << "Worst set: " << worst << " with " << sets[worst].misses << " misses ("
+             << sets[worst].misses / max(mean, 1e-9) << "x the mean), " << sets[worst].conflict << " of them conflict\n";
+
+        showTop("TOP REGIONS BY MISSES", "Region", byMisses(regions), top, regionSize);
+        if (hasPCs)
+            showTop("TOP PCS BY MISSES", "PC", byMisses(pcs), top, 1);
+
+        vector<unsigned long long> buckets = reuseBuckets();
+        cout << "\nREUSE DISTANCE (distinct blocks between uses)\n";
+        for (size_t b = 0; b < buckets.size(); b++)
+            cout << right << setw(12) << bucketLow(b) << " - " << left << setw(12) << bucketHigh(b)
+                 << right << setw(14) << buckets[b] << "\n";
+        cout << right << setw(27) << "first use" << setw(14) << shadow.getColdMisses() << "\n";
+    }
+
+    // Writes everything to path: JSON if it ends in .json, else CSV files
+    // path-sets.csv, path-regions.csv, path-pcs.csv and path-reuse.csv
+    // (dropping a .csv ending from path).
+    bool write(string path) const
+    {
+        bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        if (!json && path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0)
+            path.erase(path.size() - 4);
+        Table regionTable = byMisses(regions), pcTable = byMisses(pcs);
+        vector<unsigned long long> buckets = reuseBuckets();
+        if (json)
+        {
+            ofstream out(path);
+            out << "{\n  \"regionSize\": " << regionSize << ",\n  \"shadowBlocks\": " << capacity << ",\n  \"total\": {";
+            jsonCounts(out, total);
+            out << ",\n  \"sets\": [";
+            for (size_t s = 0; s < sets.size(); s++)
+            {
+                out << (s ? ",\n    {" : "\n    {") << "\"set\": " << s << ", ";
+                jsonCounts(out, sets[s]);
+            }
+            out << "\n  ]";
+            jsonTable(out, "regions", "address", regionTable, regionSize);
+            jsonTable(out, "pcs", "pc", pcTable, 1);
+            out << ",\n  \"reuse\": [";
+            for (size_t b = 0; b < buckets.size(); b++)
+                out << (b ? ",\n    " : "\n    ") << "{\"from\": " << bucketLow(b) << ", \"to\": " << bucketHigh(b)
+                    << ", \"accesses\": " << buckets[b] << "}";
+            out << "\n  ],\n  \"firstUses\": " << shadow.getColdMisses() << "\n}\n";
+            if (!out)
+            {
+                cerr << "Error: Could not write " << path << endl;
+                return false;
+            }
+            return true;
+        }
+
+        const char *header = ",accesses,misses,compulsory,capacity,conflict\n";
+        ofstream setsOut(path + "-sets.csv"), regionsOut(path + "-regions.csv"), pcsOut(path + "-pcs.csv"), reuseOut(path + "-reuse.csv");
+        setsOut << "set" << header;
+        for (size_t s = 0; s < sets.size(); s++)
+        {
+            setsOut << s;
+            csvCounts(setsOut, sets[s]);
+        }
+        regionsOut << "address" << header;
+        for (const auto &entry : regionTable)
+        {
+            regionsOut << hex(entry.first * regionSize);
+            csvCounts(regionsOut, entry.second);
+        }
+        pcsOut << "pc" << header;
+        for (const auto &entry : pcTable)
+        {
+            pcsOut << hex(entry.first);
+            csvCounts(pcsOut, entry.second);
+        }
+        reuseOut << "from,to,accesses\n";
+        for (size_t b = 0; b < buckets.size(); b++)
+            reuseOut << bucketLow(b) << "," << bucketHigh(b) << "," << buckets[b] << "\n";
+        reuseOut << "first use,," << shadow.getColdMisses() << "\n";
+        if (!setsOut || !regionsOut || !pcsOut || !reuseOut)
+        {
+            cerr << "Error: Could not write " << path << "-*.csv" << endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+//CACHE CLASS
+class Cache
+{
+private:
+    int cacheSize, blockSize, associativity, numSets;
+    // Every line, set after set: line = set * associativity + way.
+    vector<unsigned long long> tags;
+    vector<unsigned char> flags;
+    ReplacementPolicy *policy;
+    unsigned long long hits, misses, accesses;
+    string policyName;
+    bool isBelady;
+    int hitLatency, missPenalty; // cycles, for showStats()
+    // log2 of the block size and of the set count when they are powers of
+    // two, so decode() can shift and mask instead of dividing; else -1.
+    int blockShift, setShift;
+
+    // Prefetching (see Prefetcher); null without it. A block is useful if
+    // a demand access uses it before it is evicted. Blocks the prefetches
+    // evicted are kept in polluted until they are asked for again, when
+    // the miss counts as pollution.
+    Prefetcher *prefetcher;
+    string prefetcherName;
+    int prefetchDegree;
+    unsigned long long prefetches, usefulPrefetches, uselessPrefetches, pollution;
+    unordered_set<unsigned long long> polluted;
+    vector<unsigned long long> candidates;
+    bool lastPrefetchHit;
+
+    MissReport *report; // null unless misses are being attributed
+    int reportTop;
+
+    Cache(const Cache &);
+    Cache &operator=(const Cache &);
+
+    static int log2Exact(unsigned long long n)
+    {
+        if (n == 0 || (n & (n - 1)) != 0)
+            return -1;
+        int shift = 0;
+        while ((1ULL << shift) != n)
+            shift++;
+        return shift;
+    }
+
+public:
+    Cache(int c, int b, int a, string policyType, vector<unsigned long long> *trace = nullptr)
+        : cacheSize(c), blockSize(b), associativity(a),
+          hits(0), misses(0), accesses(0), policyName(policyType), hitLatency(1), missPenalty(100),
+          prefetcher(nullptr), prefetchDegree(0), prefetches(0), usefulPrefetches(0), uselessPrefetches(0),
+          pollution(0), lastPrefetchHit(false), report(nullptr), reportTop(0)
+    {
+        numSets = cacheSize / (blockSize * associativity);
+        tags.assign((size_t)numSets * associativity, 0);
+        flags.assign(tags.size(), 0);
+        blockShift = log2Exact(blockSize);
+        setShift = log2Exact(numSets);
+
+        for (auto &c : policyName)
+            c = toupper(c);
+        isBelady = false;
+        if (policyName == "FIFO")
+            policy = new FIFOReplacement(numSets, associativity);
+        else if (policyName == "LRU")
+            policy = new LRUReplacement(numSets, associativity);
+        else if (policyName == "LFU")
+            policy = new LFUReplacement(numSets, associativity);
+        else if (policyName == "PLRU")
+            policy = new PLRUReplacement(numSets, associativity);
+        else if (policyName == "SRRIP")
+            policy = new RRIPReplacement(numSets, associativity, RRIPReplacement::STATIC);
+        else if (policyName == "BRRIP")
+            policy = new RRIPReplacement(numSets, associativity, RRIPReplacement::BIMODAL);
+        else if (policyName == "DRRIP")
+            policy = new RRIPReplacement(numSets, associativity, RRIPReplacement::DYNAMIC);
+        else
+        {
+            policy = new BeladyReplacement(numSets, associativity, blockSize, trace);
+            isBelady = true;
+        }
+    }
+
+    ~Cache()
+    {
+        delete policy;
+        delete prefetcher;
+        delete report;
+    }
+
+    // Prefetches with NEXTLINE, STRIDE, STREAM or GHB, degree blocks at a
+    // time, on the demand accesses made through access(MemoryAccess).
+    void setPrefetcher(string name, int degree)
+    {
+        for (auto &c : name)
+            c = toupper(c);
+        delete prefetcher;
+        if (name == "NEXTLINE")
+            prefetcher = new NextLinePrefetcher(degree);
+        else if (name == "STRIDE")
+            prefetcher = new StridePrefetcher(degree);
+        else if (name == "STREAM")
+            prefetcher = new StreamPrefetcher(degree);
+        else
+            prefetcher = new GHBPrefetcher(degree);
+        prefetcherName = name;
+        prefetchDegree = degree;
+    }
+
+    pair<int, unsigned long long> decode(unsigned long long address)
+    {
+        unsigned long long blockNumber = blockShift >= 0 ? address >> blockShift : address / blockSize;
+        if (setShift >= 0)
+            return {(int)(blockNumber & (numSets - 1)), blockNumber >> setShift};
+        int setIndex = blockNumber % numSets;
+        unsigned long long tag = blockNumber / numSets;
+        return {setIndex, tag};
+    }
+
+    size_t lineOf(int setIndex, int way) const { return (size_t)setIndex * associativity + way; }
+
+    // The first way of the set whose tag word is key, or -1. Built with
+    // AVX2 or SSE4.1 (-march=native), this compares four or two ways at
+    // once.
+    int findKey(int setIndex, unsigned long long key) const
+    {
+        const unsigned long long *line = tags.data() + lineOf(setIndex, 0);
+        int way = 0;
+#if defined(__AVX2__)
+        __m256i wanted = _mm256_set1_epi64x((long long)key);
+        for (; way + 4 <= associativity; way += 4)
+        {
+            __m256i match = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(line + way)), wanted);
+            int mask = _mm256_movemask_pd(_mm256_castsi256_pd(match));
+            if (mask)
+                return way + __builtin_ctz(mask);
+        }
+#elif defined(__SSE4_1__)
+        __m128i wanted = _mm_set1_epi64x((long long)key);
+        for (; way + 2 <= associativity; way += 2)
+        {
+            __m128i match = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(line + way)), wanted);
+            int mask = _mm_movemask_pd(_mm_castsi128_pd(match));
+            if (mask)
+                return way + __builtin_ctz(mask);
+        }
+#endif
+        for (; way < associativity; way++)
+            if (line[way] == key)
+                return way;
+        return -1;
+    }
+
+    int findWay(int setIndex, unsigned long long tag) const { return findKey(setIndex, tag | VALID_TAG); }
+
+    unsigned long long blockAddress(int setIndex, unsigned long long tag) const
+    {
+        return (tag * numSets + setIndex) * blockSize;
+    }
+
+    // Puts the block in the set, in an invalid way if there is one and
+    // else in place of the policy's victim, which is reported in evicted.
+    void place(int setIndex, unsigned long long tag, bool dirty, Eviction *evicted, bool prefetch = false)
+    {
+        int victim = findKey(setIndex, 0);
+        if (victim == -1)
+        {
+            victim = policy->chooseVictim(setIndex);
+            size_t line = lineOf(setIndex, victim);
+            if (flags[line] & LINE_PREFETCHED)
+                uselessPrefetches++;
+            else if (prefetch)
+                polluted.insert(blockAddress(setIndex, tags[line] & ~VALID_TAG));
+            if (evicted)
+            {
+                evicted->valid = true;
+                evicted->address = blockAddress(setIndex, tags[line] & ~VALID_TAG);
+                evicted->dirty = flags[line] & LINE_DIRTY;
+            }
+        }
+
+        size_t line = lineOf(setIndex, victim);
+        tags[line] = tag | VALID_TAG;
+        flags[line] = (dirty ? LINE_DIRTY : 0) | (prefetch ? LINE_PREFETCHED : 0);
+        policy->onInsert(setIndex, victim);
+    }
+
+    // Looks the address up and counts the access. A hit marks the block
+    // dirty for a write; a miss fills the block unless allocate is false.
+    bool access(unsigned long long address, size_t index, bool write = false, bool allocate = true,
+                Eviction *evicted = nullptr)
+    {
+        accesses++;
+        if (isBelady)
+            ((BeladyReplacement *)policy)->setCurrentIndex(index);
+        auto decoded = decode(address);
+        int setIndex = decoded.first;
+        unsigned long long tag = decoded.second;
+
+        // Check for hit
+        int way = findWay(setIndex, tag);
+        if (way >= 0)
+        {
+            hits++;
+            unsigned char &state = flags[lineOf(setIndex, way)];
+            if (write)
+                state |= LINE_DIRTY;
+            lastPrefetchHit = state & LINE_PREFETCHED;
+            if (lastPrefetchHit)
+            {
+                usefulPrefetches++;
+                state &= ~LINE_PREFETCHED;
+            }
+            policy->onAccess(setIndex, way);
+            return true;
+        }
+
+        // Miss
+        misses++;
+        lastPrefetchHit = false;
+        if (!polluted.empty() && polluted.erase(blockAddress(setIndex, tag)))
+            pollution++;
+        if (allocate)
+            place(setIndex, tag, write, evicted);
+        return false;
+    }
+
+    // Attributes the misses of the demand accesses made through
+    // access(MemoryAccess) (see MissReport) to regions of regionSize bytes,
+    // showing the top of each table with the statistics.
+    void setReport(int regionSize, int top)
+    {
+        delete report;
+        report = new MissReport(numSets, blockSize, (unsigned long long)numSets * associativity, regionSize);
+        reportTop = top;
+    }
+
+    const MissReport *getReport() const { return report; }
+
+    // A demand access that also trains the prefetcher, if there is one,
+    // and brings in the blocks it names that are not here already.
+    bool access(const MemoryAccess &a, size_t index)
+    {
+        bool hit = access(a.address, index);
+        if (report)
+            report->record(a.address, a.pc, decode(a.address).first, hit);
+        if (!prefetcher)
+            return hit;
+        unsigned long long block = blockShift >= 0 ? a.address >> blockShift : a.address / blockSize;
+        candidates.clear();
+        prefetcher->onAccess(block, a.pc, hit, lastPrefetchHit, candidates);
+        for (unsigned long long b : candidates)
+        {
+            auto decoded = decode(b * blockSize);
+            if (findWay(decoded.first, decoded.second) >= 0)
+                continue;
+            prefetches++;
+            polluted.erase(b * blockSize);
+            place(decoded.first, decoded.second, false, nullptr, true);
+        }
+        return hit;
+    }
+
+    // Puts a block in the cache without counting an access, as when a
+    // lower level fills it or an upper level writes it back. A block
+    // already there only takes on the dirty bit.
+    void fill(unsigned long long address, size_t index, bool dirty, Eviction *evicted)
+    {
+        if (isBelady)
+            ((BeladyReplacement *)policy)->setCurrentIndex(index);
+        auto decoded = decode(address);
+        int way = findWay(decoded.first, decoded.second);
+        if (way >= 0)
+        {
+            if (dirty)
+                flags[lineOf(decoded.first, way)] |= LINE_DIRTY;
+            policy->onAccess(decoded.first, way);
+            return;
+        }
+        place(decoded.first, decoded.second, dirty, evicted);
+    }
+
+    bool contains(unsigned long long address)
+    {
+        auto decoded = decode(address);
+        return findWay(decoded.first, decoded.second) >= 0;
+    }
+
+    // Marks the block dirty if it is here; false if it is not.
+    bool markDirty(unsigned long long address)
+    {
+        auto decoded = decode(address);
+        int way = findWay(decoded.first, decoded.second);
+        if (way < 0)
+            return false;
+        flags[lineOf(decoded.first, way)] |= LINE_DIRTY;
+        return true;
+    }
+
+    // The dirty and shared bits of the block; false if it is not here.
+    bool getState(unsigned long long address, bool &dirty, bool &shared)
+    {
+        auto decoded = decode(address);
+        int way = findWay(decoded.first, decoded.second);
+        if (way < 0)
+            return false;
+        unsigned char state = flags[lineOf(decoded.first, way)];
+        dirty = state & LINE_DIRTY;
+        shared = state & LINE_SHARED;
+        return true;
+    }
+
+    bool setState(unsigned long long address, bool dirty, bool shared)
+    {
+        auto decoded = decode(address);
+        int way = findWay(decoded.first, decoded.second);
+        if (way < 0)
+            return false;
+        unsigned char &state = flags[lineOf(decoded.first, way)];
+        state = (state & ~(LINE_DIRTY | LINE_SHARED)) | (dirty ? LINE_DIRTY : 0) | (shared ? LINE_SHARED : 0);
+        return true;
+    }
+
+    // Drops the block if it is here, setting dirty to whether it was.
+    bool invalidate(unsigned long long address, bool &dirty)
+    {
+        auto decoded = decode(address);
+        int way = findWay(decoded.first, decoded.second);
+        if (way < 0)
+            return false;
+        size_t line = lineOf(decoded.first, way);
+        dirty = flags[line] & LINE_DIRTY;
+        tags[line] = 0;
+        flags[line] = 0;
+        return true;
+    }
+
+    void setLatency(int hit, int memory)
+    {
+        hitLatency = hit;
+        missPenalty = memory;
+    }
+
+    unsigned long long getAccesses() const { return accesses; }
+    unsigned long long getHits() const { return hits; }
+    unsigned long long getMisses() const { return misses; }
+    int getSets() const { return numSets; }
+    int setOf(unsigned long long address) { return decode(address).first; }
+
+    // Adds the counts of a copy of this cache that simulated other sets.
+    void addCounts(const Cache &other)
+    {
+        accesses += other.accesses;
+        hits += other.hits;
+        misses += other.misses;
+    }
+    int getSize() const { return cacheSize; }
+    int getAssociativity() const { return associativity; }
+    const string &getPolicy() const { return policyName; }
+
+    void printCacheState()
+    {
+        for (int s = 0; s < numSets; s++)
+        {
+            cout << "Set " << setw(2) << s << ": ";
+            for (int w = 0; w < associativity; w++)
+            {
+                unsigned long long tag = tags[lineOf(s, w)];
+                cout << (tag ? "[T" + to_string(tag & ~VALID_TAG) + "] " : "[ ] ");
+            }
+            cout << "\n";
+        }
+    }
+
+    void showStats()
+    {
+        double missRate = (double)misses / max(accesses, 1ULL);
+        double hitRate = 1.0 - missRate;
+        double AMAT = hitLatency + missRate * missPenalty;
+
+        cout << fixed << setprecision(2);
+        cout << "\nAccesses: " << accesses
+             << " | Hits: " << hits
+             << " | Misses: " << misses << endl;
+        cout << "Hit Rate: " << hitRate * 100 << "%  Miss Rate: " << missRate * 100 << "%\n";
+        cout << "Average Memory Access Time (AMAT): " << AMAT << " cycles\n";
+        if (prefetcher)
+            showPrefetchStats();
+        if (report)
+            report->show(reportTop);
+    }
+
+    // Accuracy is the share of prefetches used before eviction, coverage
+    // the share of misses they saved (of those saved and those left), and
+    // pollution the misses on blocks a prefetch evicted.
+    void showPrefetchStats()
+    {
+        unsigned long long unprefetched = misses + usefulPrefetches;
+        cout << "Prefetcher: " << prefetcherName << " (degree " << prefetchDegree << ")"
+             << " | Issued: " << prefetches
+             << " | Useful: " << usefulPrefetches
+             << " | Evicted unused: " << uselessPrefetches << endl;
+        cout << "Accuracy: " << 100.0 * usefulPrefetches / max(prefetches, 1ULL) << "%"
+             << "  Coverage: " << 100.0 * usefulPrefetches / max(unprefetched, 1ULL) << "%"
+             << "  Pollution: " << pollution << " misses ("
+             << 100.0 * pollution / max(misses, 1ULL) << "% of misses)\n";
+    }
+};
+
+// How the levels below L1 hold the blocks of the levels above.
+//   INCLUSIVE  every block above is also below; evicting a block below
+//              invalidates its copies above (back-invalidation)
+//   EXCLUSIVE  a block is in one level at most: misses fill L1 only, a
+//              hit below moves the block up to L1, and every victim moves
+//              one level down
+//   NINE       neither: misses fill every level they passed, and
+//              evictions below leave the levels above alone
+enum class Inclusion
+{
+    INCLUSIVE,
+    EXCLUSIVE,
+    NINE
+};
+
+inline string inclusionName(Inclusion inclusion)
+{
+    return inclusion == Inclusion::INCLUSIVE ? "inclusive" : (inclusion == Inclusion::EXCLUSIVE ? "exclusive" : "NINE");
+}
+
+// One level of a hierarchy as configured: L1I, L1D or L1, then L2, L3.
+struct LevelConfig
+{
+    string name;
+    int size, associativity, latency; // latency: cycles to look a block up
+    string policy;
+};
+
+// A cache hierarchy: an L1 (unified, or split into L1I for instruction
+// fetches and L1D for data) and the shared levels below it, all with one
+// block size, in front of memory. An access looks the levels up in turn,
+// paying each one's latency, until one holds the block, or else pays the
+// memory latency as well; AMAT is the average of these costs.
+//
+// Writes are write-back (dirty blocks are written to the level below when
+// evicted) or write-through (every write goes to memory and blocks stay
+// clean), and write-allocate (a write miss fills like a read) or not (it
+// updates whichever level holds the block, or memory).
+class CacheHierarchy
+{
+    vector<LevelConfig> configs;
+    vector<Cache *> levels;        // as configs
+    vector<unsigned long long> writebacks, backInvalidations; // per level
+    int instructionLevel;          // L1I, or -1 for a unified L1
+    int dataLevel;                 // L1D or L1
+    Inclusion inclusion;
+    bool writeBack, writeAllocate;
+    int memoryLatency;
+    unsigned long long accesses, cycles, memoryAccesses, memoryReads, memoryWrites;
+    vector<int> path; // levels looked up by the current access
+
+    CacheHierarchy(const CacheHierarchy &);
+    CacheHierarchy &operator=(const CacheHierarchy &);
+
+    // The level below, or -1 for memory.
+    int below(int level) const
+    {
+        int next = level < dataLevel ? dataLevel + 1 : level + 1;
+        return next < (int)levels.size() ? next : -1;
+    }
+
+    void fill(int level, unsigned long long address, size_t index, bool dirty)
+    {
+        Eviction evicted;
+        levels[level]->fill(address, index, dirty, &evicted);
+        if (evicted.valid)
+            evict(level, evicted, index);
+    }
+
+    void evict(int level, Eviction evicted, size_t index)
+    {
+        if (inclusion == Inclusion::INCLUSIVE && level > dataLevel)
+            for (int up = 0; up < level; up++)
+            {
+                bool dirty = false;
+                if (levels[up]->invalidate(evicted.address, dirty))
+                {
+                    backInvalidations[level]++;
+                    evicted.dirty = evicted.dirty || dirty;
+                }
+            }
+        // L1I and L1D may both hold a block; in an exclusive hierarchy it
+        // only moves down once neither does.
+        if (inclusion == Inclusion::EXCLUSIVE && instructionLevel >= 0 && level <= dataLevel)
+        {
+            Cache *other = levels[level == dataLevel ? instructionLevel : dataLevel];
+            if (other->contains(evicted.address))
+            {
+                if (evicted.dirty)
+                    other->markDirty(evicted.address);
+                return;
+            }
+        }
+        if (evicted.dirty)
+            writebacks[level]++;
+        int next = below(level);
+        if (next < 0)
+        {
+            if (evicted.dirty)
+                memoryWrites++;
+        }
+        else if (inclusion == Inclusion::EXCLUSIVE)
+            fill(next, evicted.address, index, evicted.dirty);
+        else if (evicted.dirty && !levels[next]->markDirty(evicted.address))
+            fill(next, evicted.address, index, true);
+    }
+
+public:
+    // configs start with L1I and L1D for a split L1, or with L1. trace is
+    // for levels that use Belady's algorithm.
+    CacheHierarchy(const vector<LevelConfig> &levelConfigs, int blockSize, Inclusion inclusionPolicy,
+                   bool isWriteBack, bool isWriteAllocate, int memory, vector<unsigned long long> *trace)
+        : configs(levelConfigs), writebacks(levelConfigs.size(), 0), backInvalidations(levelConfigs.size(), 0),
+          inclusion(inclusionPolicy), writeBack(isWriteBack), writeAllocate(isWriteAllocate), memoryLatency(memory),
+          accesses(0), cycles(0), memoryAccesses(0), memoryReads(0), memoryWrites(0), path(levelConfigs.size())
+    {
+        bool split = configs.size() > 1 && configs[0].name == "L1I";
+        instructionLevel = split ? 0 : -1;
+        dataLevel = split ? 1 : 0;
+        for (const auto &c : configs)
+            levels.push_back(new Cache(c.size, blockSize, c.associativity, c.policy, trace));
+    }
+
+    ~CacheHierarchy()
+    {
+        for (auto level : levels)
+            delete level;
+    }
+
+    void access(const MemoryAccess &a, size_t index)
+    {
+        accesses++;
+        bool write = a.type == ACCESS_WRITE;
+        bool dirtyWrite = write && writeBack;
+        bool allocate = !write || writeAllocate;
+        int first = a.type == ACCESS_FETCH && instructionLevel >= 0 ? instructionLevel : dataLevel;
+
+        int depth = 0, hitLevel = -1;
+        for (int level = first; level >= 0; level = below(level))
+        {
+            path[depth++] = level;
+            cycles += configs[level].latency;
+            // Without write-allocate a write dirties the block wherever it is.
+            if (levels[level]->access(a.address, index, dirtyWrite && (level == first || !allocate), false))
+            {
+                hitLevel = level;
+                break;
+            }
+        }
+        if (hitLevel < 0)
+        {
+            memoryAccesses++;
+            cycles += memoryLatency;
+            if (allocate)
+                memoryReads++;
+        }
+        if (write && (!writeBack || (hitLevel < 0 && !allocate)))
+            memoryWrites++;
+        if (!allocate || hitLevel == first)
+            return;
+
+        if (inclusion == Inclusion::EXCLUSIVE)
+        {
+            bool dirty = dirtyWrite;
+            if (hitLevel >= 0)
+            {
+                bool wasDirty = false;
+                levels[hitLevel]->invalidate(a.address, wasDirty);
+                dirty = dirty || wasDirty;
+            }
+            // L1I is never written, so a dirty block moving up into it
+            // writes its data back to memory on the way.
+            if (dirty && first == instructionLevel)
+            {
+                writebacks[hitLevel]++;
+                memoryWrites++;
+                dirty = false;
+            }
+            fill(first, a.address, index, dirty);
+            return;
+        }
+        // Fill the levels that missed from the bottom up, so that a
+        // back-invalidation cannot remove the block just put above.
+        for (int d = (hitLevel < 0 ? depth : depth - 1) - 1; d >= 0; d--)
+            fill(path[d], a.address, index, d == 0 && dirtyWrite);
+    }
+
+    void showStats()
+    {
+        double total = (double)max(accesses, 1ULL);
+        cout << "\nHIERARCHY: " << inclusionName(inclusion) << ", "
+             << (writeBack ? "write-back" : "write-through") << ", "
+             << (writeAllocate ? "write-allocate" : "no-write-allocate") << "\n";
+        cout << left << setw(8) << "Level" << right << setw(10) << "Size" << setw(7) << "Assoc"
+             << setw(8) << "Policy" << setw(9) << "Latency" << setw(13) << "Accesses" << setw(13) << "Hits"
+             << setw(13) << "Misses" << setw(11) << "Local MR" << setw(11) << "Global MR"
+             << setw(12) << "Writebacks" << setw(11) << "Back-inv" << "\n";
+        cout << fixed << setprecision(2);
+        for (size_t l = 0; l < levels.size(); l++)
+        {
+            const Cache &c = *levels[l];
+            cout << left << setw(8) << configs[l].name << right << setw(10) << c.getSize()
+                 << setw(7) << c.getAssociativity() << setw(8) << c.getPolicy() << setw(9) << configs[l].latency
+                 << setw(13) << c.getAccesses() << setw(13) << c.getHits() << setw(13) << c.getMisses()
+                 << setw(10) << 100.0 * c.getMisses() / max(c.getAccesses(), 1ULL) << "%"
+                 << setw(10) << 100.0 * c.getMisses() / total << "%"
+                 << setw(12) << writebacks[l] << setw(11) << backInvalidations[l] << "\n";
+        }
+        cout << left << setw(8) << "Memory" << right << setw(34) << memoryLatency << setw(13) << memoryAccesses
+             << "   reads " << memoryReads << ", writes " << memoryWrites << "\n";
+
+        cout << "\nAccesses: " << accesses << "\n";
+        cout << "Average Memory Access Time (AMAT): " << cycles / total << " cycles =";
+        for (size_t l = 0; l < levels.size(); l++)
+            cout << (l ? " + " : " ") << configs[l].name << " "
+                 << (double)levels[l]->getAccesses() * configs[l].latency / total;
+        cout << " + Memory " << (double)memoryAccesses * memoryLatency / total << "\n";
+    }
+};
+
+// Snooping protocols of CoherentCaches. A line's state is its dirty and
+// shared bits: M is dirty alone, O (MOESI only) dirty and shared, E clean
+// alone and S clean and shared.
+enum class Protocol
+{
+    MESI,
+    MOESI
+};
+
+// Cores whose copy of a block was invalidated and which have not missed
+// on it since, with the words of the block others wrote in the meantime.
+struct BlockSharing
+{
+    unsigned long long lostBy; // bit per core
+    vector<unsigned long long> written; // per core, bit per word
+};
+
+struct SharingCounts
+{
+    unsigned long long invalidations, trueSharing, falseSharing;
+};
+
+struct CoreStats
+{
+    unsigned long long busReads, busReadsExclusive, upgrades;
+    unsigned long long invalidationsSent, invalidationsReceived;
+    unsigned long long cacheToCache, writebacks, coherenceMisses;
+};
+
+// Most cores a CoherentCaches can have (BlockSharing keeps a bit each).
+const int MAX_CORES = 64;
+
+// N private caches, one per core, kept coherent by a MESI or MOESI
+// protocol over a snooping bus in front of memory. Accesses carry the
+// core that made them.
+//
+// A read miss (BusRd) takes the block shared if another cache holds it and
+// exclusive otherwise; a dirty holder supplies the data, and under MESI
+// also writes it back. A write miss (BusRdX) or a write hit on a shared
+// line (BusUpgr) invalidates every other copy.
+//
+// A miss on a block the core lost to an invalidation is a coherence miss.
+// It is true sharing if another core wrote the word it now wants since
+// then, and false sharing if the writes were only to other words of the
+// block. Words are blockSize / 64 bytes, and at least 4.
+class CoherentCaches
+{
+    vector<Cache *> caches;
+    vector<CoreStats> stats;
+    Protocol protocol;
+    int blockSize, wordSize;
+    unsigned long long memoryReads, memoryWrites;
+    unordered_map<unsigned long long, BlockSharing> sharing; // by block number
+    unordered_map<unsigned long long, SharingCounts> hotSpots;
+
+    CoherentCaches(const CoherentCaches &);
+    CoherentCaches &operator=(const CoherentCaches &);
+
+    void noteMiss(int core, unsigned long long block, unsigned long long word)
+    {
+        auto it = sharing.find(block);
+        if (it == sharing.end() || !(it->second.lostBy >> core & 1))
+            return;
+        stats[core].coherenceMisses++;
+        SharingCounts &counts = hotSpots[block];
+        if (it->second.written[core] & word)
+            counts.trueSharing++;
+        else
+            counts.falseSharing++;
+        it->second.lostBy &= ~(1ULL << core);
+        if (it->second.lostBy == 0)
+            sharing.erase(it);
+    }
+
+    void noteWrite(int core, unsigned long long block, unsigned long long word)
+    {
+        auto it = sharing.find(block);
+        if (it == sharing.end())
+            return;
+        for (int other = 0; other < (int)caches.size(); other++)
+            if (other != core && (it->second.lostBy >> other & 1))
+                it->second.written[other] |= word;
+    }
+
+    // Invalidates the other cores' copies of the block; true if one was dirty.
+    bool invalidateOthers(int core, unsigned long long address, unsigned long long word)
+    {
+        unsigned long long block = address / blockSize;
+        bool dirtyCopy = false;
+        for (int other = 0; other < (int)caches.size(); other++)
+        {
+            bool dirty = false;
+            if (other == core || !caches[other]->invalidate(address, dirty))
+                continue;
+            dirtyCopy = dirtyCopy || dirty;
+            stats[core].invalidationsSent++;
+            stats[other].invalidationsReceived++;
+            hotSpots[block].invalidations++;
+            BlockSharing &history = sharing[block];
+            if (history.written.empty())
+                history.written.assign(caches.size(), 0);
+            history.lostBy |= 1ULL << other;
+            history.written[other] = word;
+        }
+        return dirtyCopy;
+    }
+
+    void fill(int core, unsigned long long address, size_t index, bool dirty, bool shared)
+    {
+        Eviction evicted;
+        caches[core]->fill(address, index, dirty, &evicted);
+        caches[core]->setState(address, dirty, shared);
+        if (evicted.valid && evicted.dirty)
+        {
+            stats[core].writebacks++;
+            memoryWrites++;
+        }
+    }
+
+public:
+    CoherentCaches(int cores, int size, int block, int assoc, const string &policy, Protocol coherence)
+        : stats(cores, CoreStats()), protocol(coherence), blockSize(block), wordSize(max(4, block / 64)),
+          memoryReads(0), memoryWrites(0)
+    {
+        for (int c = 0; c < cores; c++)
+            caches.push_back(new Cache(size, block, assoc, policy));
+    }
+
+    ~CoherentCaches()
+    {
+        for (auto cache : caches)
+            delete cache;
+    }
+
+    // False if the access names a core there is no cache for.
+    bool access(const MemoryAccess &a, size_t index)
+    {
+        int core = a.core;
+        if (core >= (int)caches.size())
+            return false;
+        Cache &mine = *caches[core];
+        unsigned long long block = a.address / blockSize;
+        unsigned long long word = 1ULL << (a.address % blockSize / wordSize);
+        bool write = a.type == ACCESS_WRITE;
+
+        bool hit = mine.access(a.address, index, false, false);
+        if (!hit)
+            noteMiss(core, block, word);
+        if (write)
+            noteWrite(core, block, word);
+
+        bool dirty = false, shared = false;
+        if (hit)
+        {
+            mine.getState(a.address, dirty, shared);
+            if (write && shared)
+            {
+                stats[core].upgrades++;
+                invalidateOthers(core, a.address, word);
+            }
+            if (write)
+                mine.setState(a.address, true, false);
+            return true;
+        }
+
+        if (write)
+        {
+            stats[core].busReadsExclusive++;
+            if (invalidateOthers(core, a.address, word))
+                stats[core].cacheToCache++;
+            else
+                memoryReads++;
+            fill(core, a.address, index, true, false);
+            return true;
+        }
+
+        stats[core].busReads++;
+        bool held = false, supplied = false;
+        for (int other = 0; other < (int)caches.size(); other++)
+        {
+            if (other == core || !caches[other]->getState(a.address, dirty, shared))
+                continue;
+            held = true;
+            if (dirty)
+            {
+                supplied = true;
+                if (protocol == Protocol::MESI)
+                {
+                    // M flushes to memory and drops to S.
+                    stats[other].writebacks++;
+                    memoryWrites++;
+                    dirty = false;
+                }
+            }
+            caches[other]->setState(a.address, dirty, true);
+        }
+        if (supplied)
+            stats[core].cacheToCache++;
+        else
+            memoryReads++;
+        fill(core, a.address, index, false, held);
+        return true;
+    }
+
+    void showStats()
+    {
+        cout << "\nCOHERENCE: " << (protocol == Protocol::MESI ? "MESI" : "MOESI") << " snooping bus, "
+             << caches.size() << " cores\n";
+        cout << left << setw(6) << "Core" << right << setw(12) << "Accesses" << setw(12) << "Misses"
+             << setw(10) << "Miss %" << setw(12) << "Coherence" << setw(10) << "BusRd" << setw(10) << "BusRdX"
+             << setw(10) << "BusUpgr" << setw(11) << "Inv sent" << setw(11) << "Inv recv"
+             << setw(10) << "C2C" << setw(12) << "Writebacks" << "\n";
+        CoreStats total = CoreStats();
+        unsigned long long accesses = 0, misses = 0;
+        cout << fixed << setprecision(2);
+        for (size_t c = 0; c < caches.size(); c++)
+        {
+            const CoreStats &s = stats[c];
+            const Cache &cache = *caches[c];
+            cout << left << setw(6) << c << right << setw(12) << cache.getAccesses() << setw(12) << cache.getMisses()
+                 << setw(9) << 100.0 * cache.getMisses() / max(cache.getAccesses(), 1ULL) << "%"
+                 << setw(12) << s.coherenceMisses << setw(10) << s.busReads << setw(10) << s.busReadsExclusive
+                 << setw(10) << s.upgrades << setw(11) << s.invalidationsSent << setw(11) << s.invalidationsReceived
+                 << setw(10) << s.cacheToCache << setw(12) << s.writebacks << "\n";
+            accesses += cache.getAccesses();
+            misses += cache.getMisses();
+            total.coherenceMisses += s.coherenceMisses;
+            total.busReads += s.busReads;
+            total.busReadsExclusive += s.busReadsExclusive;
+            total.upgrades += s.upgrades;
+            total.invalidationsSent += s.invalidationsSent;
+            total.invalidationsReceived += s.invalidationsReceived;
+            total.cacheToCache += s.cacheToCache;
+            total.writebacks += s.writebacks;
+        }
+        unsigned long long transactions = total.busReads + total.busReadsExclusive + total.upgrades;
+        cout << left << setw(6) << "All" << right << setw(12) << accesses << setw(12) << misses
+             << setw(9) << 100.0 * misses / max(accesses, 1ULL) << "%" << setw(12) << total.coherenceMisses
+             << setw(10) << total.busReads << setw(10) << total.busReadsExclusive << setw(10) << total.upgrades
+             << setw(11) << total.invalidationsSent << setw(11) << total.invalidationsReceived
+             << setw(10) << total.cacheToCache << setw(12) << total.writebacks << "\n";
+
+        cout << "\nBus transactions: " << transactions << " (" << transactions * (caches.size() - 1)
+             << " snoop lookups), memory reads " << memoryReads << ", writes " << memoryWrites << "\n";
+
+        unsigned long long trueSharing = 0, falseSharing = 0;
+        vector<pair<unsigned long long, SharingCounts>> spots(hotSpots.begin(), hotSpots.end());
+        for (const auto &spot : spots)
+        {
+            trueSharing += spot.second.trueSharing;
+            falseSharing += spot.second.falseSharing;
+        }
+        cout << "Coherence misses: " << total.coherenceMisses << " (true sharing " << trueSharing
+             << ", false sharing " << falseSharing << ")\n";
+        if (spots.empty())
+            return;
+
+        // The blocks that cost the most coherence traffic.
+        const size_t shown = 10;
+        sort(spots.begin(), spots.end(), [](const pair<unsigned long long, SharingCounts> &a, const pair<unsigned long long, SharingCounts> &b)
+             {
+                 if (a.second.falseSharing != b.second.falseSharing)
+                     return a.second.falseSharing > b.second.falseSharing;
+                 if (a.second.invalidations != b.second.invalidations)
+                     return a.second.invalidations > b.second.invalidations;
+                 return a.first < b.first;
+             });
+        cout << "\nContended blocks:\n";
+        cout << left << setw(20) << "Block" << right << setw(15) << "Invalidations" << setw(15) << "True sharing"
+             << setw(15) << "False sharing" << "\n";
+        for (size_t i = 0; i < spots.size() && i < shown; i++)
+        {
+            stringstream address;
+            address << "0x" << hex << spots[i].first * blockSize;
+            cout << left << setw(20) << address.str() << right << setw(15) << spots[i].second.invalidations
+                 << setw(15) << spots[i].second.trueSharing << setw(15) << spots[i].second.falseSharing << "\n";
+        }
+    }
+};
+
+// Accesses handed from the trace reader to the cache at a time in batch mode.
+const size_t TRACE_BATCH = 1 << 16;
+// Addresses read ahead while the threads of a partitioned run simulate.
+const size_t PARTITION_CHUNK = 1 << 22;
+
+// False (with a message) unless a cache of this shape can be built.
+static bool checkCache(const string &name, int size, int block, int assoc, const string &policy)
+{
+    string upper = policy;
+    for (auto &c : upper)
+        c = toupper(c);
+    static const set<string> policies = {"FIFO", "LRU", "LFU", "PLRU", "SRRIP", "BRRIP", "DRRIP", "BELADY"};
+    if (!policies.count(upper))
+    {
+        cerr << "Error: Unknown policy " << policy << endl;
+        return false;
+    }
+    if (size <= 0 || block <= 0 || assoc <= 0 || size % ((long long)block * assoc) != 0)
+    {
+        cerr << "Error: " << name << " size must be a positive multiple of block size x associativity" << endl;
+        return false;
+    }
+    if (upper == "PLRU" && (assoc & (assoc - 1)) != 0)
+    {
+        cerr << "Error: PLRU needs a power-of-two associativity" << endl;
+        return false;
+    }
+    return true;
+}
+
+static bool isBeladyPolicy(string policy)
+{
+    for (auto &c : policy)
+        c = toupper(c);
+    return policy == "BELADY";
+}
+
+// One cache of a sweep, and its results.
+struct SweepConfig
+{
+    int size, block, associativity;
+    string policy;
+    unsigned long long accesses, misses;
+};
+
+// Simulator starts from here
+class CacheSimulator
+{
+private:
+    int cacheSize, blockSize, associativity;
+    string policyName;
+    vector<unsigned long long> trace;
+    int hitLatency, memoryLatency;
+    vector<LevelConfig> levels; // empty: a single cache
+    Inclusion inclusion;
+    bool writeBack, writeAllocate;
+    int cores; // 0: no coherence
+    Protocol protocol;
+    string prefetcherName; // empty: no prefetching
+    int prefetchDegree;
+    int partitions; // threads the sets of the single cache are split over; 0: none
+    bool attribute; // attribute the misses of the single cache (see MissReport)
+    string reportPath; // where to write them too; empty: nowhere
+    int regionSize, reportTop;
+
+public:
+    CacheSimulator()
+        : cacheSize(16384), blockSize(64), associativity(4), policyName("LRU"), hitLatency(1), memoryLatency(100),
+          inclusion(Inclusion::INCLUSIVE), writeBack(true), writeAllocate(true), cores(0), protocol(Protocol::MESI),
+          prefetchDegree(2), partitions(0),
+          attribute(false), regionSize(0), reportTop(10) {}
+
+    void configure(int size, int block, int assoc, const string &policy)
+    {
+        cacheSize = size;
+        blockSize = block;
+        associativity = assoc;
+        policyName = policy;
+    }
+
+    void setLatency(int hit, int memory)
+    {
+        hitLatency = hit;
+        memoryLatency = memory;
+    }
+
+    // Simulates a hierarchy of levels (see CacheHierarchy) instead of
+    // the single cache.
+    void configureHierarchy(const vector<LevelConfig> &levelConfigs, Inclusion inclusionPolicy,
+                            bool isWriteBack, bool isWriteAllocate)
+    {
+        levels = levelConfigs;
+        inclusion = inclusionPolicy;
+        writeBack = isWriteBack;
+        writeAllocate = isWriteAllocate;
+    }
+
+    // Simulates a private cache per core, shaped like the single cache
+    // and kept coherent (see CoherentCaches).
+    void configureCores(int coreCount, Protocol coherence)
+    {
+        cores = coreCount;
+        protocol = coherence;
+    }
+
+    // Prefetches into the single cache (see Cache::setPrefetcher).
+    void configurePrefetcher(const string &name, int degree)
+    {
+        prefetcherName = name;
+        prefetchDegree = degree;
+    }
+
+    // Attributes the misses of the single cache to regions of region bytes
+    // (0: blocks), showing the top entries, and writes them to path unless
+    // it is empty (see MissReport::write).
+    void configureReport(const string &path, int region, int top)
+    {
+        attribute = true;
+        reportPath = path;
+        regionSize = region;
+        reportTop = top;
+    }
+
+    // Splits the sets of the single cache over threads (see
+    // runPartitioned).
+    void configurePartitions(int threads) { partitions = threads; }
+
+    // False (with a message) unless every cache holds a whole number of
+    // sets. Belady's algorithm needs to know which block each access
+    // brings in, so in a hierarchy only L1 can use it.
+    bool validate()
+    {
+        if (attribute && (cores != 0 || !levels.empty() || partitions != 0 || regionSize < 0 || reportTop < 0))
+        {
+            cerr << "Error: Miss attribution needs a single cache, not --partition" << endl;
+            return false;
+        }
+        if (partitions != 0)
+        {
+            // BRRIP and DRRIP count insertions across all sets, Belady's
+            // algorithm needs the whole trace, and prefetches cross sets.
+            string upper = policyName;
+            for (auto &c : upper)
+                c = toupper(c);
+            static const set<string> independent = {"FIFO", "LRU", "LFU", "PLRU", "SRRIP"};
+            if (partitions < 1 || cores != 0 || !levels.empty() || !prefetcherName.empty() || !independent.count(upper))
+            {
+                cerr << "Error: --partition needs a single cache with FIFO, LRU, LFU, PLRU or SRRIP and no prefetcher" << endl;
+                return false;
+            }
+        }
+        if (!prefetcherName.empty())
+        {
+            string upper = prefetcherName;
+            for (auto &c : upper)
+                c = toupper(c);
+            if (upper != "NEXTLINE" && upper != "STRIDE" && upper != "STREAM" && upper != "GHB")
+            {
+                cerr << "Error: Unknown prefetcher " << prefetcherName << endl;
+                return false;
+            }
+            // Belady's algorithm keys each block it inserts by the next use
+            // of the block being accessed, which a prefetch is not.
+            if (cores != 0 || !levels.empty() || isBeladyPolicy(policyName) || prefetchDegree < 1)
+            {
+                cerr << "Error: --prefetch needs a single cache, not BELADY, and a degree of 1 or more" << endl;
+                return false;
+            }
+        }
+        if (cores != 0)
+        {
+            if (cores < 1 || cores > MAX_CORES || !levels.empty() || isBeladyPolicy(policyName))
+            {
+                cerr << "Error: --cores takes 1 to " << MAX_CORES << " cores of a single cache level, not BELADY" << endl;
+                return false;
+            }
+            return checkCache("Cache", cacheSize, blockSize, associativity, policyName);
+        }
+        if (levels.empty())
+            return checkCache("Cache", cacheSize, blockSize, associativity, policyName);
+        for (size_t l = 0; l < levels.size(); l++)
+        {
+            const LevelConfig &c = levels[l];
+            if (!checkCache(c.name, c.size, blockSize, c.associativity, c.policy))
+                return false;
+            if (isBeladyPolicy(c.policy) && c.name.compare(0, 2, "L1") != 0)
+            {
+                cerr << "Error: BELADY can only be used by L1 in a hierarchy" << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool loadFromFile(string filename)
+    {
+        ifstream fin(filename);
+        if (!fin.is_open())
+        {
+            cerr << "Error: Could not open " << filename << endl;
+            return false;
+        }
+        string token;
+        while (fin >> token)
+        {
+            if (token == "CACHE_SIZE")
+                fin >> cacheSize;
+            else if (token == "BLOCK_SIZE")
+                fin >> blockSize;
             else if (token == "ASSOCIATIVITY")
                 fin >> associativity;
             else if (token == "POLICY")
@@ -310,7 +2189,7 @@ public:
 
         for (size_t i = 0; i < trace.size(); i++)
         {
-            bool hit = cache.access(trace[i], i, &trace);
+            bool hit = cache.access(trace[i], i);
             cout << "Access " << setw(2) << i + 1
                  << " | Addr: " << setw(6) << trace[i]
                  << " | " << (hit ? "HIT" : "MISS") << "\n";
@@ -321,13 +2200,645 @@ public:
         cache.showStats();
         cout << "\nSimulation Complete.\n";
     }
+
+    // Streams a trace file through the cache (or hierarchy) with no
+    // per-access output and prints the statistics at the end. Belady's algorithm looks ahead, so
+    // for it the whole trace is read into memory first.
+    bool runBatch(const string &path, TraceFormat format)
+    {
+        if (partitions != 0)
+            return runPartitioned(path, format);
+        TraceReader reader;
+        string error;
+        if (!reader.open(path, format, error))
+        {
+            cerr << "Error: " << error << endl;
+            return false;
+        }
+        bool lookAhead = levels.empty() && isBeladyPolicy(policyName);
+        for (const auto &c : levels)
+            lookAhead = lookAhead || isBeladyPolicy(c.policy);
+        unique_ptr<Cache> cache;
+        unique_ptr<CacheHierarchy> hierarchy;
+        unique_ptr<CoherentCaches> coherent;
+        if (cores != 0)
+            coherent.reset(new CoherentCaches(cores, cacheSize, blockSize, associativity, policyName, protocol));
+        else if (levels.empty())
+        {
+            cache.reset(new Cache(cacheSize, blockSize, associativity, policyName, &trace));
+            cache->setLatency(hitLatency, memoryLatency);
+            if (!prefetcherName.empty())
+                cache->setPrefetcher(prefetcherName, prefetchDegree);
+            if (attribute)
+                cache->setReport(regionSize > 0 ? regionSize : blockSize, reportTop);
+        }
+        else
+            hierarchy.reset(new CacheHierarchy(levels, blockSize, inclusion, writeBack, writeAllocate, memoryLatency, &trace));
+
+        vector<MemoryAccess> batch(TRACE_BATCH), recorded;
+        auto start = chrono::steady_clock::now();
+        size_t index = 0, n;
+        bool badCore = false;
+        auto simulate = [&](const MemoryAccess &a)
+        {
+            if (cache)
+                cache->access(a, index++);
+            else if (hierarchy)
+                hierarchy->access(a, index++);
+            else if (!coherent->access(a, index++))
+                badCore = true;
+        };
+        while ((n = reader.read(batch.data(), batch.size())) > 0 && !badCore)
+        {
+            if (lookAhead)
+            {
+                for (size_t i = 0; i < n; i++)
+                    trace.push_back(batch[i].address);
+                recorded.insert(recorded.end(), batch.begin(), batch.begin() + n);
+                continue;
+            }
+            for (size_t i = 0; i < n; i++)
+                simulate(batch[i]);
+        }
+        if (!reader.getError().empty())
+        {
+            cerr << "Error: " << path << ": " << reader.getError() << endl;
+            return false;
+        }
+        for (size_t i = 0; i < recorded.size(); i++)
+            simulate(recorded[i]);
+        if (badCore)
+        {
+            cerr << "Error: " << path << " has accesses from core " << cores << " or above" << endl;
+            return false;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "\nCACHE CONFIGURATION:\n";
+        if (!hierarchy)
+            cout << (coherent ? to_string(cores) + " x " : "") << "Cache Size: " << cacheSize << "B, Block: " << blockSize
+                 << "B, Assoc: " << associativity
+                 << "-way, Policy: " << policyName << "\n";
+        else
+            cout << levels.size() << " levels, Block: " << blockSize << "B, Memory latency: " << memoryLatency << " cycles\n";
+        cout << "Trace: " << path << "\n";
+        if (cache)
+            cache->showStats();
+        else if (hierarchy)
+            hierarchy->showStats();
+        else
+            coherent->showStats();
+        cout << "Simulated in " << setprecision(3) << seconds << " s ("
+             << setprecision(1) << index / max(seconds, 1e-9) / 1e6 << "M accesses/s)\n";
+        if (cache && !reportPath.empty())
+            return cache->getReport()->write(reportPath);
+        return true;
+    }
+
+    // Simulates the single cache with its sets split into contiguous
+    // ranges, one per worker thread. Each worker keeps a cache of just its
+    // own sets and lives for the whole run. The main thread reads the
+    // trace and sorts every chunk of it into one bucket per worker once,
+    // renumbering each block so that its set in the worker's cache is its
+    // set less the first of the range and its tag is unchanged; while the
+    // workers simulate one chunk it sorts the next. The policies
+    // validate() allows keep nothing across sets, so the summed counts
+    // are those of the sequential run.
+    bool runPartitioned(const string &path, TraceFormat format)
+    {
+        TraceReader reader;
+        string error;
+        if (!reader.open(path, format, error))
+        {
+            cerr << "Error: " << error << endl;
+            return false;
+        }
+        Cache total(cacheSize, blockSize, associativity, policyName);
+        total.setLatency(hitLatency, memoryLatency);
+        int sets = total.getSets(), threads = min(partitions, sets);
+        vector<int> low(threads + 1), owner(sets);
+        vector<unique_ptr<Cache>> caches;
+        for (int t = 0; t <= threads; t++)
+            low[t] = (long long)t * sets / threads;
+        for (int t = 0; t < threads; t++)
+        {
+            caches.emplace_back(new Cache((low[t + 1] - low[t]) * associativity * blockSize, blockSize, associativity, policyName));
+            for (int set = low[t]; set < low[t + 1]; set++)
+                owner[set] = t;
+        }
+
+        // The workers take work, the reader fills filling, and they swap
+        // once every worker is idle.
+        vector<vector<unsigned long long>> work(threads), filling(threads);
+        mutex lock;
+        condition_variable started, finished;
+        unsigned long long generation = 0;
+        int busy = 0;
+        bool stopping = false;
+        vector<thread> pool;
+        for (int t = 0; t < threads; t++)
+            pool.emplace_back([&, t]()
+                              {
+                                  Cache &cache = *caches[t];
+                                  unsigned long long seen = 0;
+                                  while (true)
+                                  {
+                                      {
+                                          unique_lock<mutex> guard(lock);
+                                          started.wait(guard, [&]() { return generation != seen || stopping; });
+                                          if (generation == seen)
+                                              return;
+                                          seen = generation;
+                                      }
+                                      // Belady's algorithm, the only user of the index, cannot be partitioned.
+                                      const vector<unsigned long long> &blocks = work[t];
+                                      for (size_t i = 0; i < blocks.size(); i++)
+                                          cache.access(blocks[i], i);
+                                      lock_guard<mutex> guard(lock);
+                                      if (--busy == 0)
+                                          finished.notify_one();
+                                  }
+                              });
+
+        vector<MemoryAccess> batch(TRACE_BATCH);
+        auto start = chrono::steady_clock::now();
+        size_t simulated = 0;
+        while (true)
+        {
+            size_t chunk = 0;
+            for (int t = 0; t < threads; t++)
+                filling[t].clear();
+            for (size_t n; chunk < PARTITION_CHUNK && (n = reader.read(batch.data(), batch.size())) > 0; chunk += n)
+                for (size_t i = 0; i < n; i++)
+                {
+                    pair<int, unsigned long long> block = total.decode(batch[i].address);
+                    int t = owner[block.first];
+                    filling[t].push_back(caches[t]->blockAddress(block.first - low[t], block.second));
+                }
+            unique_lock<mutex> guard(lock);
+            finished.wait(guard, [&]() { return busy == 0; });
+            if (chunk == 0)
+                break;
+            swap(work, filling);
+            simulated += chunk;
+            generation++;
+            busy = threads;
+            started.notify_all();
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        started.notify_all();
+        for (auto &th : pool)
+            th.join();
+        if (!reader.getError().empty())
+        {
+            cerr << "Error: " << path << ": " << reader.getError() << endl;
+            return false;
+        }
+        for (int t = 0; t < threads; t++)
+            total.addCounts(*caches[t]);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "\nCACHE CONFIGURATION:\n";
+        cout << "Cache Size: " << cacheSize << "B, Block: " << blockSize
+             << "B, Assoc: " << associativity
+             << "-way, Policy: " << policyName << ", Sets split over " << threads << " threads\n";
+        cout << "Trace: " << path << "\n";
+        total.showStats();
+        cout << "Simulated in " << setprecision(3) << seconds << " s ("
+             << setprecision(1) << simulated / max(seconds, 1e-9) / 1e6 << "M accesses/s)\n";
+        return true;
+    }
+
+    // Prints the miss ratio of every size of LRU cache (see StackDistance)
+    // after one pass over the trace.
+    bool runMissRatioCurve(const string &path, TraceFormat format)
+    {
+        TraceReader reader;
+        string error;
+        if (!reader.open(path, format, error))
+        {
+            cerr << "Error: " << error << endl;
+            return false;
+        }
+        StackDistance stack(blockSize);
+        vector<MemoryAccess> batch(TRACE_BATCH);
+        auto start = chrono::steady_clock::now();
+        size_t total = 0, n;
+        while ((n = reader.read(batch.data(), batch.size())) > 0)
+        {
+            for (size_t i = 0; i < n; i++)
+                stack.access(batch[i].address);
+            total += n;
+        }
+        if (!reader.getError().empty())
+        {
+            cerr << "Error: " << path << ": " << reader.getError() << endl;
+            return false;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Trace: " << path << "\n";
+        stack.showCurve();
+        cout << "Simulated in " << setprecision(3) << seconds << " s ("
+             << setprecision(1) << total / max(seconds, 1e-9) / 1e6 << "M accesses/s)\n";
+        return true;
+    }
+
+    // Simulates every config over the trace on up to threads threads. Each
+    // thread streams the trace once, handing every batch to each of its
+    // caches in turn. With Belady's algorithm among the configs the trace
+    // is read into memory once and shared instead.
+    bool runSweep(const string &path, TraceFormat format, vector<SweepConfig> configs, int threads)
+    {
+        threads = max(1, min(threads, (int)configs.size()));
+        bool lookAhead = false;
+        for (const auto &c : configs)
+            lookAhead = lookAhead || isBeladyPolicy(c.policy);
+        string error;
+        {
+            TraceReader reader;
+            if (!reader.open(path, format, error))
+            {
+                cerr << "Error: " << error << endl;
+                return false;
+            }
+            vector<MemoryAccess> batch(TRACE_BATCH);
+            for (size_t n; lookAhead && (n = reader.read(batch.data(), batch.size())) > 0;)
+                for (size_t i = 0; i < n; i++)
+                    trace.push_back(batch[i].address);
+            error = reader.getError();
+        }
+
+        auto start = chrono::steady_clock::now();
+        vector<string> errors(threads);
+        auto worker = [&](int t)
+        {
+            vector<unique_ptr<Cache>> caches;
+            for (size_t c = t; c < configs.size(); c += threads)
+                caches.emplace_back(new Cache(configs[c].size, configs[c].block, configs[c].associativity, configs[c].policy, &trace));
+            auto feed = [&](const unsigned long long *addresses, size_t n, size_t first)
+            {
+                for (auto &cache : caches)
+                    for (size_t i = 0; i < n; i++)
+                        cache->access(addresses[i], first + i);
+            };
+            if (lookAhead)
+            {
+                for (size_t first = 0; first < trace.size(); first += TRACE_BATCH)
+                    feed(trace.data() + first, min(TRACE_BATCH, trace.size() - first), first);
+            }
+            else
+            {
+                TraceReader reader;
+                string openError;
+                if (!reader.open(path, format, openError))
+                {
+                    errors[t] = openError;
+                    return;
+                }
+                vector<MemoryAccess> batch(TRACE_BATCH);
+                vector<unsigned long long> addresses(TRACE_BATCH);
+                size_t first = 0;
+                for (size_t n; (n = reader.read(batch.data(), batch.size())) > 0; first += n)
+                {
+                    for (size_t i = 0; i < n; i++)
+                        addresses[i] = batch[i].address;
+                    feed(addresses.data(), n, first);
+                }
+                errors[t] = reader.getError();
+            }
+            for (size_t c = t, k = 0; c < configs.size(); c += threads, k++)
+            {
+                configs[c].accesses = caches[k]->getAccesses();
+                configs[c].misses = caches[k]->getMisses();
+            }
+        };
+        vector<thread> pool;
+        for (int t = 0; t < threads; t++)
+            pool.emplace_back(worker, t);
+        for (auto &th : pool)
+            th.join();
+        for (const auto &e : errors)
+            if (error.empty())
+                error = e;
+        if (!error.empty())
+        {
+            cerr << "Error: " << path << ": " << error << endl;
+            return false;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "Trace: " << path << "\n";
+        cout << "\nSWEEP: " << configs.size() << " caches on " << threads << " threads\n";
+        cout << right << setw(12) << "Size" << setw(8) << "Block" << setw(8) << "Assoc" << setw(9) << "Policy"
+             << setw(14) << "Accesses" << setw(14) << "Misses" << setw(12) << "Miss Rate" << "\n";
+        cout << fixed << setprecision(2);
+        unsigned long long simulated = 0;
+        for (const auto &c : configs)
+        {
+            cout << setw(11) << c.size << "B" << setw(7) << c.block << "B" << setw(8) << c.associativity
+                 << setw(9) << c.policy << setw(14) << c.accesses << setw(14) << c.misses
+                 << setw(11) << 100.0 * c.misses / max(c.accesses, 1ULL) << "%\n";
+            simulated += c.accesses;
+        }
+        cout << "Simulated in " << setprecision(3) << seconds << " s ("
+             << setprecision(1) << simulated / max(seconds, 1e-9) / 1e6 << "M cache accesses/s)\n";
+        return true;
+    }
 };
 
+static void usage()
+{
+    cerr << "usage: cacheSimulator                 run cacheData.txt, showing every access\n"
+         << "       cacheSimulator [options] TRACE  stream TRACE and print only the statistics\n"
+         << "  --size BYTES     cache size (default 16384)\n"
+         << "  --block BYTES    block size (default 64)\n"
+         << "  --assoc WAYS     associativity (default 4)\n"
+         << "  --policy NAME    FIFO, LRU, LFU, PLRU, SRRIP, BRRIP, DRRIP or BELADY\n"
+         << "                   (default LRU)\n"
+         << "  --latency CYCLES hit latency (default 1)\n"
+         << "  --memory CYCLES  memory latency (default 100)\n"
+         << "  --format NAME    text, bin32, bin64, lackey, pin, dinero or cores\n"
+         << "                   (default: from the file extension)\n"
+         << "  --prefetch NAME  nextline, stride, stream or ghb (single cache only)\n"
+         << "  --prefetch-degree N  blocks prefetched at a time (default 2)\n"
+         << "  --attribute      split the misses by set, region and PC into compulsory,\n"
+         << "                   capacity and conflict, with reuse distances (single cache)\n"
+         << "  --report PATH    --attribute, also written to PATH.json, or to CSV files\n"
+         << "                   PATH-sets.csv, PATH-regions.csv, PATH-pcs.csv, PATH-reuse.csv\n"
+         << "  --region BYTES   region size for --attribute (default: the block size)\n"
+         << "  --top N          regions and PCs shown by --attribute (default 10)\n"
+         << "hierarchy (each level SIZE:ASSOC:LATENCY[:POLICY]; blocks are --block bytes):\n"
+         << "  --l1 LEVEL       unified L1 (default: --size, --assoc, --latency, --policy)\n"
+         << "  --l1i LEVEL, --l1d LEVEL   split L1 for instructions and data\n"
+         << "  --l2 LEVEL, --l3 LEVEL     shared levels below L1\n"
+         << "  --inclusion NAME inclusive, exclusive or nine (default inclusive)\n"
+         << "  --write-through  instead of write-back\n"
+         << "  --no-write-allocate\n"
+         << "multi-core (a private cache of --size etc. per core; use a cores trace):\n"
+         << "  --cores N        simulate N coherent caches\n"
+         << "  --protocol NAME  mesi or moesi (default mesi)\n"
+         << "design-space exploration:\n"
+         << "  --mrc            miss ratio of every LRU cache size, in one pass\n"
+         << "  --sweep          simulate every combination of the lists below\n"
+         << "  --sizes LIST, --blocks LIST, --assocs LIST, --policies LIST\n"
+         << "                   comma-separated (default: --size, --block, ...)\n"
+         << "  --partition      split the sets of a single cache over --threads threads\n"
+         << "                   (FIFO, LRU, LFU, PLRU or SRRIP; same results)\n"
+         << "  --threads N      threads for --sweep and --partition (default: all cores)\n"
+         << "Sizes take a K, M or G suffix.\n";
+}
+
+// Reads a byte count such as 4096, 32K or 8M.
+static int parseSize(const string &text)
+{
+    char *end = nullptr;
+    long long value = strtoll(text.c_str(), &end, 10);
+    if (*end == 'K' || *end == 'k')
+        value <<= 10;
+    else if (*end == 'M' || *end == 'm')
+        value <<= 20;
+    else if (*end == 'G' || *end == 'g')
+        value <<= 30;
+    return value > INT_MAX || value < 0 ? -1 : (int)value;
+}
+
+static vector<string> splitList(const string &text)
+{
+    vector<string> items;
+    stringstream in(text);
+    for (string item; getline(in, item, ',');)
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+// Reads SIZE:ASSOC:LATENCY[:POLICY] for the level called name.
+static bool parseLevel(const string &name, const string &text, const string &policy, LevelConfig &level)
+{
+    vector<string> parts;
+    stringstream in(text);
+    for (string part; getline(in, part, ':');)
+        parts.push_back(part);
+    if (parts.size() < 3 || parts.size() > 4)
+    {
+        cerr << "Error: " << name << " must be SIZE:ASSOC:LATENCY[:POLICY], not " << text << endl;
+        return false;
+    }
+    level.name = name;
+    level.size = parseSize(parts[0]);
+    level.associativity = atoi(parts[1].c_str());
+    level.latency = atoi(parts[2].c_str());
+    level.policy = parts.size() == 4 ? parts[3] : policy;
+    for (auto &c : level.policy)
+        c = toupper(c);
+    return true;
+}
+
 // DRIVER CODE
-int main()
+int main(int argc, char **argv)
 {
     CacheSimulator sim;
-    if (sim.loadFromFile("cacheData.txt"))
-        sim.run();
+    if (argc < 2)
+    {
+        if (sim.loadFromFile("cacheData.txt"))
+            sim.run();
+        return 0;
+    }
+
+    int cacheSize = 16384, blockSize = 64, associativity = 4, hitLatency = 1, memoryLatency = 100;
+    string policyName = "LRU", path;
+    map<string, string> levelText; // --l1, --l1i, ... -> SIZE:ASSOC:LATENCY[:POLICY]
+    Inclusion inclusion = Inclusion::INCLUSIVE;
+    bool writeBack = true, writeAllocate = true;
+    int cores = 0;
+    Protocol protocol = Protocol::MESI;
+    bool missRatioCurve = false, sweep = false, partition = false;
+    string sizes, blocks, assocs, policies;
+    int threads = max(1, (int)thread::hardware_concurrency());
+    string prefetcherName;
+    int prefetchDegree = 2;
+    bool attribute = false;
+    string reportPath;
+    int regionSize = 0, reportTop = 10;
+    TraceFormat format = TraceFormat::AUTO;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue)
+            cacheSize = parseSize(argv[++i]);
+        else if (arg == "--block" && hasValue)
+            blockSize = atoi(argv[++i]);
+        else if (arg == "--assoc" && hasValue)
+            associativity = atoi(argv[++i]);
+        else if (arg == "--policy" && hasValue)
+            policyName = argv[++i];
+        else if (arg == "--latency" && hasValue)
+            hitLatency = atoi(argv[++i]);
+        else if (arg == "--memory" && hasValue)
+            memoryLatency = atoi(argv[++i]);
+        else if ((arg == "--l1" || arg == "--l1i" || arg == "--l1d" || arg == "--l2" || arg == "--l3") && hasValue)
+            levelText[arg.substr(2)] = argv[++i];
+        else if (arg == "--inclusion" && hasValue)
+        {
+            string name = argv[++i];
+            for (auto &c : name)
+                c = tolower(c);
+            if (name == "inclusive")
+                inclusion = Inclusion::INCLUSIVE;
+            else if (name == "exclusive")
+                inclusion = Inclusion::EXCLUSIVE;
+            else if (name == "nine")
+                inclusion = Inclusion::NINE;
+            else
+            {
+                cerr << "Error: Unknown inclusion policy " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--cores" && hasValue)
+            cores = atoi(argv[++i]);
+        else if (arg == "--protocol" && hasValue)
+        {
+            string name = argv[++i];
+            for (auto &c : name)
+                c = toupper(c);
+            if (name == "MESI")
+                protocol = Protocol::MESI;
+            else if (name == "MOESI")
+                protocol = Protocol::MOESI;
+            else
+            {
+                cerr << "Error: Unknown protocol " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--prefetch" && hasValue)
+            prefetcherName = argv[++i];
+        else if (arg == "--prefetch-degree" && hasValue)
+            prefetchDegree = atoi(argv[++i]);
+        else if (arg == "--attribute")
+            attribute = true;
+        else if (arg == "--report" && hasValue)
+        {
+            attribute = true;
+            reportPath = argv[++i];
+        }
+        else if (arg == "--region" && hasValue)
+            regionSize = parseSize(argv[++i]);
+        else if (arg == "--top" && hasValue)
+            reportTop = atoi(argv[++i]);
+        else if (arg == "--mrc")
+            missRatioCurve = true;
+        else if (arg == "--sweep")
+            sweep = true;
+        else if (arg == "--partition")
+            partition = true;
+        else if (arg == "--sizes" && hasValue)
+            sizes = argv[++i];
+        else if (arg == "--blocks" && hasValue)
+            blocks = argv[++i];
+        else if (arg == "--assocs" && hasValue)
+            assocs = argv[++i];
+        else if (arg == "--policies" && hasValue)
+            policies = argv[++i];
+        else if (arg == "--threads" && hasValue)
+            threads = atoi(argv[++i]);
+        else if (arg == "--write-through")
+            writeBack = false;
+        else if (arg == "--no-write-allocate")
+            writeAllocate = false;
+        else if (arg == "--format" && hasValue)
+        {
+            if (!parseTraceFormat(argv[++i], format))
+            {
+                cerr << "Error: Unknown trace format " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+            path = arg;
+    }
+    if (path.empty())
+    {
+        usage();
+        return 1;
+    }
+    sim.configure(cacheSize, blockSize, associativity, policyName);
+    sim.setLatency(hitLatency, memoryLatency);
+
+    if (missRatioCurve)
+    {
+        if (blockSize <= 0)
+        {
+            cerr << "Error: Block size must be positive" << endl;
+            return 1;
+        }
+        return sim.runMissRatioCurve(path, format) ? 0 : 1;
+    }
+    if (sweep)
+    {
+        vector<SweepConfig> configs;
+        vector<string> policyList = splitList(policies.empty() ? policyName : policies);
+        vector<string> blockList = splitList(blocks.empty() ? to_string(blockSize) : blocks);
+        vector<string> assocList = splitList(assocs.empty() ? to_string(associativity) : assocs);
+        vector<string> sizeList = splitList(sizes.empty() ? to_string(cacheSize) : sizes);
+        for (auto policy : policyList)
+            for (const auto &block : blockList)
+                for (const auto &assoc : assocList)
+                    for (const auto &size : sizeList)
+                    {
+                        for (auto &c : policy)
+                            c = toupper(c);
+                        SweepConfig c = {parseSize(size), parseSize(block), atoi(assoc.c_str()), policy, 0, 0};
+                        if (!checkCache("Cache", c.size, c.block, c.associativity, c.policy))
+                            return 1;
+                        configs.push_back(c);
+                    }
+        return sim.runSweep(path, format, configs, threads) ? 0 : 1;
+    }
+
+    if (!levelText.empty())
+    {
+        if (levelText.count("l1i") != levelText.count("l1d") || (levelText.count("l1i") && levelText.count("l1")))
+        {
+            cerr << "Error: Give either --l1 or both --l1i and --l1d" << endl;
+            return 1;
+        }
+        if (!levelText.count("l1i") && !levelText.count("l1"))
+            levelText["l1"] = to_string(cacheSize) + ":" + to_string(associativity) + ":" + to_string(hitLatency);
+        vector<LevelConfig> levels;
+        for (const char *name : {"l1i", "l1d", "l1", "l2", "l3"})
+        {
+            if (!levelText.count(name))
+                continue;
+            string upper = name;
+            for (auto &c : upper)
+                c = toupper(c);
+            LevelConfig level;
+            if (!parseLevel(upper, levelText[name], policyName, level))
+                return 1;
+            levels.push_back(level);
+        }
+        sim.configureHierarchy(levels, inclusion, writeBack, writeAllocate);
+    }
+    if (cores != 0)
+        sim.configureCores(cores, protocol);
+    if (!prefetcherName.empty())
+        sim.configurePrefetcher(prefetcherName, prefetchDegree);
+    if (attribute)
+        sim.configureReport(reportPath, regionSize, reportTop);
+    if (partition)
+        sim.configurePartitions(max(threads, 1));
+    if (!sim.validate() || !sim.runBatch(path, format))
+        return 1;
     return 0;
 }
@@ -0,0 +1,303 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// Default size of a pool that reads a page file: 64 MB of 4 KB pages.
+const size_t BUFFER_POOL_PAGES = 16384;
+
+// A fixed number of page-sized frames caching the pages of one file.
+//
+// pin() returns a page's frame, reading it on a miss, and keeps it in
+// memory until the matching unpin(). A frame changed while pinned is
+// marked dirty and is written back when it is evicted or on flush().
+// When every frame is in use the unpinned page with the oldest K-th most
+// recent use is evicted (LRU-K with K = 2); pages used only once go
+// first, oldest first, so a long scan cannot push out pages that are
+// used again and again.
+class BufferPool {
+public:
+    struct Stats {
+        uint64_t hits, misses, evictions, writes;
+    };
+
+private:
+    static const int K = 2;
+
+    struct Frame {
+        uint32_t page;
+        size_t pins;
+        bool dirty;
+        uint64_t uses[K];   // times of the last K uses, newest first; 0 if fewer
+        vector<unsigned char> bytes;
+    };
+
+    size_t pageSize, capacity;
+    vector<Frame> frames;
+    unordered_map<uint32_t, size_t> table;   // page -> frame
+    set<pair<pair<bool, uint64_t>, size_t> > evictable;   // unpinned frames, next victim first
+    vector<size_t> freeFrames;
+    uint64_t clock;
+    Stats counters;
+    bool failed;
+    // Decides whether a page just read from the file is intact.
+    function<bool(const unsigned char*)> verify;
+    mutable mutex lock;
+#ifdef _WIN32
+    HANDLE file;
+#else
+    int fd;
+#endif
+
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+    static pair<bool, uint64_t> priority(const Frame& f) {
+        return f.uses[K - 1] == 0 ? make_pair(false, f.uses[0]) : make_pair(true, f.uses[K - 1]);
+    }
+
+    bool readAt(uint32_t page, unsigned char* out) {
+        uint64_t offset = (uint64_t)page * pageSize;
+#ifdef _WIN32
+        OVERLAPPED at = {};
+        at.Offset = (DWORD)offset;
+        at.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD got = 0;
+        return ReadFile(file, out, (DWORD)pageSize, &got, &at) && got == pageSize;
+#else
+        return pread(fd, out, pageSize, (off_t)offset) == (ssize_t)pageSize;
+#endif
+    }
+
+    bool writeAt(uint32_t page, const unsigned char* data) {
+        uint64_t offset = (uint64_t)page * pageSize;
+        counters.writes++;
+#ifdef _WIN32
+        OVERLAPPED at = {};
+        at.Offset = (DWORD)offset;
+        at.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD put = 0;
+        return WriteFile(file, data, (DWORD)pageSize, &put, &at) && put == pageSize;
+#else
+        return pwrite(fd, data, pageSize, (off_t)offset) == (ssize_t)pageSize;
+#endif
+    }
+
+    // A frame to load a page into: a free one, a new one while below
+    // capacity, or the victim, written back first if dirty. SIZE_MAX if
+    // every frame is pinned.
+    size_t takeFrame() {
+        if (!freeFrames.empty()) {
+            size_t f = freeFrames.back();
+            freeFrames.pop_back();
+            return f;
+        }
+        if (frames.size() < capacity) {
+            frames.push_back(Frame());
+            frames.back().bytes.resize(pageSize);
+            return frames.size() - 1;
+        }
+        if (evictable.empty()) return SIZE_MAX;
+        size_t f = evictable.begin()->second;
+        evictable.erase(evictable.begin());
+        Frame& victim = frames[f];
+        if (victim.dirty && !writeAt(victim.page, victim.bytes.data())) failed = true;
+        table.erase(victim.page);
+        counters.evictions++;
+        return f;
+    }
+
+public:
+    explicit BufferPool(size_t pageBytes, size_t capacityPages = BUFFER_POOL_PAGES)
+        : pageSize(pageBytes), capacity(capacityPages < 1 ? 1 : capacityPages), clock(0), failed(false) {
+        frames.reserve(capacity);
+        counters = Stats();
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+#else
+        fd = -1;
+#endif
+    }
+
+    ~BufferPool() { close(); }
+
+    // Opens path read-only, or for writing as a new, empty file. Pages
+    // read from the file are only handed out if check accepts them.
+    bool open(const string& path, bool create, const function<bool(const unsigned char*)>& check = nullptr) {
+        close();
+        lock_guard<mutex> guard(lock);
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+#else
+        fd = create ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+#endif
+        verify = check;
+        failed = false;
+        counters = Stats();
+        return true;
+    }
+
+    // Writes back dirty pages and forgets every page. Returns false if a
+    // write failed since the file was opened.
+    bool close() {
+        bool ok = flush();
+        lock_guard<mutex> guard(lock);
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        frames.clear();
+        table.clear();
+        evictable.clear();
+        freeFrames.clear();
+        return ok;
+    }
+
+    bool isOpen() const {
+#ifdef _WIN32
+        return file != INVALID_HANDLE_VALUE;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    uint64_t fileSize() const {
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        return GetFileSizeEx(file, &size) ? (uint64_t)size.QuadPart : 0;
+#else
+        struct stat st;
+        return fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+#endif
+    }
+
+    // Pins page and returns its bytes, or nullptr if it cannot be read,
+    // fails the check, or every frame is pinned. A page that is about to
+    // be overwritten completely need not be read: load = false gives a
+    // zeroed frame for it.
+    unsigned char* pin(uint32_t page, bool load = true) {
+        lock_guard<mutex> guard(lock);
+        size_t f;
+        auto it = table.find(page);
+        if (it != table.end()) {
+            f = it->second;
+            if (frames[f].pins == 0) evictable.erase(make_pair(priority(frames[f]), f));
+            counters.hits++;
+        } else {
+            f = takeFrame();
+            if (f == SIZE_MAX) return nullptr;
+            Frame& frame = frames[f];
+            if (!load) {
+                memset(frame.bytes.data(), 0, pageSize);
+            } else if (!readAt(page, frame.bytes.data()) || (verify && !verify(frame.bytes.data()))) {
+                freeFrames.push_back(f);
+                return nullptr;
+            }
+            frame.page = page;
+            frame.pins = 0;
+            frame.dirty = false;
+            for (int k = 0; k < K; k++) frame.uses[k] = 0;
+            table[page] = f;
+            counters.misses++;
+        }
+        Frame& frame = frames[f];
+        frame.pins++;
+        for (int k = K - 1; k > 0; k--) frame.uses[k] = frame.uses[k - 1];
+        frame.uses[0] = ++clock;
+        return frame.bytes.data();
+    }
+
+    // Releases one pin of page; dirty says whether its bytes were changed.
+    void unpin(uint32_t page, bool dirty) {
+        lock_guard<mutex> guard(lock);
+        auto it = table.find(page);
+        if (it == table.end()) return;
+        Frame& frame = frames[it->second];
+        frame.dirty = frame.dirty || dirty;
+        if (--frame.pins == 0) evictable.insert(make_pair(priority(frame), it->second));
+    }
+
+    // Writes every dirty page back to the file.
+    bool flush() {
+        lock_guard<mutex> guard(lock);
+        for (size_t f = 0; f < frames.size(); f++) {
+            if (!frames[f].dirty || !table.count(frames[f].page)) continue;
+            if (!writeAt(frames[f].page, frames[f].bytes.data())) failed = true;
+            frames[f].dirty = false;
+        }
+        return !failed;
+    }
+
+    // Writes every dirty page back and forces the file to stable storage.
+    bool sync() {
+        bool ok = flush();
+        lock_guard<mutex> guard(lock);
+#ifdef _WIN32
+        return FlushFileBuffers(file) && ok;
+#else
+        return fsync(fd) == 0 && ok;
+#endif
+    }
+
+    Stats stats() const { lock_guard<mutex> guard(lock); return counters; }
+    size_t cachedPages() const { lock_guard<mutex> guard(lock); return table.size(); }
+    size_t capacityPages() const { return capacity; }
+};
+
+// Keeps a page pinned for its lifetime.
+class PinnedPage {
+private:
+    BufferPool* pool;
+    uint32_t number;
+    unsigned char* bytes;
+    bool dirty;
+
+    PinnedPage(const PinnedPage&);
+    PinnedPage& operator=(const PinnedPage&);
+
+public:
+    PinnedPage() : pool(nullptr), number(0), bytes(nullptr), dirty(false) {}
+    PinnedPage(BufferPool& p, uint32_t page, bool load = true)
+        : pool(&p), number(page), bytes(p.pin(page, load)), dirty(false) {}
+    PinnedPage(PinnedPage&& other) : pool(other.pool), number(other.number), bytes(other.bytes), dirty(other.dirty) {
+        other.bytes = nullptr;
+    }
+    ~PinnedPage() { if (bytes) pool->unpin(number, dirty); }
+
+    // False if the page could not be pinned.
+    explicit operator bool() const { return bytes != nullptr; }
+    const unsigned char* data() const { return bytes; }
+    // The bytes, to change; the page will be written back.
+    unsigned char* write() {
+        dirty = true;
+        return bytes;
+    }
+};
+
+#endif // BUFFER_POOL_H
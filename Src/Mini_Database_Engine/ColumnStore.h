@@ -0,0 +1,640 @@
+#ifndef COLUMN_STORE_H
+#define COLUMN_STORE_H
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Schema.h"
+using namespace std;
+
+// Physical type of a column. Columns of type ANY start as INT64 and are
+// widened to DOUBLE or STRING the first time a value does not fit; typed
+// columns keep the physical type of their declared type.
+enum class ColumnType { INT64, DOUBLE, STRING };
+
+inline const char* columnTypeName(ColumnType type) {
+    switch (type) {
+        case ColumnType::INT64:  return "INT64";
+        case ColumnType::DOUBLE: return "DOUBLE";
+        default:                 return "STRING";
+    }
+}
+
+// Whole numbers up to 2^53 print like integers, so values widened from an
+// INT64 column keep their text; anything else gets the shortest "%g"
+// form that reads back as the same double.
+inline string formatDouble(double value) {
+    char buf[32];
+    if (value == floor(value) && fabs(value) <= 9007199254740992.0 && !(value == 0 && signbit(value))) {
+        snprintf(buf, sizeof(buf), "%.0f", value);
+        return buf;
+    }
+    for (int precision = 1; precision <= 17; precision++) {
+        snprintf(buf, sizeof(buf), "%.*g", precision, value);
+        if (strtod(buf, nullptr) == value) break;
+    }
+    return buf;
+}
+
+// A value is only stored as a number when printing the number gives back
+// exactly the text the user typed, so "007" or "1.50" stay strings and
+// every cell round-trips unchanged. The text need not end in a NUL, so
+// fields can be parsed where they lie in a file.
+//
+// An integer is canonical as to_string prints it: an optional '-', no
+// '+', spaces or leading zeros, and not "-0".
+inline bool parseCanonicalInt(const char* text, size_t length, int64_t& out) {
+    if (length == 0 || length > 20) return false;
+    bool negative = text[0] == '-';
+    size_t i = negative ? 1 : 0;
+    if (i == length || (text[i] == '0' && (length > i + 1 || negative))) return false;
+    uint64_t value = 0;
+    for (; i < length; i++) {
+        unsigned digit = (unsigned char)text[i] - '0';
+        if (digit > 9 || value > (UINT64_MAX - digit) / 10) return false;
+        value = value * 10 + digit;
+    }
+    if (value > (uint64_t)INT64_MAX + (negative ? 1 : 0)) return false;
+    out = negative ? (int64_t)(0 - value) : (int64_t)value;
+    return true;
+}
+
+inline bool parseCanonicalInt(const string& text, int64_t& out) { return parseCanonicalInt(text.data(), text.size(), out); }
+
+inline bool parseCanonicalDouble(const char* text, size_t length, double& out) {
+    if (length == 0 || length > 32) return false;
+    char buf[33];
+    memcpy(buf, text, length);
+    buf[length] = '\0';
+    char* end = nullptr;
+    errno = 0;
+    double value = strtod(buf, &end);
+    if (errno != 0 || *end != '\0' || !isfinite(value)) return false;
+    if (value == 0 && signbit(value)) return false;
+    string printed = formatDouble(value);
+    if (printed.size() != length || memcmp(printed.data(), text, length) != 0) return false;
+    out = value;
+    return true;
+}
+
+inline bool parseCanonicalDouble(const string& text, double& out) { return parseCanonicalDouble(text.data(), text.size(), out); }
+
+// Appends the positions i in [begin, end) where data[i] == key. The compare runs over a
+// fixed-size block into a byte mask first so the compiler can vectorize
+// it; only the (usually few) matches are then gathered.
+template <typename T>
+void scanEquals(const T* data, size_t begin, size_t end, T key, vector<size_t>& out) {
+    const size_t BLOCK = 1024;
+    unsigned char mask[BLOCK];
+    for (size_t base = begin; base < end; base += BLOCK) {
+        size_t n = end - base < BLOCK ? end - base : BLOCK;
+        const T* block = data + base;
+        unsigned char any = 0;
+        for (size_t i = 0; i < n; i++) {
+            mask[i] = block[i] == key;
+            any |= mask[i];
+        }
+        if (!any) continue;
+        for (size_t i = 0; i < n; i++)
+            if (mask[i]) out.push_back(base + i);
+    }
+}
+
+template <typename T>
+void keepRows(vector<T>& data, const vector<uint8_t>& keep) {
+    size_t kept = 0;
+    for (size_t i = 0; i < data.size(); i++)
+        if (keep[i]) data[kept++] = data[i];
+    data.resize(kept);
+}
+
+// One column stored contiguously. Strings are dictionary encoded: each
+// cell is a 32-bit code into a table of distinct values.
+//
+// A typed column (see Schema.h) may hold NULLs. They are rows set in a
+// bitmap, which is only allocated once the first NULL arrives, over a
+// placeholder value (0, or the empty string) in the data.
+class Column {
+private:
+    ColumnType type;
+    ColumnSpec spec;
+    vector<int64_t> ints;
+    vector<double> doubles;
+    vector<uint32_t> codes;
+    vector<string> dictionary;
+    unordered_map<string, uint32_t> dictionaryIndex;
+    string lookup;   // reused key for encoding text that is not a string
+    vector<uint64_t> nullBits;   // bit per row; rows past its end are not NULL
+    size_t nullCount;
+
+    uint32_t encode(const string& value) {
+        auto it = dictionaryIndex.find(value);
+        if (it != dictionaryIndex.end()) return it->second;
+        uint32_t code = (uint32_t)dictionary.size();
+        dictionary.push_back(value);
+        dictionaryIndex.emplace(value, code);
+        return code;
+    }
+
+    uint32_t encode(const char* text, size_t length) {
+        lookup.assign(text, length);
+        return encode(lookup);
+    }
+
+    void promoteToDouble() {
+        doubles.reserve(ints.capacity());
+        for (size_t i = 0; i < ints.size(); i++)
+            doubles.push_back((double)ints[i]);
+        vector<int64_t>().swap(ints);
+        type = ColumnType::DOUBLE;
+    }
+
+    void promoteToString() {
+        size_t n = size();
+        codes.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            string text = get(i);
+            codes.push_back(encode(text));
+        }
+        vector<int64_t>().swap(ints);
+        vector<double>().swap(doubles);
+        type = ColumnType::STRING;
+    }
+
+    // Integers above 2^53 cannot be widened to double without losing digits.
+    static bool fitsInDouble(int64_t value) {
+        const int64_t LIMIT = (int64_t)1 << 53;
+        return value <= LIMIT && value >= -LIMIT;
+    }
+
+    bool intsFitInDouble() const {
+        for (size_t i = 0; i < ints.size(); i++)
+            if (!fitsInDouble(ints[i])) return false;
+        return true;
+    }
+
+    // Widens the column until it can hold value.
+    void makeRoomFor(const string& value) {
+        int64_t i;
+        double d;
+        if (type == ColumnType::INT64 && !parseCanonicalInt(value, i)) {
+            if (parseCanonicalDouble(value, d) && intsFitInDouble()) promoteToDouble();
+            else promoteToString();
+        }
+        if (type == ColumnType::DOUBLE && (parseCanonicalInt(value, i) ? !fitsInDouble(i) : !parseCanonicalDouble(value, d)))
+            promoteToString();
+    }
+
+    void markNull(size_t row, bool null) {
+        if (row / 64 >= nullBits.size()) {
+            if (!null) return;
+            nullBits.resize(row / 64 + 1, 0);
+        }
+        uint64_t bit = (uint64_t)1 << (row % 64);
+        if (((nullBits[row / 64] & bit) != 0) == null) return;
+        nullBits[row / 64] ^= bit;
+        if (null) nullCount++;
+        else nullCount--;
+    }
+
+    // Reads text as a value of a typed column, with surrounding blanks
+    // dropped for types other than VARCHAR: into i for the INT64 types,
+    // d for FLOAT. False if it is not one.
+    bool parseTyped(const char* text, size_t length, int64_t& i, double& d) const {
+        if (spec.type != SqlType::VARCHAR) {
+            while (length && isspace((unsigned char)text[length - 1])) length--;
+            while (length && isspace((unsigned char)*text)) { text++; length--; }
+        }
+        switch (spec.type) {
+            case SqlType::INT:       return parseInt(text, length, i);
+            case SqlType::FLOAT:     return parseFloat(text, length, d);
+            case SqlType::TIMESTAMP: return parseTimestamp(text, length, i);
+            case SqlType::BOOL: {
+                bool b;
+                if (!parseBool(text, length, b)) return false;
+                i = b;
+                return true;
+            }
+            default: return spec.length == 0 || length <= spec.length;
+        }
+    }
+
+    // Appends a value to a typed column; one that is not of its type is
+    // stored as NULL, and false returned.
+    bool appendTyped(const char* text, size_t length) {
+        int64_t i = 0;
+        double d = 0;
+        bool null = isNullText(spec, text, length);
+        bool valid = null || parseTyped(text, length, i, d);
+        if (!valid) null = true;
+        if (null) markNull(size(), true);
+        if (type == ColumnType::INT64) ints.push_back(null ? 0 : i);
+        else if (type == ColumnType::DOUBLE) doubles.push_back(null ? 0 : d);
+        else codes.push_back(null ? encode(string()) : encode(text, length));
+        return valid;
+    }
+
+public:
+    Column() : type(ColumnType::INT64), nullCount(0) {}
+
+    explicit Column(const ColumnSpec& declared) : type(ColumnType::INT64), spec(declared), nullCount(0) {
+        if (spec.type == SqlType::FLOAT) type = ColumnType::DOUBLE;
+        else if (spec.type == SqlType::VARCHAR) type = ColumnType::STRING;
+    }
+
+    // Columns decoded from a compressed block (Compression.h) are built
+    // from their values directly. The vectors are taken, not copied.
+    static Column ofInts(vector<int64_t>& values) {
+        Column c;
+        c.ints.swap(values);
+        return c;
+    }
+
+    static Column ofDoubles(vector<double>& values) {
+        Column c;
+        c.type = ColumnType::DOUBLE;
+        c.doubles.swap(values);
+        return c;
+    }
+
+    // Fails unless the dictionary entries are distinct and every code is
+    // below dict.size().
+    static bool ofStrings(vector<string>& dict, vector<uint32_t>& values, Column& out) {
+        out = Column();
+        out.type = ColumnType::STRING;
+        out.dictionary.swap(dict);
+        out.dictionaryIndex.reserve(out.dictionary.size());
+        for (size_t i = 0; i < out.dictionary.size(); i++)
+            if (!out.dictionaryIndex.emplace(out.dictionary[i], (uint32_t)i).second) return false;
+        out.codes.swap(values);
+        for (size_t i = 0; i < out.codes.size(); i++)
+            if (out.codes[i] >= out.dictionary.size()) return false;
+        return true;
+    }
+
+    ColumnType getType() const { return type; }
+    const ColumnSpec& getSpec() const { return spec; }
+
+    bool hasNulls() const { return nullCount != 0; }
+    bool isNull(size_t row) const { return row / 64 < nullBits.size() && (nullBits[row / 64] >> (row % 64) & 1); }
+
+    // Gives a column decoded from a block its declared type; false if its
+    // values are not stored as that type stores them.
+    bool declare(const ColumnSpec& declared) {
+        Column typed(declared);
+        if (declared.typed() && typed.type != type) return false;
+        spec = declared;
+        return true;
+    }
+
+    // Sets the NULL rows of a column decoded from a block.
+    void setNullBits(const vector<uint64_t>& bits) {
+        nullBits = bits;
+        nullCount = 0;
+        for (size_t w = 0; w < nullBits.size(); w++)
+            for (uint64_t b = nullBits[w]; b; b &= b - 1) nullCount++;
+    }
+
+    // The text of a typed column's INT64 value: a number, true / false,
+    // or a timestamp.
+    string formatInt(int64_t value) const {
+        if (spec.type == SqlType::BOOL) return value ? "true" : "false";
+        if (spec.type == SqlType::TIMESTAMP) return formatTimestamp(value);
+        return to_string(value);
+    }
+
+    // The text the column stores for value: value itself for ANY, the
+    // value as get() shows it for a typed column ("+5 " is 5 in an INT
+    // column, "yes" is true in a BOOL one), or NULL. False, with error
+    // set, if value is not of the column's type.
+    bool normalize(const string& value, string& canonical, string& error) const {
+        if (!spec.typed()) { canonical = value; return true; }
+        if (isNullText(spec, value.data(), value.size())) { canonical = "NULL"; return true; }
+        int64_t i = 0;
+        double d = 0;
+        if (!parseTyped(value.data(), value.size(), i, d)) {
+            error = "'" + value + "' is not a valid " + typeName(spec);
+            return false;
+        }
+        if (spec.type == SqlType::FLOAT) canonical = formatDouble(d);
+        else if (spec.type == SqlType::VARCHAR) canonical = value;
+        else canonical = formatInt(i);
+        return true;
+    }
+
+    // A typed literal for comparing against an INT64 or DOUBLE column, as
+    // a number (timestamps as seconds, booleans as 0 and 1). False if it
+    // is not a value of the column's type.
+    bool literalValue(const string& text, double& number) const {
+        int64_t i = 0;
+        double d = 0;
+        if (!parseTyped(text.data(), text.size(), i, d)) return false;
+        number = spec.type == SqlType::FLOAT ? d : (double)i;
+        return true;
+    }
+
+    size_t size() const {
+        switch (type) {
+            case ColumnType::INT64:  return ints.size();
+            case ColumnType::DOUBLE: return doubles.size();
+            default:                 return codes.size();
+        }
+    }
+
+    void reserve(size_t n) {
+        if (type == ColumnType::INT64) ints.reserve(n);
+        else if (type == ColumnType::DOUBLE) doubles.reserve(n);
+        else codes.reserve(n);
+    }
+
+    // Parses the text once in the common case that the column need not
+    // be widened. Returns false if a typed column stored NULL instead of
+    // a value that is not of its type.
+    bool append(const char* text, size_t length) {
+        if (spec.typed()) return appendTyped(text, length);
+        int64_t i;
+        double d;
+        if (type == ColumnType::INT64) {
+            if (parseCanonicalInt(text, length, i)) { ints.push_back(i); return true; }
+            if (parseCanonicalDouble(text, length, d) && intsFitInDouble()) promoteToDouble();
+            else promoteToString();
+        }
+        if (type == ColumnType::DOUBLE) {
+            bool isInt = parseCanonicalInt(text, length, i);
+            if (isInt && fitsInDouble(i)) { doubles.push_back((double)i); return true; }
+            if (!isInt && parseCanonicalDouble(text, length, d)) { doubles.push_back(d); return true; }
+            promoteToString();
+        }
+        codes.push_back(encode(text, length));
+        return true;
+    }
+
+    bool append(const string& value) { return append(value.data(), value.size()); }
+
+    // Appends every row of other, with the result appending each of its
+    // values one by one would give: the column is widened first if other
+    // is wider, then the values are copied in bulk. A typed column copies
+    // other's values and NULLs in bulk when other has its declared type.
+    void append(const Column& other) {
+        if (spec.typed()) {
+            size_t first = size();
+            if (other.spec.type != spec.type || other.spec.length != spec.length) {
+                for (size_t r = 0; r < other.size(); r++) append(other.get(r));
+                return;
+            }
+            if (type == ColumnType::INT64) {
+                ints.insert(ints.end(), other.ints.begin(), other.ints.end());
+            } else if (type == ColumnType::DOUBLE) {
+                doubles.insert(doubles.end(), other.doubles.begin(), other.doubles.end());
+            } else {
+                vector<uint32_t> recode(other.dictionary.size());
+                for (size_t c = 0; c < recode.size(); c++) recode[c] = encode(other.dictionary[c]);
+                for (size_t r = 0; r < other.codes.size(); r++) codes.push_back(recode[other.codes[r]]);
+            }
+            for (size_t r = 0; other.nullCount && r < other.size(); r++)
+                if (other.isNull(r)) markNull(first + r, true);
+            return;
+        }
+        if (other.type == ColumnType::STRING && type != ColumnType::STRING) promoteToString();
+        if (other.type == ColumnType::DOUBLE && type == ColumnType::INT64) {
+            if (intsFitInDouble()) promoteToDouble();
+            else promoteToString();
+        }
+        if (other.type == ColumnType::INT64 && type == ColumnType::DOUBLE && !other.intsFitInDouble()) promoteToString();
+        if (type == ColumnType::INT64) {
+            ints.insert(ints.end(), other.ints.begin(), other.ints.end());
+        } else if (type == ColumnType::DOUBLE && other.type == ColumnType::DOUBLE) {
+            doubles.insert(doubles.end(), other.doubles.begin(), other.doubles.end());
+        } else if (type == ColumnType::DOUBLE) {
+            for (size_t r = 0; r < other.ints.size(); r++) doubles.push_back((double)other.ints[r]);
+        } else if (other.type == ColumnType::STRING) {
+            vector<uint32_t> recode(other.dictionary.size());
+            for (size_t c = 0; c < recode.size(); c++) recode[c] = encode(other.dictionary[c]);
+            for (size_t r = 0; r < other.codes.size(); r++) codes.push_back(recode[other.codes[r]]);
+        } else {
+            for (size_t r = 0; r < other.size(); r++) codes.push_back(encode(other.get(r)));
+        }
+    }
+
+    // An empty column of the same type that shares this column's
+    // dictionary, so that gather() can copy its rows in code for code.
+    Column emptyLike() const {
+        Column c;
+        c.type = type;
+        c.spec = spec;
+        c.dictionary = dictionary;
+        c.dictionaryIndex = dictionaryIndex;
+        return c;
+    }
+
+    // Appends the values (and NULLs) of source at rows, n of them. This
+    // column was made by source.emptyLike(), so nothing is parsed or
+    // widened.
+    void gather(const Column& source, const size_t* rows, size_t n) {
+        size_t first = size();
+        if (type == ColumnType::INT64) for (size_t i = 0; i < n; i++) ints.push_back(source.ints[rows[i]]);
+        else if (type == ColumnType::DOUBLE) for (size_t i = 0; i < n; i++) doubles.push_back(source.doubles[rows[i]]);
+        else for (size_t i = 0; i < n; i++) codes.push_back(source.codes[rows[i]]);
+        for (size_t i = 0; source.nullCount && i < n; i++)
+            if (source.isNull(rows[i])) markNull(first + i, true);
+    }
+
+    void set(size_t row, const string& value) {
+        if (spec.typed()) {
+            int64_t i = 0;
+            double d = 0;
+            bool null = isNullText(spec, value.data(), value.size()) || !parseTyped(value.data(), value.size(), i, d);
+            markNull(row, null);
+            if (type == ColumnType::INT64) ints[row] = null ? 0 : i;
+            else if (type == ColumnType::DOUBLE) doubles[row] = null ? 0 : d;
+            else codes[row] = encode(null ? string() : value);
+            return;
+        }
+        makeRoomFor(value);
+        int64_t i;
+        if (type == ColumnType::INT64) {
+            parseCanonicalInt(value, i);
+            ints[row] = i;
+        } else if (type == ColumnType::DOUBLE) {
+            double d;
+            if (parseCanonicalInt(value, i)) d = (double)i;
+            else parseCanonicalDouble(value, d);
+            doubles[row] = d;
+        } else {
+            codes[row] = encode(value);
+        }
+    }
+
+    // Drops every row whose keep flag is 0 in one pass; the rows left keep
+    // their order. Dictionary entries are kept even if no row uses them.
+    void compact(const vector<uint8_t>& keep) {
+        if (nullCount) {
+            vector<uint64_t> bits;
+            bits.swap(nullBits);
+            nullCount = 0;
+            for (size_t i = 0, kept = 0; i < keep.size(); i++) {
+                if (!keep[i]) continue;
+                if (i / 64 < bits.size() && (bits[i / 64] >> (i % 64) & 1)) markNull(kept, true);
+                kept++;
+            }
+        }
+        if (type == ColumnType::INT64) keepRows(ints, keep);
+        else if (type == ColumnType::DOUBLE) keepRows(doubles, keep);
+        else keepRows(codes, keep);
+    }
+
+    string get(size_t row) const {
+        if (nullCount && isNull(row)) return "NULL";
+        if (spec.typed() && type == ColumnType::INT64) return formatInt(ints[row]);
+        switch (type) {
+            case ColumnType::INT64:  return to_string(ints[row]);
+            case ColumnType::DOUBLE: return formatDouble(doubles[row]);
+            default:                 return dictionary[codes[row]];
+        }
+    }
+
+    // Appends every row in [begin, end) whose value equals value (as the
+    // user typed it, or any spelling of it in a typed column).
+    void findEquals(const string& value, vector<size_t>& out, size_t begin, size_t end) const {
+        int64_t i;
+        double d;
+        if (spec.typed()) {
+            string canonical, error;
+            if (!normalize(value, canonical, error) || canonical == "NULL") return;
+            size_t from = out.size();
+            if (type == ColumnType::STRING) {
+                auto it = dictionaryIndex.find(canonical);
+                if (it != dictionaryIndex.end()) scanEquals(codes.data(), begin, end, it->second, out);
+            } else if (type == ColumnType::DOUBLE) {
+                parseTyped(value.data(), value.size(), i, d);
+                scanEquals(doubles.data(), begin, end, d, out);
+            } else {
+                parseTyped(value.data(), value.size(), i, d);
+                scanEquals(ints.data(), begin, end, i, out);
+            }
+            size_t kept = from;
+            for (size_t k = from; k < out.size(); k++)
+                if (!isNull(out[k])) out[kept++] = out[k];
+            out.resize(kept);
+            return;
+        }
+        if (type == ColumnType::INT64) {
+            if (parseCanonicalInt(value, i)) scanEquals(ints.data(), begin, end, i, out);
+        } else if (type == ColumnType::DOUBLE) {
+            if (parseCanonicalInt(value, i)) scanEquals(doubles.data(), begin, end, (double)i, out);
+            else if (parseCanonicalDouble(value, d)) scanEquals(doubles.data(), begin, end, d, out);
+        } else {
+            auto it = dictionaryIndex.find(value);
+            if (it != dictionaryIndex.end()) scanEquals(codes.data(), begin, end, it->second, out);
+        }
+    }
+
+    void findEquals(const string& value, vector<size_t>& out) const { findEquals(value, out, 0, size()); }
+
+    const int64_t* intData() const { return ints.data(); }
+    const double* doubleData() const { return doubles.data(); }
+    const uint32_t* codeData() const { return codes.data(); }
+    const vector<string>& getDictionary() const { return dictionary; }
+
+    size_t memoryUsage() const {
+        size_t bytes = ints.capacity() * sizeof(int64_t) + doubles.capacity() * sizeof(double)
+                     + codes.capacity() * sizeof(uint32_t) + nullBits.capacity() * sizeof(uint64_t);
+        for (size_t i = 0; i < dictionary.size(); i++)
+            bytes += sizeof(string) + (dictionary[i].size() > 15 ? dictionary[i].capacity() : 0)
+                   + sizeof(uint32_t) + sizeof(void*) * 2;
+        return bytes;
+    }
+};
+
+// Column-major storage for a table: one Column per table column, all of
+// the same length. Rows only exist as positions across the columns.
+class ColumnStore {
+private:
+    vector<Column> columns;
+    size_t rows;
+
+public:
+    explicit ColumnStore(size_t columnCount = 0) : columns(columnCount), rows(0) {}
+    explicit ColumnStore(const vector<ColumnSpec>& specs) : rows(0) {
+        for (size_t c = 0; c < specs.size(); c++) columns.push_back(Column(specs[c]));
+    }
+    // A store with no rows and the given (empty) columns, which are taken.
+    explicit ColumnStore(vector<Column>& empty) : rows(0) { columns.swap(empty); }
+
+    vector<ColumnSpec> specs() const {
+        vector<ColumnSpec> out;
+        for (size_t c = 0; c < columns.size(); c++) out.push_back(columns[c].getSpec());
+        return out;
+    }
+
+    size_t rowCount() const { return rows; }
+    size_t columnCount() const { return columns.size(); }
+    const Column& column(size_t index) const { return columns[index]; }
+
+    void reserve(size_t rowCapacity) {
+        for (size_t c = 0; c < columns.size(); c++) columns[c].reserve(rowCapacity);
+    }
+
+    void appendRow(const vector<string>& values) {
+        for (size_t c = 0; c < columns.size(); c++) columns[c].append(values[c]);
+        rows++;
+    }
+
+    vector<string> getRow(size_t row) const {
+        vector<string> values;
+        values.reserve(columns.size());
+        for (size_t c = 0; c < columns.size(); c++) values.push_back(columns[c].get(row));
+        return values;
+    }
+
+    // Builds a row one cell at a time, as a parser does: appendCell for
+    // every column, then endRow. appendCell returns false if a typed
+    // column stored NULL for a value that is not of its type.
+    bool appendCell(size_t column, const char* text, size_t length) { return columns[column].append(text, length); }
+    void endRow() { rows++; }
+
+    // Builds n rows a column at a time from other columns: gather for
+    // every column (see Column::gather), then endRows.
+    void gather(size_t column, const Column& source, const size_t* sourceRows, size_t n) {
+        columns[column].gather(source, sourceRows, n);
+    }
+    void endRows(size_t n) { rows += n; }
+
+    // Appends all rows of other, which has the same columns.
+    void append(const ColumnStore& other) {
+        for (size_t c = 0; c < columns.size(); c++) columns[c].append(other.columns[c]);
+        rows += other.rows;
+    }
+
+    // Appends rowCount rows given as one Column per column.
+    void append(const vector<Column>& block, size_t rowCount) {
+        for (size_t c = 0; c < columns.size(); c++) columns[c].append(block[c]);
+        rows += rowCount;
+    }
+
+    void setRow(size_t row, const vector<string>& values) {
+        for (size_t c = 0; c < columns.size(); c++) columns[c].set(row, values[c]);
+    }
+
+    // Removes the rows whose keep flag is 0; see Column::compact.
+    void compact(const vector<uint8_t>& keep) {
+        for (size_t c = 0; c < columns.size(); c++) columns[c].compact(keep);
+        size_t kept = 0;
+        for (size_t i = 0; i < rows; i++) kept += keep[i] != 0;
+        rows = kept;
+    }
+
+    size_t memoryUsage() const {
+        size_t bytes = 0;
+        for (size_t c = 0; c < columns.size(); c++) bytes += columns[c].memoryUsage();
+        return bytes;
+    }
+};
+
+#endif // COLUMN_STORE_H
@@ -0,0 +1,445 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef MINIDB_ZLIB
+#include <zlib.h>
+#endif
+#include "ColumnStore.h"
+#include "PageFile.h"
+using namespace std;
+
+// Compressed column blocks
+// ------------------------
+// A table is saved as blocks of rows. A block is
+//
+//   varint rows
+//   per column: varint length, segment
+//
+// and a segment holds one column of the block:
+//
+//   u8 type        ColumnType, | HAS_NULLS if any row is NULL
+//   nulls          HAS_NULLS only: a bit per row, set for NULL
+//   u8 encoding    BlockEncoding, | DEFLATED if the payload is deflated
+//   varint size    payload size before deflating (DEFLATED only)
+//   payload
+//
+// Each segment is encoded on its own, in whichever of the encodings for
+// its type comes out smallest, so a column of sorted ids, one of a few
+// repeated strings and one of small counters each get their own:
+//
+//   INT64   BIT_PACKED   zigzag min, u8 width, values - min in width bits
+//           DELTA        zigzag first, zigzag min delta, u8 width,
+//                        deltas - min delta in width bits
+//           RUN_LENGTH   varint runs, then zigzag value, varint count each
+//   DOUBLE  PLAIN        8 bytes per value
+//           RUN_LENGTH   varint runs, then 8 bytes, varint count each
+//   STRING  DICTIONARY       varint entries, strings, u8 width, codes in
+//                            width bits
+//           DICTIONARY_RUNS  varint entries, strings, varint runs, then
+//                            varint code, varint count each
+//
+// Built with MINIDB_ZLIB defined (and -lz), a payload is also deflated
+// when that makes it smaller.
+enum BlockEncoding : uint8_t { BIT_PACKED = 1, DELTA = 2, RUN_LENGTH = 3, PLAIN = 4, DICTIONARY = 5, DICTIONARY_RUNS = 6 };
+const uint8_t DEFLATED = 0x80;
+const uint8_t HAS_NULLS = 0x80;
+
+// Rows a block may claim, so a damaged length cannot allocate without bound.
+const uint64_t MAX_BLOCK_ROWS = 1u << 24;
+
+inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t unzigzag(uint64_t u) { return (int64_t)((u >> 1) ^ (0 - (u & 1))); }
+
+inline int bitWidth(uint64_t v) {
+    int width = 0;
+    while (v) { width++; v >>= 1; }
+    return width;
+}
+
+inline size_t varintSize(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) { v >>= 7; n++; }
+    return n;
+}
+
+inline size_t packedSize(size_t count, int width) { return (count * (size_t)width + 7) / 8; }
+
+// Appends the low width bits of every value, least significant first.
+inline void packBits(const vector<uint64_t>& values, int width, string& out) {
+    size_t start = out.size();
+    out.resize(start + packedSize(values.size(), width), '\0');
+    unsigned char* p = (unsigned char*)&out[start];
+    size_t bit = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        for (int done = 0; done < width;) {
+            int shift = (int)(bit & 7);
+            int take = min(8 - shift, width - done);
+            p[bit >> 3] |= (unsigned char)(((values[i] >> done) & ((1u << take) - 1)) << shift);
+            done += take;
+            bit += (size_t)take;
+        }
+    }
+}
+
+// Calls out(i, value) for count values of width bits packed at p, which
+// holds packedSize(count, width) bytes.
+template <typename Out>
+void unpackBits(const unsigned char* p, size_t count, int width, Out out) {
+    size_t bytes = packedSize(count, width);
+    uint64_t mask = width == 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+    size_t bit = 0;
+    for (size_t i = 0; i < count; i++, bit += (size_t)width) {
+        size_t byte = bit >> 3;
+        int shift = (int)(bit & 7);
+        uint64_t v = 0;
+        if (width <= 56 && byte + 8 <= bytes) {
+            for (int k = 7; k >= 0; k--) v = (v << 8) | p[byte + k];
+            v = (v >> shift) & mask;
+        } else {
+            for (int got = 0; got < width;) {
+                int take = min(8 - shift, width - got);
+                v |= (uint64_t)((p[byte] >> shift) & ((1u << take) - 1)) << got;
+                got += take;
+                shift = 0;
+                byte++;
+            }
+        }
+        out(i, v);
+    }
+}
+
+inline void putDoubleBits(string& out, double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, 8);
+    for (int k = 0; k < 8; k++) out.push_back((char)((bits >> (8 * k)) & 0xFF));
+}
+
+inline double getDoubleBits(const unsigned char* p) {
+    uint64_t bits = 0;
+    for (int k = 7; k >= 0; k--) bits = (bits << 8) | p[k];
+    double d;
+    memcpy(&d, &bits, 8);
+    return d;
+}
+
+// Number of runs of equal neighbours in values.
+template <typename T>
+size_t countRuns(const vector<T>& values) {
+    size_t runs = values.empty() ? 0 : 1;
+    for (size_t i = 1; i < values.size(); i++) runs += !(values[i] == values[i - 1]);
+    return runs;
+}
+
+// Appends (value, count) for every run of equal neighbours in values,
+// with put(out, value) writing a value.
+template <typename T, typename Put>
+void putRuns(const vector<T>& values, ByteWriter& out, Put put) {
+    out.putVarint(countRuns(values));
+    for (size_t i = 0; i < values.size();) {
+        size_t j = i + 1;
+        while (j < values.size() && values[j] == values[i]) j++;
+        put(out, values[i]);
+        out.putVarint(j - i);
+        i = j;
+    }
+}
+
+inline uint8_t encodeInts(const vector<int64_t>& v, ByteWriter& out) {
+    size_t n = v.size();
+    int64_t low = *min_element(v.begin(), v.end());
+    uint64_t spread = 0;
+    for (size_t i = 0; i < n; i++) spread = max(spread, (uint64_t)v[i] - (uint64_t)low);
+    int width = bitWidth(spread);
+    size_t packed = varintSize(zigzag(low)) + 1 + packedSize(n, width);
+
+    vector<int64_t> deltas(n > 1 ? n - 1 : 0);
+    for (size_t i = 1; i < n; i++) deltas[i - 1] = (int64_t)((uint64_t)v[i] - (uint64_t)v[i - 1]);
+    int64_t lowDelta = deltas.empty() ? 0 : *min_element(deltas.begin(), deltas.end());
+    uint64_t deltaSpread = 0;
+    for (size_t i = 0; i < deltas.size(); i++) deltaSpread = max(deltaSpread, (uint64_t)deltas[i] - (uint64_t)lowDelta);
+    int deltaWidth = bitWidth(deltaSpread);
+    size_t delta = varintSize(zigzag(v[0])) + varintSize(zigzag(lowDelta)) + 1 + packedSize(deltas.size(), deltaWidth);
+
+    size_t runs = countRuns(v), runLength = varintSize(runs);
+    for (size_t i = 0; i < n;) {
+        size_t j = i + 1;
+        while (j < n && v[j] == v[i]) j++;
+        runLength += varintSize(zigzag(v[i])) + varintSize(j - i);
+        i = j;
+    }
+
+    if (runLength <= packed && runLength <= delta) {
+        putRuns(v, out, [](ByteWriter& w, int64_t x) { w.putVarint(zigzag(x)); });
+        return RUN_LENGTH;
+    }
+    vector<uint64_t> offsets;
+    if (delta < packed) {
+        out.putVarint(zigzag(v[0]));
+        out.putVarint(zigzag(lowDelta));
+        out.bytes.push_back((char)deltaWidth);
+        offsets.resize(deltas.size());
+        for (size_t i = 0; i < deltas.size(); i++) offsets[i] = (uint64_t)deltas[i] - (uint64_t)lowDelta;
+        packBits(offsets, deltaWidth, out.bytes);
+        return DELTA;
+    }
+    out.putVarint(zigzag(low));
+    out.bytes.push_back((char)width);
+    offsets.resize(n);
+    for (size_t i = 0; i < n; i++) offsets[i] = (uint64_t)v[i] - (uint64_t)low;
+    packBits(offsets, width, out.bytes);
+    return BIT_PACKED;
+}
+
+inline uint8_t encodeDoubles(const vector<double>& v, ByteWriter& out) {
+    // Compared bit for bit, as they are stored.
+    vector<uint64_t> bits(v.size());
+    for (size_t i = 0; i < v.size(); i++) memcpy(&bits[i], &v[i], 8);
+    size_t runs = countRuns(bits);
+    if (runs * 10 < v.size() * 8) {
+        putRuns(bits, out, [](ByteWriter& w, uint64_t b) {
+            for (int k = 0; k < 8; k++) w.bytes.push_back((char)((b >> (8 * k)) & 0xFF));
+        });
+        return RUN_LENGTH;
+    }
+    for (size_t i = 0; i < v.size(); i++) putDoubleBits(out.bytes, v[i]);
+    return PLAIN;
+}
+
+// codes index dictionary, whose entries appear in first-use order.
+inline uint8_t encodeStrings(const vector<string>& dictionary, const vector<uint32_t>& codes, ByteWriter& out) {
+    out.putVarint(dictionary.size());
+    for (size_t i = 0; i < dictionary.size(); i++) out.putString(dictionary[i]);
+    int width = bitWidth(dictionary.size() - 1);
+    size_t runs = countRuns(codes), runLength = varintSize(runs);
+    for (size_t i = 0; i < codes.size();) {
+        size_t j = i + 1;
+        while (j < codes.size() && codes[j] == codes[i]) j++;
+        runLength += varintSize(codes[i]) + varintSize(j - i);
+        i = j;
+    }
+    if (runLength < 1 + packedSize(codes.size(), width)) {
+        putRuns(codes, out, [](ByteWriter& w, uint32_t c) { w.putVarint(c); });
+        return DICTIONARY_RUNS;
+    }
+    out.bytes.push_back((char)width);
+    vector<uint64_t> wide(codes.begin(), codes.end());
+    packBits(wide, width, out.bytes);
+    return DICTIONARY;
+}
+
+// Appends the segment for the given rows (at least one) of column.
+inline void encodeSegment(const Column& column, const vector<size_t>& rows, string& out) {
+    ByteWriter payload;
+    uint8_t encoding;
+    if (column.getType() == ColumnType::INT64) {
+        vector<int64_t> values(rows.size());
+        for (size_t i = 0; i < rows.size(); i++) values[i] = column.intData()[rows[i]];
+        encoding = encodeInts(values, payload);
+    } else if (column.getType() == ColumnType::DOUBLE) {
+        vector<double> values(rows.size());
+        for (size_t i = 0; i < rows.size(); i++) values[i] = column.doubleData()[rows[i]];
+        encoding = encodeDoubles(values, payload);
+    } else {
+        // Only the strings these rows use, renumbered from 0.
+        const vector<string>& global = column.getDictionary();
+        unordered_map<uint32_t, uint32_t> local;
+        vector<string> dictionary;
+        vector<uint32_t> codes(rows.size());
+        for (size_t i = 0; i < rows.size(); i++) {
+            uint32_t code = column.codeData()[rows[i]];
+            auto it = local.emplace(code, (uint32_t)dictionary.size());
+            if (it.second) dictionary.push_back(global[code]);
+            codes[i] = it.first->second;
+        }
+        encoding = encodeStrings(dictionary, codes, payload);
+    }
+
+    bool nulls = false;
+    for (size_t i = 0; i < rows.size() && !nulls && column.hasNulls(); i++) nulls = column.isNull(rows[i]);
+    out.push_back((char)((uint8_t)column.getType() | (nulls ? HAS_NULLS : 0)));
+    if (nulls) {
+        vector<uint64_t> bits(rows.size());
+        for (size_t i = 0; i < rows.size(); i++) bits[i] = column.isNull(rows[i]);
+        packBits(bits, 1, out);
+    }
+#ifdef MINIDB_ZLIB
+    uLongf deflatedSize = compressBound((uLong)payload.bytes.size());
+    string deflated(deflatedSize, '\0');
+    if (compress2((Bytef*)&deflated[0], &deflatedSize, (const Bytef*)payload.bytes.data(), (uLong)payload.bytes.size(), 6) == Z_OK
+        && deflatedSize + varintSize(payload.bytes.size()) < payload.bytes.size()) {
+        ByteWriter header;
+        header.bytes.push_back((char)(encoding | DEFLATED));
+        header.putVarint(payload.bytes.size());
+        out += header.bytes;
+        out.append(deflated, 0, deflatedSize);
+        return;
+    }
+#endif
+    out.push_back((char)encoding);
+    out += payload.bytes;
+}
+
+// Decodes a segment of rows values of a column declared as spec into
+// column. Returns false if it is damaged or uses an encoding this build
+// cannot read.
+inline bool decodeSegment(const unsigned char* data, size_t length, size_t rows, const ColumnSpec& spec, Column& column) {
+    ByteReader in(data, length);
+    const unsigned char* typeByte = in.take(1);
+    if (!typeByte) return false;
+    uint8_t type = *typeByte & (uint8_t)~HAS_NULLS;
+    vector<uint64_t> nulls;
+    if (*typeByte & HAS_NULLS) {
+        const unsigned char* bits = in.take(packedSize(rows, 1));
+        if (!bits || !spec.typed()) return false;
+        nulls.assign((rows + 63) / 64, 0);
+        unpackBits(bits, rows, 1, [&nulls](size_t i, uint64_t v) { nulls[i / 64] |= v << (i % 64); });
+    }
+    const unsigned char* encodingByte = in.take(1);
+    if (!encodingByte) return false;
+    uint8_t encoding = *encodingByte;
+    string inflated;
+    if (encoding & DEFLATED) {
+#ifdef MINIDB_ZLIB
+        uint64_t size = in.getVarint();
+        if (!in.ok || size > (uint64_t)rows * 16 + (64u << 20)) return false;
+        inflated.resize((size_t)size);
+        uLongf got = (uLongf)size;
+        size_t rest = in.remaining();
+        if (uncompress((Bytef*)&inflated[0], &got, in.take(rest), (uLong)rest) != Z_OK || got != size) return false;
+        in = ByteReader((const unsigned char*)inflated.data(), inflated.size());
+        encoding &= (uint8_t)~DEFLATED;
+#else
+        return false;
+#endif
+    }
+
+    if (type == (uint8_t)ColumnType::INT64) {
+        vector<int64_t> values(rows);
+        if (encoding == BIT_PACKED || encoding == DELTA) {
+            int64_t first = unzigzag(in.getVarint());
+            uint64_t low = (uint64_t)(encoding == DELTA ? unzigzag(in.getVarint()) : first);
+            const unsigned char* width = in.take(1);
+            if (!width || *width > 64) return false;
+            size_t count = encoding == DELTA ? rows - 1 : rows;
+            const unsigned char* bits = in.take(packedSize(count, *width));
+            if (!bits) return false;
+            if (encoding == BIT_PACKED) {
+                unpackBits(bits, count, *width, [&values, low](size_t i, uint64_t v) { values[i] = (int64_t)(low + v); });
+            } else {
+                values[0] = first;
+                unpackBits(bits, count, *width, [&values, low](size_t i, uint64_t v) {
+                    values[i + 1] = (int64_t)((uint64_t)values[i] + low + v);
+                });
+            }
+        } else if (encoding == RUN_LENGTH) {
+            uint64_t runs = in.getVarint();
+            size_t at = 0;
+            for (uint64_t r = 0; r < runs && in.ok; r++) {
+                int64_t value = unzigzag(in.getVarint());
+                uint64_t count = in.getVarint();
+                if (count > rows - at) return false;
+                fill(values.begin() + at, values.begin() + at + count, value);
+                at += (size_t)count;
+            }
+            if (at != rows) return false;
+        } else {
+            return false;
+        }
+        if (!in.ok || !in.atEnd()) return false;
+        column = Column::ofInts(values);
+        column.setNullBits(nulls);
+        return column.declare(spec);
+    }
+
+    if (type == (uint8_t)ColumnType::DOUBLE) {
+        vector<double> values(rows);
+        if (encoding == PLAIN) {
+            const unsigned char* p = in.take(rows * 8);
+            if (!p) return false;
+            for (size_t i = 0; i < rows; i++) values[i] = getDoubleBits(p + 8 * i);
+        } else if (encoding == RUN_LENGTH) {
+            uint64_t runs = in.getVarint();
+            size_t at = 0;
+            for (uint64_t r = 0; r < runs && in.ok; r++) {
+                const unsigned char* p = in.take(8);
+                uint64_t count = in.getVarint();
+                if (!p || count > rows - at) return false;
+                fill(values.begin() + at, values.begin() + at + count, getDoubleBits(p));
+                at += (size_t)count;
+            }
+            if (at != rows) return false;
+        } else {
+            return false;
+        }
+        if (!in.ok || !in.atEnd()) return false;
+        column = Column::ofDoubles(values);
+        column.setNullBits(nulls);
+        return column.declare(spec);
+    }
+
+    if (type != (uint8_t)ColumnType::STRING || (encoding != DICTIONARY && encoding != DICTIONARY_RUNS)) return false;
+    uint64_t entries = in.getVarint();
+    if (!in.ok || entries == 0 || entries > rows) return false;
+    vector<string> dictionary((size_t)entries);
+    for (size_t i = 0; i < dictionary.size() && in.ok; i++) in.getString(dictionary[i]);
+    vector<uint32_t> codes(rows);
+    if (encoding == DICTIONARY) {
+        const unsigned char* width = in.take(1);
+        if (!width || *width > 32) return false;
+        const unsigned char* bits = in.take(packedSize(rows, *width));
+        if (!bits) return false;
+        unpackBits(bits, rows, *width, [&codes](size_t i, uint64_t v) { codes[i] = (uint32_t)v; });
+    } else {
+        uint64_t runs = in.getVarint();
+        size_t at = 0;
+        for (uint64_t r = 0; r < runs && in.ok; r++) {
+            uint64_t code = in.getVarint();
+            uint64_t count = in.getVarint();
+            if (code >= entries || count > rows - at) return false;
+            fill(codes.begin() + at, codes.begin() + at + count, (uint32_t)code);
+            at += (size_t)count;
+        }
+        if (at != rows) return false;
+    }
+    if (!in.ok || !in.atEnd() || !Column::ofStrings(dictionary, codes, column)) return false;
+    column.setNullBits(nulls);
+    return column.declare(spec);
+}
+
+// Appends the block holding the given rows (at least one) of store.
+inline void encodeBlock(const ColumnStore& store, const vector<size_t>& rows, string& out) {
+    ByteWriter block;
+    block.putVarint(rows.size());
+    string segment;
+    for (size_t c = 0; c < store.columnCount(); c++) {
+        segment.clear();
+        encodeSegment(store.column(c), rows, segment);
+        block.putVarint(segment.size());
+        block.bytes += segment;
+    }
+    out += block.bytes;
+}
+
+// Decodes a block of a table whose columns are declared as specs into one
+// Column per column and sets rows to its row count.
+inline bool decodeBlock(const unsigned char* data, size_t length, const vector<ColumnSpec>& specs, vector<Column>& columns, size_t& rows) {
+    ByteReader in(data, length);
+    uint64_t count = in.getVarint();
+    if (!in.ok || count == 0 || count > MAX_BLOCK_ROWS) return false;
+    rows = (size_t)count;
+    columns.assign(specs.size(), Column());
+    for (size_t c = 0; c < specs.size(); c++) {
+        uint64_t size = in.getVarint();
+        const unsigned char* segment = in.ok && size <= in.remaining() ? in.take((size_t)size) : nullptr;
+        if (!segment || !decodeSegment(segment, (size_t)size, rows, specs[c], columns[c])) return false;
+    }
+    return in.atEnd();
+}
+
+#endif // COMPRESSION_H
@@ -0,0 +1,219 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ColumnStore.h"
+#include "PageFile.h"
+#include "WorkerPool.h"
+using namespace std;
+
+// Comma-separated values as in RFC 4180: a field may be quoted with ",
+// a quote inside a quoted field is written twice, and quoted fields may
+// hold commas and line breaks. Records end in \n or \r\n; blank lines
+// are skipped.
+
+// Bytes of file one parse task takes.
+const size_t CSV_CHUNK_BYTES = 4u << 20;
+
+// Splits the record at p into fields, calling cell(field, text, length)
+// for each, and sets fields to how many there were. Unquoted fields, and
+// quoted ones without doubled quotes, are passed where they lie; only the
+// rest are copied (unescaped) into scratch. Returns the start of the next
+// record, or nullptr if a quote is not closed or a closing quote is
+// followed by more text.
+template <typename Cell>
+const char* parseCsvRecord(const char* p, const char* end, string& scratch, size_t& fields, const Cell& cell) {
+    fields = 0;
+    while (true) {
+        if (p < end && *p == '"') {
+            const char* text = ++p;
+            const char* close;
+            bool doubled = false;
+            while (true) {
+                close = (const char*)memchr(p, '"', end - p);
+                if (!close) return nullptr;
+                if (close + 1 < end && close[1] == '"') {
+                    doubled = true;
+                    p = close + 2;
+                    continue;
+                }
+                break;
+            }
+            if (!doubled) {
+                cell(fields, text, (size_t)(close - text));
+            } else {
+                scratch.clear();
+                for (const char* q = text; q < close; q++) {
+                    scratch += *q;
+                    if (*q == '"') q++;
+                }
+                cell(fields, scratch.data(), scratch.size());
+            }
+            p = close + 1;
+            if (p < end && *p != ',' && *p != '\n' && *p != '\r') return nullptr;
+        } else {
+            const char* text = p;
+            while (p < end && *p != ',' && *p != '\n' && *p != '\r') p++;
+            cell(fields, text, (size_t)(p - text));
+        }
+        fields++;
+        if (p < end && *p == ',') {
+            p++;
+            continue;
+        }
+        if (p < end && *p == '\r') p++;
+        if (p < end && *p == '\n') p++;
+        return p;
+    }
+}
+
+// Appends value to out as a field, quoted if it holds a comma, a quote or
+// a line break.
+inline void appendCsvField(string& out, const string& value) {
+    if (value.find_first_of(",\"\r\n") == string::npos) {
+        out += value;
+        return;
+    }
+    out += '"';
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '"') out += '"';
+        out += value[i];
+    }
+    out += '"';
+}
+
+// Reads a CSV file mapped into memory. The rows are parsed by the worker
+// pool straight into column storage: the file is cut into chunks at
+// record boundaries, each chunk becomes a ColumnStore of its own, and the
+// chunks, in file order, are the rows of the file.
+class CsvReader {
+private:
+    MappedFile file;
+    const char* pos;
+    const char* end;
+
+    // Line (from 1) that p lies on, for error messages.
+    size_t lineOf(const char* p) const {
+        return 1 + count((const char*)file.bytes(), p, '\n');
+    }
+
+    // Where each chunk starts, and end last. Each cut of the file into
+    // pieces of CSV_CHUNK_BYTES is moved past the next line break outside
+    // quotes. A position is inside quotes if an odd number of quotes come
+    // before it; those are counted for all pieces in parallel.
+    vector<const char*> chunkStarts() const {
+        size_t pieces = ((size_t)(end - pos) + CSV_CHUNK_BYTES - 1) / CSV_CHUNK_BYTES;
+        vector<size_t> quotes(pieces);
+        const char* begin = pos;
+        const char* stop = end;
+        WorkerPool::getInstance().run(pieces, [&](size_t piece, size_t) {
+            const char* p = begin + piece * CSV_CHUNK_BYTES;
+            quotes[piece] = count(p, min(stop, p + CSV_CHUNK_BYTES), '"');
+        });
+        vector<const char*> starts(1, begin);
+        bool quoted = false;
+        for (size_t piece = 1; piece < pieces; piece++) {
+            quoted ^= (quotes[piece - 1] & 1) != 0;
+            bool inside = quoted;
+            const char* p = begin + piece * CSV_CHUNK_BYTES;
+            for (; p < end; p++) {
+                if (*p == '"') inside = !inside;
+                else if (*p == '\n' && !inside) break;
+            }
+            if (p + 1 >= end) break;
+            if (p + 1 > starts.back()) starts.push_back(p + 1);
+        }
+        starts.push_back(end);
+        return starts;
+    }
+
+    CsvReader(const CsvReader&);
+    CsvReader& operator=(const CsvReader&);
+
+public:
+    CsvReader() : pos(nullptr), end(nullptr) {}
+
+    bool open(const string& path, string& error) {
+        if (!file.open(path)) { error = "cannot open " + path; return false; }
+        pos = (const char*)file.bytes();
+        end = pos + file.size();
+        if (end - pos >= 3 && memcmp(pos, "\xEF\xBB\xBF", 3) == 0) pos += 3;   // UTF-8 byte order mark
+        return true;
+    }
+
+    // Reads the first record as column names.
+    bool readHeader(vector<string>& names, string& error) {
+        while (pos < end && (*pos == '\n' || *pos == '\r')) pos++;
+        if (pos == end) { error = "the file is empty"; return false; }
+        string scratch;
+        size_t fields;
+        names.clear();
+        const char* next = parseCsvRecord(pos, end, scratch, fields, [&names](size_t, const char* text, size_t length) {
+            names.push_back(string(text, length));
+        });
+        if (!next) { error = "line 1: malformed header"; return false; }
+        pos = next;
+        return true;
+    }
+
+    // Parses every remaining record into chunks with a column of each of
+    // specs. Fails on the first record that is malformed, has another
+    // number of fields, or has a value that is not of its column's type.
+    bool readRows(const vector<ColumnSpec>& specs, vector<ColumnStore>& chunks, string& error) {
+        if (pos >= end) { chunks.clear(); return true; }
+        size_t columns = specs.size();
+        vector<const char*> starts = chunkStarts();
+        chunks.assign(starts.size() - 1, ColumnStore(specs));
+        vector<const char*> bad(chunks.size(), nullptr);
+        vector<size_t> badFields(chunks.size(), 0);
+        vector<string> badValues(chunks.size());
+        vector<size_t> badColumns(chunks.size(), 0);   // from 1; 0 if the record itself is bad
+        WorkerPool::getInstance().run(chunks.size(), [&](size_t chunk, size_t) {
+            ColumnStore& rows = chunks[chunk];
+            const char* p = starts[chunk];
+            const char* stop = starts[chunk + 1];
+            string scratch;
+            size_t fields;
+            while (p < stop) {
+                if (*p == '\n' || *p == '\r') { p++; continue; }
+                const char* record = p;
+                size_t invalid = 0;
+                string value;
+                p = parseCsvRecord(p, stop, scratch, fields, [&](size_t field, const char* text, size_t length) {
+                    if (field < columns && !rows.appendCell(field, text, length) && !invalid) {
+                        invalid = field + 1;
+                        value.assign(text, length);
+                    }
+                });
+                if (!p || fields != columns || invalid) {
+                    bad[chunk] = record;
+                    badFields[chunk] = p ? fields : 0;
+                    badColumns[chunk] = p && fields == columns ? invalid : 0;
+                    badValues[chunk] = value;
+                    return;
+                }
+                rows.endRow();
+            }
+        });
+        for (size_t c = 0; c < chunks.size(); c++) {
+            if (!bad[c]) continue;
+            error = "line " + to_string(lineOf(bad[c])) + ": ";
+            if (badColumns[c])
+                error += "'" + badValues[c] + "' is not a valid " + typeName(specs[badColumns[c] - 1]) +
+                         " for column " + to_string(badColumns[c]);
+            else if (badFields[c])
+                error += to_string(badFields[c]) + " field(s), expected " + to_string(columns);
+            else
+                error += "malformed record";
+            chunks.clear();
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif // CSV_H
@@ -0,0 +1,249 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+enum class IndexType { HASH, BTREE };
+
+// Sort key for one cell. Numbers order numerically and before all other
+// text, which orders lexicographically; ties on the number fall back to
+// the text so "1" and "1.0" stay distinct keys.
+struct IndexKey {
+    bool numeric;
+    double number;
+    string text;
+
+    IndexKey() : numeric(false), number(0) {}
+    explicit IndexKey(const string& value) : numeric(false), number(0), text(value) {
+        if (value.empty()) return;
+        char* end = nullptr;
+        errno = 0;
+        double parsed = strtod(value.c_str(), &end);
+        if (errno == 0 && *end == '\0' && parsed == parsed) {
+            numeric = true;
+            number = parsed;
+        }
+    }
+};
+
+inline int compareKeys(const IndexKey& a, const IndexKey& b) {
+    if (a.numeric != b.numeric) return a.numeric ? -1 : 1;
+    if (a.numeric && a.number != b.number) return a.number < b.number ? -1 : 1;
+    return a.text.compare(b.text);
+}
+
+inline int compareValues(const string& a, const string& b) {
+    return compareKeys(IndexKey(a), IndexKey(b));
+}
+
+// Equality index: value -> row positions holding it.
+class HashIndex {
+private:
+    unordered_map<string, vector<size_t>> postings;
+
+public:
+    void insert(const string& value, size_t row) { postings[value].push_back(row); }
+
+    void erase(const string& value, size_t row) {
+        auto it = postings.find(value);
+        if (it == postings.end()) return;
+        vector<size_t>& rows = it->second;
+        rows.erase(remove(rows.begin(), rows.end(), row), rows.end());
+        if (rows.empty()) postings.erase(it);
+    }
+
+    void find(const string& value, vector<size_t>& out) const {
+        auto it = postings.find(value);
+        if (it != postings.end()) out.insert(out.end(), it->second.begin(), it->second.end());
+    }
+
+    // Follows a compaction of the table: drops the rows whose keep flag is
+    // 0 and renumbers the rest; position[r] is the number of kept rows
+    // before r.
+    void compact(const vector<uint8_t>& keep, const vector<size_t>& position) {
+        for (auto it = postings.begin(); it != postings.end();) {
+            vector<size_t>& rows = it->second;
+            size_t kept = 0;
+            for (size_t i = 0; i < rows.size(); i++)
+                if (keep[rows[i]]) rows[kept++] = position[rows[i]];
+            rows.resize(kept);
+            if (rows.empty()) it = postings.erase(it);
+            else ++it;
+        }
+    }
+
+    void clear() { postings.clear(); }
+};
+
+// Ordered index for range predicates. Entries are (key, row) pairs so
+// duplicate values are distinct entries; leaves are chained left to right
+// for range scans. Nodes live in a pool and refer to each other by
+// position, which keeps the tree copyable along with its Table.
+class BPlusTree {
+private:
+    static constexpr size_t ORDER = 64;  // max entries per node before a split
+
+    struct Entry {
+        IndexKey key;
+        size_t row;
+    };
+
+    struct Node {
+        bool leaf;
+        vector<Entry> entries;   // leaf: the data; inner: separator keys
+        vector<int> children;    // inner only, entries.size() + 1 of them
+        int next;                // leaf only, right sibling or -1
+        Node(bool isLeaf) : leaf(isLeaf), next(-1) {}
+    };
+
+    vector<Node> nodes;
+    int root;
+
+    static int compareEntries(const Entry& a, const Entry& b) {
+        int c = compareKeys(a.key, b.key);
+        if (c != 0) return c;
+        return a.row < b.row ? -1 : (a.row > b.row ? 1 : 0);
+    }
+
+    static bool entryLess(const Entry& a, const Entry& b) { return compareEntries(a, b) < 0; }
+
+    // Index of the child of inner node n that covers e.
+    size_t childFor(const Node& n, const Entry& e) const {
+        return upper_bound(n.entries.begin(), n.entries.end(), e, entryLess) - n.entries.begin();
+    }
+
+    // Inserts into the subtree at nodeId. If the node splits, returns the
+    // new right sibling and sets separator to its first key; else -1.
+    int insertInto(int nodeId, const Entry& e, Entry& separator) {
+        if (nodes[nodeId].leaf) {
+            vector<Entry>& entries = nodes[nodeId].entries;
+            entries.insert(lower_bound(entries.begin(), entries.end(), e, entryLess), e);
+            if (entries.size() <= ORDER) return -1;
+
+            int rightId = (int)nodes.size();
+            nodes.push_back(Node(true));
+            Node& left = nodes[nodeId];
+            Node& right = nodes[rightId];
+            size_t half = left.entries.size() / 2;
+            right.entries.assign(left.entries.begin() + half, left.entries.end());
+            left.entries.resize(half);
+            right.next = left.next;
+            left.next = rightId;
+            separator = right.entries.front();
+            return rightId;
+        }
+
+        size_t slot = childFor(nodes[nodeId], e);
+        Entry childSeparator;
+        int newChild = insertInto(nodes[nodeId].children[slot], e, childSeparator);
+        if (newChild == -1) return -1;
+
+        Node& inner = nodes[nodeId];
+        inner.entries.insert(inner.entries.begin() + slot, childSeparator);
+        inner.children.insert(inner.children.begin() + slot + 1, newChild);
+        if (inner.entries.size() <= ORDER) return -1;
+
+        int rightId = (int)nodes.size();
+        nodes.push_back(Node(false));
+        Node& left = nodes[nodeId];
+        Node& right = nodes[rightId];
+        size_t half = left.entries.size() / 2;
+        separator = left.entries[half];
+        right.entries.assign(left.entries.begin() + half + 1, left.entries.end());
+        right.children.assign(left.children.begin() + half + 1, left.children.end());
+        left.entries.resize(half);
+        left.children.resize(half + 1);
+        return rightId;
+    }
+
+    int leafFor(const Entry& e) const {
+        int id = root;
+        while (!nodes[id].leaf) id = nodes[id].children[childFor(nodes[id], e)];
+        return id;
+    }
+
+public:
+    BPlusTree() { clear(); }
+
+    void clear() {
+        nodes.clear();
+        nodes.push_back(Node(true));
+        root = 0;
+    }
+
+    void insert(const string& value, size_t row) {
+        Entry e = {IndexKey(value), row};
+        Entry separator;
+        int right = insertInto(root, e, separator);
+        if (right == -1) return;
+        Node newRoot(false);
+        newRoot.entries.push_back(separator);
+        newRoot.children.push_back(root);
+        newRoot.children.push_back(right);
+        nodes.push_back(newRoot);
+        root = (int)nodes.size() - 1;
+    }
+
+    // Removes the entry from its leaf. Underfull leaves are not merged; the
+    // tree stays valid and range scans simply skip empty leaves.
+    void erase(const string& value, size_t row) {
+        Entry e = {IndexKey(value), row};
+        vector<Entry>& entries = nodes[leafFor(e)].entries;
+        auto it = lower_bound(entries.begin(), entries.end(), e, entryLess);
+        if (it != entries.end() && compareEntries(*it, e) == 0) entries.erase(it);
+    }
+
+    // Appends rows whose value lies in [low, high]. A missing bound (null
+    // pointer) leaves that side open.
+    void range(const string* low, const string* high, vector<size_t>& out) const {
+        int id = root;
+        size_t pos = 0;
+        IndexKey lowKey, highKey;
+        if (low) {
+            lowKey = IndexKey(*low);
+            Entry start = {lowKey, 0};
+            id = leafFor(start);
+            pos = lower_bound(nodes[id].entries.begin(), nodes[id].entries.end(), start, entryLess)
+                  - nodes[id].entries.begin();
+        } else {
+            while (!nodes[id].leaf) id = nodes[id].children.front();
+        }
+        if (high) highKey = IndexKey(*high);
+
+        for (; id != -1; id = nodes[id].next, pos = 0) {
+            const vector<Entry>& entries = nodes[id].entries;
+            for (; pos < entries.size(); pos++) {
+                if (high && compareKeys(entries[pos].key, highKey) > 0) return;
+                out.push_back(entries[pos].row);
+            }
+        }
+    }
+
+    void find(const string& value, vector<size_t>& out) const { range(&value, &value, out); }
+
+    // As HashIndex::compact. Leaves lose the removed entries (like
+    // erase, without merging); separators are renumbered the same way,
+    // removed rows included, which keeps every (key, row) order, so the
+    // tree shape stays valid.
+    void compact(const vector<uint8_t>& keep, const vector<size_t>& position) {
+        for (size_t n = 0; n < nodes.size(); n++) {
+            vector<Entry>& entries = nodes[n].entries;
+            size_t kept = 0;
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (nodes[n].leaf && !keep[entries[i].row]) continue;
+                entries[kept] = entries[i];
+                entries[kept++].row = position[entries[i].row];
+            }
+            entries.resize(kept);
+        }
+    }
+};
+
+#endif // INDEX_H
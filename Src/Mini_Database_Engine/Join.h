@@ -0,0 +1,411 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ColumnStore.h"
+#include "Index.h"
+using namespace std;
+
+// One side of an equi-join: the rows of store (only those set in visible,
+// if given) matched on one column. order, if given, lists those rows in
+// key order, as a B+tree on the column does.
+struct JoinInput {
+    const ColumnStore* store;
+    const vector<uint8_t>* visible;
+    size_t column;
+    const vector<size_t>* order;
+};
+
+// Called with (left row, right row) for every matching pair.
+typedef function<void(size_t, size_t)> JoinEmitter;
+
+// The join key of every row of a column. Keys match like SQL "=": numbers
+// by value (so 5 matches 5.0), other text exactly.
+class KeyColumn {
+private:
+    const Column& column;
+    vector<IndexKey> codeKeys;   // STRING columns: key of each dictionary entry
+
+public:
+    explicit KeyColumn(const Column& c) : column(c) {
+        if (c.getType() != ColumnType::STRING) return;
+        const vector<string>& dict = c.getDictionary();
+        codeKeys.reserve(dict.size());
+        for (size_t i = 0; i < dict.size(); i++) codeKeys.push_back(IndexKey(dict[i]));
+    }
+
+    bool integral() const { return column.getType() == ColumnType::INT64; }
+
+    bool numeric(size_t row) const { return column.getType() != ColumnType::STRING || codeKeys[column.codeData()[row]].numeric; }
+
+    double number(size_t row) const {
+        switch (column.getType()) {
+            case ColumnType::INT64:  return (double)column.intData()[row];
+            case ColumnType::DOUBLE: return column.doubleData()[row];
+            default:                 return codeKeys[column.codeData()[row]].number;
+        }
+    }
+
+    const string& text(size_t row) const { return codeKeys[column.codeData()[row]].text; }
+
+    int compare(size_t row, const KeyColumn& other, size_t otherRow) const {
+        bool a = numeric(row), b = other.numeric(otherRow);
+        if (a != b) return a ? -1 : 1;
+        if (a) {
+            double x = number(row), y = other.number(otherRow);
+            return x < y ? -1 : (x > y ? 1 : 0);
+        }
+        return text(row).compare(other.text(otherRow));
+    }
+
+    // Byte string that is equal for exactly the keys that match.
+    string hashKey(size_t row) const {
+        if (!numeric(row)) return "T" + text(row);
+        double d = number(row);
+        if (d == 0) d = 0;   // -0 matches 0
+        string key(1 + sizeof(d), 'N');
+        memcpy(&key[1], &d, sizeof(d));
+        return key;
+    }
+};
+
+// Build/probe hash join. The build side goes into a hash table; the probe
+// side is streamed past it. When the table would not fit in memoryLimit
+// bytes, both sides are first split by key hash into partitions written to
+// temporary files, and each partition is joined on its own, so only one
+// partition's hash table is in memory at a time. A partition that is still
+// too large is split again with a different hash, and one that splitting
+// cannot shrink (a single key with more rows than fit) is joined a block
+// of build rows at a time, each block against the whole probe partition.
+class HashJoin {
+private:
+    static constexpr size_t NONE = (size_t)-1;
+    static constexpr size_t ENTRY_OVERHEAD = 48;   // hash node, chain and row per build row, roughly
+    static constexpr size_t MAX_PARTITIONS = 512;  // spill files per split
+    static constexpr size_t MAX_LEVELS = 4;        // splits of one partition before joining it in blocks
+
+    template <typename Key>
+    class Table {
+    private:
+        unordered_map<Key, size_t> heads;   // key -> newest entry
+        vector<size_t> rows, next;
+
+    public:
+        void reserve(size_t n) {
+            heads.reserve(n);
+            rows.reserve(n);
+            next.reserve(n);
+        }
+
+        // Entries of a key come back newest first.
+        void insert(const Key& key, size_t row) {
+            auto r = heads.emplace(key, rows.size());
+            next.push_back(r.second ? NONE : r.first->second);
+            if (!r.second) r.first->second = rows.size();
+            rows.push_back(row);
+        }
+
+        template <typename Visitor>
+        void find(const Key& key, const Visitor& visit) const {
+            auto it = heads.find(key);
+            if (it == heads.end()) return;
+            for (size_t e = it->second; e != NONE; e = next[e]) visit(rows[e]);
+        }
+    };
+
+    // A temporary file of (key, row) entries and how many it holds.
+    struct Spill {
+        FILE* file;
+        size_t rows;
+    };
+
+    static bool writeKey(FILE* f, int64_t key) { return fwrite(&key, sizeof(key), 1, f) == 1; }
+    static bool writeKey(FILE* f, const string& key) {
+        uint32_t length = (uint32_t)key.size();
+        return fwrite(&length, sizeof(length), 1, f) == 1 && fwrite(key.data(), 1, length, f) == length;
+    }
+    static bool readKey(FILE* f, int64_t& key) { return fread(&key, sizeof(key), 1, f) == 1; }
+    static bool readKey(FILE* f, string& key) {
+        uint32_t length;
+        if (fread(&length, sizeof(length), 1, f) != 1) return false;
+        key.resize(length);
+        return length == 0 || fread(&key[0], 1, length, f) == length;
+    }
+
+    template <typename Key>
+    static bool writeEntry(Spill& s, const Key& key, size_t row) {
+        uint64_t r = row;
+        s.rows++;
+        return writeKey(s.file, key) && fwrite(&r, sizeof(r), 1, s.file) == 1;
+    }
+
+    template <typename Key>
+    static bool readEntry(FILE* f, Key& key, size_t& row) {
+        uint64_t r;
+        if (!readKey(f, key) || fread(&r, sizeof(r), 1, f) != 1) return false;
+        row = (size_t)r;
+        return true;
+    }
+
+    // The partition of a key at a level of splitting. Each level mixes the
+    // hash with its own constant, so the rows of one partition spread over
+    // the next level's partitions instead of landing together again.
+    static size_t bucket(size_t hash, size_t level, size_t buckets) {
+        uint64_t x = hash + 0x9E3779B97F4A7C15ull * (level + 1);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return (size_t)((x ^ (x >> 31)) % buckets);
+    }
+
+    // Twice the bare minimum leaves room for uneven partitions.
+    static size_t partitionCount(size_t need, size_t memoryLimit) {
+        return min<size_t>(2 * (need / max<size_t>(memoryLimit, 1) + 1), MAX_PARTITIONS);
+    }
+
+    static bool openSpills(size_t n, vector<Spill>& spills, string& error) {
+        for (size_t p = 0; p < n; p++) {
+            Spill s = {tmpfile(), 0};
+            if (!s.file) { error = "cannot create join spill file"; return false; }
+            spills.push_back(s);
+        }
+        return true;
+    }
+
+    static void closeSpills(vector<Spill>& spills) {
+        for (size_t p = 0; p < spills.size(); p++)
+            if (spills[p].file) fclose(spills[p].file);
+        spills.clear();
+    }
+
+    // Makes the spills readable from the start.
+    static bool finishSpills(vector<Spill>& spills, string& error) {
+        for (size_t p = 0; p < spills.size(); p++) {
+            if (fflush(spills[p].file) != 0) { error = "cannot write join spill file"; return false; }
+            rewind(spills[p].file);
+        }
+        return true;
+    }
+
+    static bool included(const JoinInput& in, size_t row) { return !in.visible || (*in.visible)[row]; }
+
+    static size_t inputRows(const JoinInput& in) {
+        if (!in.visible) return in.store->rowCount();
+        size_t n = 0;
+        for (size_t i = 0; i < in.visible->size(); i++) n += (*in.visible)[i];
+        return n;
+    }
+
+    template <typename Key, typename BuildKey, typename ProbeKey>
+    static void joinInMemory(const JoinInput& build, const JoinInput& probe, bool buildIsLeft,
+                             const BuildKey& buildKey, const ProbeKey& probeKey, const JoinEmitter& emit) {
+        Table<Key> table;
+        table.reserve(inputRows(build));
+        // Inserting from the last row up makes every key's rows come back in row order.
+        for (size_t row = build.store->rowCount(); row-- > 0;)
+            if (included(build, row)) table.insert(buildKey(row), row);
+        for (size_t row = 0; row < probe.store->rowCount(); row++) {
+            if (!included(probe, row)) continue;
+            table.find(probeKey(row), [&](size_t match) {
+                if (buildIsLeft) emit(match, row);
+                else emit(row, match);
+            });
+        }
+    }
+
+    // Splits the rows of an input into spills by key hash (level 0).
+    template <typename Key, typename KeyOf>
+    static bool partition(const JoinInput& in, const KeyOf& keyOf, vector<Spill>& spills, string& error) {
+        std::hash<Key> hasher;
+        for (size_t row = 0; row < in.store->rowCount(); row++) {
+            if (!included(in, row)) continue;
+            Key key = keyOf(row);
+            if (!writeEntry(spills[bucket(hasher(key), 0, spills.size())], key, row)) {
+                error = "cannot write join spill file";
+                return false;
+            }
+        }
+        return finishSpills(spills, error);
+    }
+
+    // Splits the entries of a spill file further, at the given level.
+    template <typename Key>
+    static bool repartition(FILE* from, size_t level, vector<Spill>& spills, string& error) {
+        std::hash<Key> hasher;
+        Key key;
+        size_t row;
+        while (readEntry(from, key, row)) {
+            if (!writeEntry(spills[bucket(hasher(key), level, spills.size())], key, row)) {
+                error = "cannot write join spill file";
+                return false;
+            }
+        }
+        return finishSpills(spills, error);
+    }
+
+    // Joins one partition: buildRows entries in build with the entries in
+    // probe. It is split again if its hash table would not fit, as long as
+    // splitting makes it smaller; otherwise the build side is read a block
+    // that fits at a time and the probe side streamed past each block.
+    template <typename Key>
+    static bool joinPartition(FILE* build, size_t buildRows, FILE* probe, size_t level, bool buildIsLeft,
+                              size_t keyBytes, size_t memoryLimit, const JoinEmitter& emit, string& error) {
+        size_t perRow = keyBytes + ENTRY_OVERHEAD;
+        size_t need = buildRows * perRow;
+        if (need > memoryLimit && level < MAX_LEVELS && buildRows > 1) {
+            vector<Spill> buildParts, probeParts;
+            size_t n = min(partitionCount(need, memoryLimit), buildRows);
+            bool ok = openSpills(n, buildParts, error) && openSpills(n, probeParts, error) &&
+                      repartition<Key>(build, level, buildParts, error) && repartition<Key>(probe, level, probeParts, error);
+            bool split = true;
+            for (size_t p = 0; ok && p < buildParts.size(); p++) split = split && buildParts[p].rows < buildRows;
+            for (size_t p = 0; ok && split && p < buildParts.size(); p++)
+                ok = joinPartition<Key>(buildParts[p].file, buildParts[p].rows, probeParts[p].file, level + 1,
+                                        buildIsLeft, keyBytes, memoryLimit, emit, error);
+            closeSpills(buildParts);
+            closeSpills(probeParts);
+            if (!ok || split) return ok;
+            // One key holds every row: no hash can split it.
+            rewind(build);
+            rewind(probe);
+        }
+        size_t blockRows = max<size_t>(memoryLimit / perRow, 1);
+        vector<pair<Key, size_t> > entries;
+        Key key;
+        size_t row;
+        bool more = true;
+        while (more) {
+            entries.clear();
+            while (entries.size() < blockRows && (more = readEntry(build, key, row))) entries.push_back(make_pair(key, row));
+            if (entries.empty()) break;
+            Table<Key> table;
+            table.reserve(entries.size());
+            for (size_t e = entries.size(); e-- > 0;) table.insert(entries[e].first, entries[e].second);
+            rewind(probe);
+            while (readEntry(probe, key, row)) {
+                size_t probeRow = row;
+                table.find(key, [&](size_t match) {
+                    if (buildIsLeft) emit(match, probeRow);
+                    else emit(probeRow, match);
+                });
+            }
+        }
+        return true;
+    }
+
+    template <typename Key, typename BuildKey, typename ProbeKey>
+    static bool joinSpilled(const JoinInput& build, const JoinInput& probe, bool buildIsLeft, const BuildKey& buildKey,
+                            const ProbeKey& probeKey, size_t partitions, size_t keyBytes, size_t memoryLimit,
+                            const JoinEmitter& emit, string& error) {
+        vector<Spill> buildParts, probeParts;
+        bool ok = openSpills(partitions, buildParts, error) && openSpills(partitions, probeParts, error) &&
+                  partition<Key>(build, buildKey, buildParts, error) && partition<Key>(probe, probeKey, probeParts, error);
+        for (size_t p = 0; ok && p < buildParts.size(); p++) {
+            ok = joinPartition<Key>(buildParts[p].file, buildParts[p].rows, probeParts[p].file, 1, buildIsLeft,
+                                    keyBytes, memoryLimit, emit, error);
+            // Give the disk space back before the next partition.
+            fclose(buildParts[p].file);
+            fclose(probeParts[p].file);
+            buildParts[p].file = probeParts[p].file = nullptr;
+        }
+        closeSpills(buildParts);
+        closeSpills(probeParts);
+        return ok;
+    }
+
+    template <typename Key, typename BuildKey, typename ProbeKey>
+    static bool join(const JoinInput& build, const JoinInput& probe, bool buildIsLeft, const BuildKey& buildKey,
+                     const ProbeKey& probeKey, size_t keyBytes, size_t memoryLimit, const JoinEmitter& emit, string& error) {
+        size_t need = inputRows(build) * (keyBytes + ENTRY_OVERHEAD);
+        if (need <= memoryLimit) {
+            joinInMemory<Key>(build, probe, buildIsLeft, buildKey, probeKey, emit);
+            return true;
+        }
+        return joinSpilled<Key>(build, probe, buildIsLeft, buildKey, probeKey, partitionCount(need, memoryLimit),
+                                keyBytes, memoryLimit, emit, error);
+    }
+
+public:
+    // Joins left with right, calling emit for every matching pair. The
+    // smaller side is the build side. Returns false (and sets error) if a
+    // spill file cannot be written.
+    static bool run(const JoinInput& left, const JoinInput& right, size_t memoryLimit, const JoinEmitter& emit, string& error) {
+        bool buildIsLeft = inputRows(left) <= inputRows(right);
+        const JoinInput& build = buildIsLeft ? left : right;
+        const JoinInput& probe = buildIsLeft ? right : left;
+        KeyColumn buildColumn(build.store->column(build.column)), probeColumn(probe.store->column(probe.column));
+        if (buildColumn.integral() && probeColumn.integral()) {
+            const int64_t* b = build.store->column(build.column).intData();
+            const int64_t* p = probe.store->column(probe.column).intData();
+            return join<int64_t>(build, probe, buildIsLeft, [b](size_t row) { return b[row]; },
+                                 [p](size_t row) { return p[row]; }, sizeof(int64_t), memoryLimit, emit, error);
+        }
+        return join<string>(build, probe, buildIsLeft, [&buildColumn](size_t row) { return buildColumn.hashKey(row); },
+                            [&probeColumn](size_t row) { return probeColumn.hashKey(row); }, sizeof(string) + 16, memoryLimit, emit, error);
+    }
+};
+
+// Sort-merge join: both sides are put in key order and merged in one pass.
+// A side with a known order (an index) or whose rows are already sorted
+// on the key is not sorted again, which is when this beats a hash join.
+class SortMergeJoin {
+private:
+    static vector<size_t> ordered(const JoinInput& in, const KeyColumn& key) {
+        if (in.order) return *in.order;
+        vector<size_t> rows;
+        rows.reserve(in.store->rowCount());
+        for (size_t row = 0; row < in.store->rowCount(); row++)
+            if (!in.visible || (*in.visible)[row]) rows.push_back(row);
+        if (!sortedOn(rows, key))
+            stable_sort(rows.begin(), rows.end(), [&key](size_t a, size_t b) { return key.compare(a, key, b) < 0; });
+        return rows;
+    }
+
+public:
+    static bool sortedOn(const vector<size_t>& rows, const KeyColumn& key) {
+        for (size_t i = 1; i < rows.size(); i++)
+            if (key.compare(rows[i - 1], key, rows[i]) > 0) return false;
+        return true;
+    }
+
+    // True if the input needs no sort: it has an order, or its rows are
+    // already sorted on the key.
+    static bool presorted(const JoinInput& in) {
+        if (in.order) return true;
+        KeyColumn key(in.store->column(in.column));
+        size_t last = (size_t)-1;
+        for (size_t row = 0; row < in.store->rowCount(); row++) {
+            if (in.visible && !(*in.visible)[row]) continue;
+            if (last != (size_t)-1 && key.compare(last, key, row) > 0) return false;
+            last = row;
+        }
+        return true;
+    }
+
+    static void run(const JoinInput& left, const JoinInput& right, const JoinEmitter& emit) {
+        KeyColumn leftKey(left.store->column(left.column)), rightKey(right.store->column(right.column));
+        vector<size_t> l = ordered(left, leftKey), r = ordered(right, rightKey);
+        size_t i = 0, j = 0;
+        while (i < l.size() && j < r.size()) {
+            int c = leftKey.compare(l[i], rightKey, r[j]);
+            if (c < 0) { i++; continue; }
+            if (c > 0) { j++; continue; }
+            // Equal keys: pair up the two runs.
+            size_t iEnd = i + 1, jEnd = j + 1;
+            while (iEnd < l.size() && leftKey.compare(l[iEnd], rightKey, r[j]) == 0) iEnd++;
+            while (jEnd < r.size() && leftKey.compare(l[i], rightKey, r[jEnd]) == 0) jEnd++;
+            for (size_t a = i; a < iEnd; a++)
+                for (size_t b = j; b < jEnd; b++) emit(l[a], r[b]);
+            i = iEnd;
+            j = jEnd;
+        }
+    }
+};
+
+#endif // JOIN_H
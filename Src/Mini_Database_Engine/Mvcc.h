@@ -0,0 +1,389 @@
+#ifndef MVCC_H
+#define MVCC_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// deletedAt of a row that has not been deleted.
+const uint64_t NEVER = UINT64_MAX;
+
+// A shared_mutex that can be a member of a copyable class. A copy gets a
+// fresh, unlocked latch; tables are only copied while they are loaded,
+// before any other thread can see them.
+class Latch : public shared_mutex {
+public:
+    Latch() {}
+    Latch(const Latch&) : shared_mutex() {}
+    Latch& operator=(const Latch&) { return *this; }
+};
+
+// Hands out commit timestamps and keeps track of who is still reading.
+//
+// Every commit gets the next timestamp. A transaction's snapshot is the
+// last commit timestamp when it began, and it sees exactly the changes
+// committed at or before its snapshot. Old row versions are kept until no
+// active snapshot can see them any more.
+class TransactionManager {
+private:
+    mutex lock;                  // guards snapshots, writers and nextId
+    multiset<uint64_t> snapshots;
+    size_t writers;
+    uint64_t nextId;
+    atomic<uint64_t> lastCommit;
+
+    TransactionManager(const TransactionManager&);
+    TransactionManager& operator=(const TransactionManager&);
+
+public:
+    // Held by commits (and by checkpoints and DDL that write the log) so
+    // changes reach the log in commit order.
+    mutex commitLock;
+
+    TransactionManager() : writers(0), nextId(0), lastCommit(0) {}
+
+    uint64_t beginSnapshot() {
+        lock_guard<mutex> guard(lock);
+        uint64_t ts = lastCommit.load();
+        snapshots.insert(ts);
+        return ts;
+    }
+
+    void endSnapshot(uint64_t ts) {
+        lock_guard<mutex> guard(lock);
+        auto it = snapshots.find(ts);
+        if (it != snapshots.end()) snapshots.erase(it);
+    }
+
+    // No active snapshot is older than this.
+    uint64_t oldestSnapshot() {
+        lock_guard<mutex> guard(lock);
+        return snapshots.empty() ? lastCommit.load() : *snapshots.begin();
+    }
+
+    uint64_t newTransactionId() {
+        lock_guard<mutex> guard(lock);
+        return ++nextId;
+    }
+
+    // Transactions holding row locks or buffered changes count as writers;
+    // rows are only physically removed while there are none.
+    void addWriter() { lock_guard<mutex> guard(lock); writers++; }
+    void removeWriter() { lock_guard<mutex> guard(lock); writers--; }
+    size_t writerCount() { lock_guard<mutex> guard(lock); return writers; }
+
+    // Called under commitLock.
+    uint64_t nextCommit() const { return lastCommit.load() + 1; }
+    // Makes every change stamped with ts visible to new snapshots at once.
+    void publish(uint64_t ts) { lastCommit.store(ts); }
+};
+
+// Takes a snapshot for the lifetime of a read.
+class SnapshotScope {
+private:
+    TransactionManager& manager;
+    uint64_t ts;
+
+public:
+    explicit SnapshotScope(TransactionManager& m) : manager(m), ts(m.beginSnapshot()) {}
+    ~SnapshotScope() { manager.endSnapshot(ts); }
+    uint64_t time() const { return ts; }
+};
+
+inline size_t lowbit(size_t i) { return i & (~i + 1); }
+
+// Counts flagged rows by position (a Fenwick tree): how many of the
+// first n rows are flagged, and which row is the k-th flagged one, in
+// O(log rows). Appending a row and changing a flag are O(log rows) too.
+class RowCounter {
+private:
+    vector<size_t> tree;   // tree[i] (from 1) sums the flags of rows (i - lowbit(i), i]
+    size_t flagged;
+
+public:
+    RowCounter() : tree(1, 0), flagged(0) {}
+
+    size_t count() const { return flagged; }
+
+    // Rows [0, rows) with row i flagged if isFlagged(i), in one pass.
+    template <typename Flag>
+    void build(size_t rows, const Flag& isFlagged) {
+        tree.assign(rows + 1, 0);
+        flagged = 0;
+        for (size_t i = 1; i <= rows; i++) {
+            if (isFlagged(i - 1)) { tree[i]++; flagged++; }
+            size_t parent = i + lowbit(i);
+            if (parent <= rows) tree[parent] += tree[i];
+        }
+    }
+
+    void push(bool isFlagged) {
+        size_t i = tree.size();
+        tree.push_back(isFlagged + prefix(i - 1) - prefix(i - lowbit(i)));
+        flagged += isFlagged;
+    }
+
+    void unflag(size_t row) {
+        for (size_t i = row + 1; i < tree.size(); i += lowbit(i)) tree[i]--;
+        flagged--;
+    }
+
+    // Flagged rows among the first n.
+    size_t prefix(size_t n) const {
+        size_t sum = 0;
+        for (size_t i = n; i > 0; i -= lowbit(i)) sum += tree[i];
+        return sum;
+    }
+
+    // The k-th (from 0) flagged row; k < count().
+    size_t select(size_t k) const {
+        size_t pos = 0, step = 1;
+        while (step * 2 < tree.size()) step *= 2;
+        for (; step > 0; step /= 2) {
+            if (pos + step < tree.size() && tree[pos + step] <= k) {
+                pos += step;
+                k -= tree[pos];
+            }
+        }
+        return pos;
+    }
+
+    // The k-th (from 0) row flagged here but not in excluded, which only
+    // flags rows flagged here.
+    template <typename Counter>
+    size_t selectExcept(size_t k, const Counter& excluded) const {
+        size_t pos = 0, step = 1;
+        while (step * 2 < tree.size()) step *= 2;
+        for (; step > 0; step /= 2) {
+            if (pos + step >= tree.size()) continue;
+            size_t n = tree[pos + step] - excluded.node(pos + step);
+            if (n <= k) {
+                pos += step;
+                k -= n;
+            }
+        }
+        return pos;
+    }
+};
+
+// A RowCounter for a few rows of a large table: only the nodes of the
+// tree that are not zero are stored. It covers the rows the table had
+// when it was made; rows after those cannot be flagged.
+class SparseRowCounter {
+private:
+    unordered_map<size_t, size_t> tree;
+    size_t rows, flagged;
+
+public:
+    explicit SparseRowCounter(size_t rowCount = 0) : rows(rowCount), flagged(0) {}
+
+    size_t count() const { return flagged; }
+
+    void flag(size_t row) {
+        for (size_t i = row + 1; i <= rows; i += lowbit(i)) tree[i]++;
+        flagged++;
+    }
+
+    size_t prefix(size_t n) const {
+        size_t sum = 0;
+        for (size_t i = min(n, rows); i > 0; i -= lowbit(i)) {
+            auto it = tree.find(i);
+            if (it != tree.end()) sum += it->second;
+        }
+        return sum;
+    }
+
+    // Flagged rows in (i - lowbit(i), i], for i past the covered rows too.
+    size_t node(size_t i) const {
+        if (i > rows) return prefix(i) - prefix(i - lowbit(i));
+        auto it = tree.find(i);
+        return it == tree.end() ? 0 : it->second;
+    }
+};
+
+// Version bookkeeping for the rows of one table. The column storage holds
+// the newest committed version of every row in place; this records when
+// each row was created and deleted and keeps the values that updates
+// replaced (newest first) for snapshots that are older than the update.
+class RowVersions {
+public:
+    struct OldVersion {
+        uint64_t until;          // commit that replaced these values
+        vector<string> values;
+    };
+
+private:
+    vector<uint64_t> createdAt, deletedAt;
+    unordered_map<size_t, vector<OldVersion> > history;
+    unordered_map<size_t, uint64_t> owners;   // row -> transaction updating or deleting it
+    RowCounter live;                           // rows not deleted
+    Latch ownerLock;                           // owners change under the shared table latch
+    size_t deadRows;
+    uint64_t lastChange;     // latest commit that inserted, updated or deleted
+    uint64_t lastUpdate;     // latest commit that replaced values
+
+public:
+    RowVersions() : deadRows(0), lastChange(0), lastUpdate(0) {}
+
+    // Rows that exist from the start, as after loading.
+    void reset(size_t rows) {
+        createdAt.assign(rows, 0);
+        deletedAt.assign(rows, NEVER);
+        history.clear();
+        owners.clear();
+        live.build(rows, [](size_t) { return true; });
+        deadRows = 0;
+    }
+
+    size_t size() const { return createdAt.size(); }
+    size_t dead() const { return deadRows; }
+    size_t liveCount() const { return live.count(); }
+    bool hasHistory() const { return !history.empty(); }
+
+    // Nothing committed after ts and no deleted rows left: the column
+    // storage is exactly what a snapshot at ts sees.
+    bool current(uint64_t ts) const { return deadRows == 0 && lastChange <= ts; }
+    // The rows a snapshot at ts sees all hold their in-place values.
+    bool inPlace(uint64_t ts) const { return lastUpdate <= ts; }
+    // Nothing committed after ts: a snapshot at ts sees exactly the rows
+    // that are not deleted.
+    bool settled(uint64_t ts) const { return lastChange <= ts; }
+
+    bool visible(size_t row, uint64_t ts) const { return createdAt[row] <= ts && deletedAt[row] > ts; }
+    bool deleted(size_t row) const { return deletedAt[row] != NEVER; }
+
+    // The replaced values a snapshot at ts sees for a visible row, or
+    // nullptr if it sees the in-place ones.
+    const vector<string>* olderVersion(size_t row, uint64_t ts) const {
+        if (lastUpdate <= ts) return nullptr;
+        auto it = history.find(row);
+        if (it == history.end() || it->second.front().until <= ts) return nullptr;
+        const vector<OldVersion>& versions = it->second;
+        size_t i = 0;
+        while (i + 1 < versions.size() && versions[i + 1].until > ts) i++;
+        return &versions[i].values;
+    }
+
+    const vector<OldVersion>* versionsOf(size_t row) const {
+        auto it = history.find(row);
+        return it == history.end() ? nullptr : &it->second;
+    }
+
+    // Position of row among the rows that are not deleted, as the log
+    // counts them, and back.
+    size_t liveOrdinal(size_t row) const { return deadRows == 0 ? row : live.prefix(row); }
+    size_t nthLive(size_t ordinal) const { return deadRows == 0 ? ordinal : live.select(ordinal); }
+    // The same, skipping the rows in excluded as well.
+    size_t nthLive(size_t ordinal, const SparseRowCounter& excluded) const {
+        return excluded.count() == 0 ? nthLive(ordinal) : live.selectExcept(ordinal, excluded);
+    }
+
+    void visibleMask(uint64_t ts, vector<uint8_t>& mask) const {
+        mask.resize(createdAt.size());
+        for (size_t i = 0; i < createdAt.size(); i++) mask[i] = createdAt[i] <= ts && deletedAt[i] > ts;
+    }
+
+    // First updater wins: a transaction reading at ts may change a row
+    // only if nobody committed a change to it after ts and no other
+    // transaction is changing it.
+    bool lock(size_t row, uint64_t transaction, uint64_t ts) {
+        lock_guard<Latch> guard(ownerLock);
+        auto it = owners.find(row);
+        if (it != owners.end()) return it->second == transaction;
+        uint64_t last = createdAt[row];
+        auto h = history.find(row);
+        if (h != history.end()) last = max(last, h->second.front().until);
+        if (deletedAt[row] != NEVER) last = max(last, deletedAt[row]);
+        if (last > ts) return false;
+        owners[row] = transaction;
+        return true;
+    }
+
+    void unlock(size_t row, uint64_t transaction) {
+        lock_guard<Latch> guard(ownerLock);
+        auto it = owners.find(row);
+        if (it != owners.end() && it->second == transaction) owners.erase(it);
+    }
+
+    // The commit* methods run under the exclusive table latch.
+    void commitInsert(uint64_t ts) {
+        createdAt.push_back(ts);
+        deletedAt.push_back(NEVER);
+        live.push(true);
+        lastChange = ts;
+    }
+
+    void commitUpdate(size_t row, uint64_t ts, const vector<string>& oldValues) {
+        OldVersion v = {ts, oldValues};
+        vector<OldVersion>& versions = history[row];
+        versions.insert(versions.begin(), v);
+        lastChange = lastUpdate = ts;
+    }
+
+    // Leaves a tombstone; compact() removes the row once no snapshot can
+    // see it.
+    void commitDelete(size_t row, uint64_t ts) {
+        deletedAt[row] = ts;
+        live.unflag(row);
+        deadRows++;
+        lastChange = ts;
+    }
+
+    // Drops the replaced values no snapshot at or after oldest can see;
+    // dropped(row, values) is told about each.
+    template <typename Visitor>
+    void prune(uint64_t oldest, const Visitor& dropped) {
+        for (auto it = history.begin(); it != history.end();) {
+            vector<OldVersion>& versions = it->second;
+            while (!versions.empty() && versions.back().until <= oldest) {
+                OldVersion v = versions.back();
+                versions.pop_back();
+                dropped(it->first, v.values);
+            }
+            if (versions.empty()) it = history.erase(it);
+            else ++it;
+        }
+    }
+
+    // Removes the deleted rows no snapshot at or after oldest can see, in
+    // one pass, and sets keep[r] to whether row r stayed. Rows only move
+    // while no transaction holds row locks or buffered changes. Returns
+    // the number of rows removed.
+    size_t compact(uint64_t oldest, vector<uint8_t>& keep) {
+        size_t rows = createdAt.size(), kept = 0;
+        keep.assign(rows, 1);
+        vector<size_t> position(rows);
+        for (size_t i = 0; i < rows; i++) {
+            position[i] = kept;
+            if (deletedAt[i] <= oldest) {
+                keep[i] = 0;
+                continue;
+            }
+            createdAt[kept] = createdAt[i];
+            deletedAt[kept++] = deletedAt[i];
+        }
+        if (kept == rows) return 0;
+        deadRows -= rows - kept;
+        createdAt.resize(kept);
+        deletedAt.resize(kept);
+        unordered_map<size_t, vector<OldVersion> > moved;
+        for (auto it = history.begin(); it != history.end(); ++it)
+            if (keep[it->first]) moved[position[it->first]].swap(it->second);
+        history.swap(moved);
+        unordered_map<size_t, uint64_t> owned;
+        for (auto it = owners.begin(); it != owners.end(); ++it)
+            if (keep[it->first]) owned[position[it->first]] = it->second;
+        owners.swap(owned);
+        live.build(kept, [this](size_t row) { return deletedAt[row] == NEVER; });
+        return rows - kept;
+    }
+};
+
+#endif // MVCC_H
@@ -0,0 +1,560 @@
+#ifndef PAGE_FILE_H
+#define PAGE_FILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BufferPool.h"
+#include "Schema.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// On-disk layout
+// --------------
+// The file is a sequence of DB_PAGE_SIZE pages. Every page starts with a
+// 16-byte header:
+//
+//   u32 checksum   CRC32 of the rest of the page
+//   u16 type       HEADER_PAGE / CATALOG_PAGE / DATA_PAGE / OVERFLOW_PAGE / BLOCK_PAGE
+//   u16 slotCount  records on a data page
+//   u32 next       next page of the same chain, 0 for none
+//   u16 freeStart  end of the slot directory (or of the payload)
+//   u16 freeEnd    start of the record area on a data page
+//
+// Page 0 holds the magic, format version, page count and the first
+// catalog page. The catalog lists each table's columns, index
+// definitions, row count and first data page. All integers are little
+// endian.
+//
+// Since version 2 a table's rows are a chain of block pages whose
+// payloads, joined, are a sequence of (varint length, block) pairs; a
+// block holds a run of rows as compressed columns (see Compression.h).
+// Since version 3 the catalog also gives each column's declared type
+// (u8 SqlType, varint VARCHAR length) after the column names. Since
+// version 4 page 0 also holds the checkpoint LSN: the last write-ahead log
+// record whose change the file contains (see WriteAheadLog.h).
+//
+// Version 1 files, which are still read, keep rows in slotted data
+// pages instead: a directory of (offset, length) slots grows from the
+// header while record bytes grow down from the end of the page. Records
+// too large for a page live in a chain of overflow pages and their slot
+// holds only the chain start and total length.
+const uint32_t DB_PAGE_SIZE = 4096;
+const uint32_t PAGE_HEADER_SIZE = 16;
+const uint32_t PAGE_FORMAT_VERSION = 4;
+const char PAGE_MAGIC[8] = {'M', 'D', 'B', 'P', 'A', 'G', 'E', '1'};
+
+enum PageType : uint16_t { HEADER_PAGE = 1, CATALOG_PAGE = 2, DATA_PAGE = 3, OVERFLOW_PAGE = 4, BLOCK_PAGE = 5 };
+
+const uint16_t OVERFLOW_SLOT = 0xFFFF;  // slot length marking an overflow record
+
+// CRC32 of data, or of the bytes crc was taken over followed by data.
+inline uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0) {
+    // Built once, thread-safely, by the first call.
+    static const vector<uint32_t> table = [] {
+        vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc ^= 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+inline void put16(unsigned char* p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+inline void put32(unsigned char* p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF; }
+inline uint16_t get16(const unsigned char* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+inline uint32_t get32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Growable byte buffer with the varint/string encodings used in records
+// and the catalog.
+class ByteWriter {
+public:
+    string bytes;
+
+    void putVarint(uint64_t v) {
+        while (v >= 0x80) { bytes.push_back((char)(v | 0x80)); v >>= 7; }
+        bytes.push_back((char)v);
+    }
+    void putString(const string& s) { putVarint(s.size()); bytes.append(s); }
+};
+
+// Cursor over encoded bytes. Reads past the end set ok to false instead
+// of running off the buffer, so a damaged record cannot crash the loader.
+class ByteReader {
+private:
+    const unsigned char* pos;
+    const unsigned char* end;
+
+public:
+    bool ok;
+    ByteReader(const unsigned char* data, size_t length) : pos(data), end(data + length), ok(true) {}
+
+    uint64_t getVarint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= end) { ok = false; return 0; }
+            unsigned char b = *pos++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+    void getString(string& out) {
+        uint64_t n = getVarint();
+        if (!ok || n > (uint64_t)(end - pos)) { ok = false; out.clear(); return; }
+        out.assign((const char*)pos, (size_t)n);
+        pos += n;
+    }
+    // The next n bytes, which are skipped; nullptr if fewer are left.
+    const unsigned char* take(size_t n) {
+        if (n > (size_t)(end - pos)) { ok = false; return nullptr; }
+        const unsigned char* p = pos;
+        pos += n;
+        return p;
+    }
+    size_t remaining() const { return (size_t)(end - pos); }
+    bool atEnd() const { return pos == end; }
+};
+
+// Read-only view of a whole file. Uses mmap (MapViewOfFile on Windows) so
+// opening costs nothing and only the pages that are read get faulted in.
+class MappedFile {
+private:
+    const unsigned char* data;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#else
+    int fd;
+#endif
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+public:
+#ifdef _WIN32
+    MappedFile() : data(nullptr), length(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+#else
+    MappedFile() : data(nullptr), length(0), fd(-1) {}
+#endif
+    ~MappedFile() { close(); }
+
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        GetFileSizeEx(file, &size);
+        length = (size_t)size.QuadPart;
+        if (length == 0) return true;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) { close(); return false; }
+        data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data) { close(); return false; }
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) { close(); return false; }
+        length = (size_t)st.st_size;
+        if (length == 0) return true;
+        void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) { close(); return false; }
+        data = (const unsigned char*)p;
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap((void*)data, length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        length = 0;
+    }
+
+    bool isOpen() const { return data != nullptr; }
+    const unsigned char* bytes() const { return data; }
+    size_t size() const { return length; }
+};
+
+// Renames from over to, replacing it, and makes the rename itself durable
+// (fsync of the directory; a write-through move on Windows), so that once
+// this returns a power loss cannot bring back the old file or lose both.
+inline bool replaceFile(const string& from, const string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (rename(from.c_str(), to.c_str()) != 0) return false;
+    size_t slash = to.rfind('/');
+    string directory = slash == string::npos ? "." : slash == 0 ? "/" : to.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Catalog entry for one table.
+struct TableEntry {
+    string name;
+    vector<string> columns;
+    vector<ColumnSpec> specs;                  // one per column
+    vector<pair<uint32_t, uint8_t> > indexes;  // (column position, IndexType)
+    uint32_t firstPage;
+    uint64_t rowCount;
+    TableEntry() : firstPage(0), rowCount(0) {}
+};
+
+// Frames of the pool a PageFileWriter writes through.
+const size_t WRITER_POOL_PAGES = 256;
+
+// Writes a page file front to back. Pages are numbered in allocation
+// order and handed to a small buffer pool as soon as they are complete;
+// the pool writes them at their final offset as it evicts them, so
+// memory use does not depend on the database size.
+class PageFileWriter {
+private:
+    BufferPool pool;
+    bool failed;
+    uint32_t pageCount;
+    vector<TableEntry> catalog;
+    string pending;        // block bytes not yet written
+    uint32_t pageNumber;   // block page being filled
+
+    static void stamp(unsigned char* p, uint16_t type, uint16_t slots, uint32_t next,
+                      uint16_t start, uint16_t end) {
+        put16(p + 4, type);
+        put16(p + 6, slots);
+        put32(p + 8, next);
+        put16(p + 12, start);
+        put16(p + 14, end);
+        put32(p, crc32(p + 4, DB_PAGE_SIZE - 4));
+    }
+
+    void writePage(uint32_t number, const unsigned char* p) {
+        PinnedPage frame(pool, number, false);
+        if (!frame) { failed = true; return; }
+        memcpy(frame.write(), p, DB_PAGE_SIZE);
+    }
+
+    // Writes the block page being filled with the n bytes at data.
+    void writeBlockPage(const char* data, size_t n, uint32_t next) {
+        unsigned char buf[DB_PAGE_SIZE];
+        memset(buf, 0, DB_PAGE_SIZE);
+        memcpy(buf + PAGE_HEADER_SIZE, data, n);
+        stamp(buf, BLOCK_PAGE, 0, next, (uint16_t)(PAGE_HEADER_SIZE + n), DB_PAGE_SIZE & 0xFFFF);
+        writePage(pageNumber, buf);
+        pageNumber = next;
+    }
+
+    // Writes bytes to a fresh chain of pages of the given type and returns
+    // the first page number.
+    uint32_t writeChain(uint16_t type, const string& bytes) {
+        const size_t capacity = DB_PAGE_SIZE - PAGE_HEADER_SIZE;
+        size_t chunks = bytes.empty() ? 1 : (bytes.size() + capacity - 1) / capacity;
+        uint32_t first = pageCount;
+        pageCount += (uint32_t)chunks;
+        unsigned char buf[DB_PAGE_SIZE];
+        for (size_t i = 0; i < chunks; i++) {
+            size_t n = min(capacity, bytes.size() - i * capacity);
+            memset(buf, 0, DB_PAGE_SIZE);
+            memcpy(buf + PAGE_HEADER_SIZE, bytes.data() + i * capacity, n);
+            uint32_t next = i + 1 < chunks ? first + (uint32_t)i + 1 : 0;
+            stamp(buf, type, 0, next, (uint16_t)(PAGE_HEADER_SIZE + n), DB_PAGE_SIZE & 0xFFFF);
+            writePage(first + (uint32_t)i, buf);
+        }
+        return first;
+    }
+
+public:
+    PageFileWriter()
+        : pool(DB_PAGE_SIZE, WRITER_POOL_PAGES), failed(false), pageCount(1), pageNumber(0) {}
+
+    bool open(const string& path) { return pool.open(path, true); }
+
+    void beginTable(const string& name, const vector<string>& columns, const vector<ColumnSpec>& specs,
+                    const vector<pair<uint32_t, uint8_t> >& indexes) {
+        TableEntry entry;
+        entry.name = name;
+        entry.columns = columns;
+        entry.specs = specs;
+        entry.indexes = indexes;
+        entry.firstPage = pageCount++;
+        catalog.push_back(entry);
+        pageNumber = entry.firstPage;
+        pending.clear();
+    }
+
+    // Adds a block of rows rows, encoded by encodeBlock().
+    void addBlock(const string& block, size_t rows) {
+        ByteWriter length;
+        length.putVarint(block.size());
+        pending += length.bytes;
+        pending += block;
+        catalog.back().rowCount += rows;
+        const size_t capacity = DB_PAGE_SIZE - PAGE_HEADER_SIZE;
+        size_t written = 0;
+        for (; pending.size() - written > capacity; written += capacity)
+            writeBlockPage(pending.data() + written, capacity, pageCount++);
+        pending.erase(0, written);
+    }
+
+    void endTable() { writeBlockPage(pending.data(), pending.size(), 0); }
+
+    // Writes the catalog and the header page and syncs the file; it is
+    // complete and on disk after this. checkpointLsn is the last log
+    // record the tables include.
+    bool finish(uint64_t checkpointLsn) {
+        ByteWriter blob;
+        blob.putVarint(catalog.size());
+        for (size_t t = 0; t < catalog.size(); t++) {
+            const TableEntry& e = catalog[t];
+            blob.putString(e.name);
+            blob.putVarint(e.columns.size());
+            for (size_t c = 0; c < e.columns.size(); c++) blob.putString(e.columns[c]);
+            for (size_t c = 0; c < e.columns.size(); c++) {
+                blob.bytes.push_back((char)e.specs[c].type);
+                blob.putVarint(e.specs[c].length);
+            }
+            blob.putVarint(e.indexes.size());
+            for (size_t i = 0; i < e.indexes.size(); i++) {
+                blob.putVarint(e.indexes[i].first);
+                blob.putVarint(e.indexes[i].second);
+            }
+            blob.putVarint(e.firstPage);
+            blob.putVarint(e.rowCount);
+        }
+        uint32_t catalogPage = writeChain(CATALOG_PAGE, blob.bytes);
+
+        unsigned char header[DB_PAGE_SIZE];
+        memset(header, 0, DB_PAGE_SIZE);
+        unsigned char* p = header + PAGE_HEADER_SIZE;
+        memcpy(p, PAGE_MAGIC, 8);
+        put32(p + 8, PAGE_FORMAT_VERSION);
+        put32(p + 12, DB_PAGE_SIZE);
+        put32(p + 16, pageCount);
+        put32(p + 20, catalogPage);
+        put32(p + 24, (uint32_t)checkpointLsn);
+        put32(p + 28, (uint32_t)(checkpointLsn >> 32));
+        stamp(header, HEADER_PAGE, 0, 0, PAGE_HEADER_SIZE + 32, DB_PAGE_SIZE & 0xFFFF);
+        writePage(0, header);
+        bool synced = pool.sync();
+        return pool.close() && synced && !failed;
+    }
+};
+
+// Reads a page file through a buffer pool. Only the header and catalog are
+// decoded on open; table pages are read (and checksummed) on demand, and
+// only as many stay in memory as the pool has frames.
+class PageFileReader {
+private:
+    mutable BufferPool pool;
+    uint32_t version;
+    uint32_t pageCount;
+    uint64_t lsn;
+    vector<TableEntry> catalog;
+
+    // Concatenated payloads of a catalog or overflow chain.
+    bool readChain(uint32_t first, uint16_t type, string& out) const {
+        out.clear();
+        for (uint32_t n = first, hops = 0; n != 0; hops++) {
+            PinnedPage frame = page(n);
+            const unsigned char* p = frame.data();
+            if (!p || get16(p + 4) != type || hops >= pageCount) return false;
+            uint16_t used = get16(p + 12);
+            if (used < PAGE_HEADER_SIZE || used > DB_PAGE_SIZE) return false;
+            out.append((const char*)p + PAGE_HEADER_SIZE, used - PAGE_HEADER_SIZE);
+            n = get32(p + 8);
+        }
+        return true;
+    }
+
+public:
+    explicit PageFileReader(size_t poolPages = BUFFER_POOL_PAGES) : pool(DB_PAGE_SIZE, poolPages), version(0), pageCount(0), lsn(0) {}
+
+    // True if the file starts with the page-format magic.
+    static bool isPageFile(const string& path) {
+        ifstream in(path.c_str(), ios::binary);
+        char buf[PAGE_HEADER_SIZE + 8];
+        if (!in.read(buf, sizeof(buf))) return false;
+        return memcmp(buf + PAGE_HEADER_SIZE, PAGE_MAGIC, 8) == 0;
+    }
+
+    bool open(const string& path, string& error) {
+        catalog.clear();
+        bool opened = pool.open(path, false, [](const unsigned char* p) {
+            return get32(p) == crc32(p + 4, DB_PAGE_SIZE - 4);
+        });
+        if (!opened || pool.fileSize() < DB_PAGE_SIZE) { error = "cannot open file"; return false; }
+        pageCount = 1;
+        PinnedPage frame = page(0);
+        const unsigned char* header = frame.data();
+        if (!header || memcmp(header + PAGE_HEADER_SIZE, PAGE_MAGIC, 8) != 0) { error = "bad header page"; return false; }
+        const unsigned char* p = header + PAGE_HEADER_SIZE;
+        version = get32(p + 8);
+        if (version < 1 || version > PAGE_FORMAT_VERSION || get32(p + 12) != DB_PAGE_SIZE) { error = "unsupported format version"; return false; }
+        pageCount = get32(p + 16);
+        lsn = version >= 4 ? get32(p + 24) | (uint64_t)get32(p + 28) << 32 : 0;
+        if ((uint64_t)pageCount * DB_PAGE_SIZE > pool.fileSize()) { error = "file is truncated"; return false; }
+
+        string blob;
+        if (!readChain(get32(p + 20), CATALOG_PAGE, blob)) { error = "catalog is corrupt"; return false; }
+        ByteReader in((const unsigned char*)blob.data(), blob.size());
+        uint64_t tables = in.getVarint();
+        for (uint64_t t = 0; t < tables && in.ok; t++) {
+            TableEntry e;
+            in.getString(e.name);
+            e.columns.resize((size_t)min<uint64_t>(in.getVarint(), blob.size()));
+            for (size_t c = 0; c < e.columns.size(); c++) in.getString(e.columns[c]);
+            e.specs.resize(e.columns.size());
+            for (size_t c = 0; c < e.specs.size() && version >= 3; c++) {
+                const unsigned char* type = in.take(1);
+                uint64_t length = in.getVarint();
+                if (!type || *type > (uint8_t)SqlType::TIMESTAMP || length > UINT32_MAX) { error = "catalog is corrupt"; return false; }
+                e.specs[c] = ColumnSpec((SqlType)*type, (uint32_t)length);
+            }
+            uint64_t indexCount = in.getVarint();
+            for (uint64_t i = 0; i < indexCount && in.ok; i++) {
+                uint32_t column = (uint32_t)in.getVarint();
+                e.indexes.push_back(make_pair(column, (uint8_t)in.getVarint()));
+            }
+            e.firstPage = (uint32_t)in.getVarint();
+            e.rowCount = in.getVarint();
+            catalog.push_back(e);
+        }
+        if (!in.ok) { error = "catalog is corrupt"; return false; }
+        return true;
+    }
+
+    void close() { pool.close(); catalog.clear(); pageCount = 0; lsn = 0; }
+
+    // The last write-ahead log record the file contains; 0 for files
+    // written before checkpoints were numbered.
+    uint64_t checkpointLsn() const { return lsn; }
+
+    const vector<TableEntry>& tables() const { return catalog; }
+    const BufferPool& bufferPool() const { return pool; }
+    // True if tables are stored as compressed blocks (read them with
+    // scanBlocks), false for the records of a version 1 file (scanTable).
+    bool storesBlocks() const { return version >= 2; }
+
+    // Page n, pinned while the result lives; empty if it is out of range or
+    // fails its checksum. The checksum is checked when the page is read
+    // from the file, not on every pin.
+    PinnedPage page(uint32_t n) const {
+        if (n >= pageCount) return PinnedPage();
+        return PinnedPage(pool, n);
+    }
+
+    // Calls visit(values) for every record of the table, in insertion order.
+    // Returns false (with error set) on the first corrupt page or record.
+    template <typename Visitor>
+    bool scanTable(const TableEntry& entry, Visitor visit, string& error) const {
+        vector<string> values(entry.columns.size());
+        string overflow;
+        for (uint32_t n = entry.firstPage, hops = 0; n != 0; hops++) {
+            PinnedPage frame = page(n);
+            const unsigned char* p = frame.data();
+            if (!p || get16(p + 4) != DATA_PAGE || hops >= pageCount) {
+                error = "page " + to_string(n) + " is corrupt";
+                return false;
+            }
+            uint16_t slots = get16(p + 6);
+            if (PAGE_HEADER_SIZE + 4u * slots > DB_PAGE_SIZE) { error = "page " + to_string(n) + " is corrupt"; return false; }
+            for (uint16_t s = 0; s < slots; s++) {
+                const unsigned char* slot = p + PAGE_HEADER_SIZE + 4 * s;
+                uint16_t offset = get16(slot), length = get16(slot + 2);
+                const unsigned char* body = p + offset;
+                size_t bodyLength = length;
+                if (length == OVERFLOW_SLOT) {
+                    if (offset + 8u > DB_PAGE_SIZE || !readChain(get32(body), OVERFLOW_PAGE, overflow)
+                        || overflow.size() < get32(body + 4)) {
+                        error = "overflow chain of page " + to_string(n) + " is corrupt";
+                        return false;
+                    }
+                    body = (const unsigned char*)overflow.data();
+                    bodyLength = get32(p + offset + 4);
+                } else if (offset + (size_t)length > DB_PAGE_SIZE) {
+                    error = "page " + to_string(n) + " is corrupt";
+                    return false;
+                }
+                ByteReader in(body, bodyLength);
+                for (size_t c = 0; c < values.size(); c++) in.getString(values[c]);
+                if (!in.ok || !in.atEnd()) { error = "record on page " + to_string(n) + " is corrupt"; return false; }
+                visit(values);
+            }
+            n = get32(p + 8);
+        }
+        return true;
+    }
+
+    // Calls visit(data, length) for every block of the table, in order,
+    // reading one page at a time. Returns false (with error set) on the
+    // first corrupt page or if the chain ends inside a block.
+    template <typename Visitor>
+    bool scanBlocks(const TableEntry& entry, Visitor visit, string& error) const {
+        string buffer;
+        size_t used = 0;
+        for (uint32_t n = entry.firstPage, hops = 0; n != 0; hops++) {
+            PinnedPage frame = page(n);
+            const unsigned char* p = frame.data();
+            uint16_t end = p ? get16(p + 12) : 0;
+            if (!p || get16(p + 4) != BLOCK_PAGE || hops >= pageCount || end < PAGE_HEADER_SIZE || end > DB_PAGE_SIZE) {
+                error = "page " + to_string(n) + " is corrupt";
+                return false;
+            }
+            buffer.append((const char*)p + PAGE_HEADER_SIZE, end - PAGE_HEADER_SIZE);
+            n = get32(p + 8);
+            // Hand out every block that is now complete.
+            while (true) {
+                ByteReader in((const unsigned char*)buffer.data() + used, buffer.size() - used);
+                uint64_t length = in.getVarint();
+                if (!in.ok || length > in.remaining()) break;
+                const unsigned char* block = in.take((size_t)length);
+                visit(block, (size_t)length);
+                used = buffer.size() - in.remaining();
+            }
+            if (used > buffer.size() / 2) {
+                buffer.erase(0, used);
+                used = 0;
+            }
+        }
+        if (used != buffer.size()) { error = "table ends inside a block"; return false; }
+        return true;
+    }
+};
+
+#endif // PAGE_FILE_H
@@ -0,0 +1,1005 @@
+#ifndef QUERY_EXECUTOR_H
+#define QUERY_EXECUTOR_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ColumnStore.h"
+#include "Index.h"
+#include "SqlParser.h"
+#include "WorkerPool.h"
+using namespace std;
+
+struct ResultSet {
+    vector<string> columns;
+    vector<vector<string> > rows;
+};
+
+// SQL comparison: numbers compare numerically (so 1 = 1.0), numbers sort
+// before text, text compares byte-wise.
+inline int compareSqlKeys(const IndexKey& a, const IndexKey& b) {
+    if (a.numeric != b.numeric) return a.numeric ? -1 : 1;
+    if (a.numeric) return a.number < b.number ? -1 : (a.number > b.number ? 1 : 0);
+    return a.text.compare(b.text);
+}
+
+inline bool compareHolds(int c, CompareOp op) {
+    switch (op) {
+        case CompareOp::EQ: return c == 0;
+        case CompareOp::NE: return c != 0;
+        case CompareOp::LT: return c < 0;
+        case CompareOp::LE: return c <= 0;
+        case CompareOp::GT: return c > 0;
+        default:            return c >= 0;
+    }
+}
+
+// The comparison that holds exactly when op does not (for a value that is
+// not NULL).
+inline CompareOp inverse(CompareOp op) {
+    switch (op) {
+        case CompareOp::EQ:      return CompareOp::NE;
+        case CompareOp::NE:      return CompareOp::EQ;
+        case CompareOp::LT:      return CompareOp::GE;
+        case CompareOp::LE:      return CompareOp::GT;
+        case CompareOp::GT:      return CompareOp::LE;
+        case CompareOp::GE:      return CompareOp::LT;
+        case CompareOp::IS_NULL: return CompareOp::NOT_NULL;
+        default:                 return CompareOp::IS_NULL;
+    }
+}
+
+// One step of a query plan as EXPLAIN shows it, reading the rows its
+// inputs produce. estimatedRows is negative where the planner has no
+// estimate. The counters are filled in under EXPLAIN ANALYZE only: rows
+// read and produced, bytes of column data read, and time spent (summed
+// over the worker threads for steps that run in parallel).
+struct PlanNode {
+    string label;
+    double estimatedRows;
+    uint64_t rowsIn, rowsOut, bytes;
+    double ms;
+    vector<PlanNode> inputs;
+    explicit PlanNode(const string& text = "", double estimate = -1)
+        : label(text), estimatedRows(estimate), rowsIn(0), rowsOut(0), bytes(0), ms(0) {}
+};
+
+// A plan as it is built and run. The caller sets root to the step that
+// reads the rows (a table scan, or a join) and matchEstimate to how many
+// rows the WHERE clause should keep; the executor stacks its own steps on
+// top. With analyze unset the query is only checked, not run.
+struct QueryPlan {
+    PlanNode root;
+    double matchEstimate;
+    bool analyze;
+    bool rootIsScan;     // the executor's scan counters belong to root
+    double totalMs;      // set by the caller
+    QueryPlan() : matchEstimate(-1), analyze(false), rootIsScan(true), totalMs(0) {}
+};
+
+inline double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Bytes one row of column takes in column storage.
+inline size_t cellBytes(const Column& column) {
+    return column.getType() == ColumnType::STRING ? sizeof(uint32_t) : sizeof(int64_t);
+}
+
+// The condition p as SQL text.
+inline string predicateText(const Predicate& p) {
+    static const char* const ops[] = {"=", "!=", "<", "<=", ">", ">=", "IS NULL", "IS NOT NULL"};
+    if (p.kind == Predicate::COMPARE) {
+        if (p.op == CompareOp::IS_NULL || p.op == CompareOp::NOT_NULL) return p.column + " " + ops[(int)p.op];
+        if (IndexKey(p.literal).numeric) return p.column + " " + ops[(int)p.op] + " " + p.literal;
+        string quoted = "'";
+        for (size_t i = 0; i < p.literal.size(); i++) {
+            if (p.literal[i] == '\'') quoted += '\'';
+            quoted += p.literal[i];
+        }
+        return p.column + " " + ops[(int)p.op] + " " + quoted + "'";
+    }
+    auto operand = [&p](const Predicate& q) {
+        bool group = q.kind == Predicate::OR || (p.kind == Predicate::NOT && q.kind != Predicate::COMPARE);
+        return group ? "(" + predicateText(q) + ")" : predicateText(q);
+    };
+    if (p.kind == Predicate::NOT) return "NOT " + operand(*p.left);
+    if (p.kind == Predicate::OR) return predicateText(*p.left) + " OR " + predicateText(*p.right);
+    return operand(*p.left) + " AND " + operand(*p.right);
+}
+
+// Appends one line per step of the plan under node to rows, each input
+// indented below the step that reads it.
+inline void formatPlan(const PlanNode& node, bool analyze, size_t depth, vector<vector<string> >& rows) {
+    string line = depth ? string(4 * depth - 4, ' ') + "->  " + node.label : node.label;
+    char buf[160];
+    if (node.estimatedRows >= 0) {
+        snprintf(buf, sizeof(buf), "  (estimated rows=%.0f)", node.estimatedRows);
+        line += buf;
+    }
+    if (analyze) {
+        snprintf(buf, sizeof(buf), "  (rows in=%llu, out=%llu, bytes=%llu, time=%.3f ms)", (unsigned long long)node.rowsIn,
+                 (unsigned long long)node.rowsOut, (unsigned long long)node.bytes, node.ms);
+        line += buf;
+    }
+    rows.push_back(vector<string>(1, line));
+    for (size_t i = 0; i < node.inputs.size(); i++) formatPlan(node.inputs[i], analyze, depth + 1, rows);
+}
+
+// Runs a SelectStatement against a ColumnStore one batch of rows at a
+// time. Within a batch, filters narrow a selection vector of row offsets
+// with tight per-column loops, and aggregates consume the selection
+// directly, so a query is a single pass over the columns it touches and
+// no row is turned back into strings unless it is part of the output.
+//
+// The scan is split into morsels that the WorkerPool threads pick up.
+// Each thread filters and aggregates into its own partial result, and
+// the partials are merged at the end in a way that gives exactly the
+// rows, and the row order, of a single-threaded run.
+//
+// When the planner has chosen an index, only the rows it found (in
+// ascending order) are read, batch by batch as for a full scan.
+class QueryExecutor {
+public:
+    static constexpr size_t BATCH_SIZE = 1024;
+
+private:
+    typedef uint16_t Offset;   // row position within a batch
+
+    struct Eq { template <class A, class B> bool operator()(A a, B b) const { return a == b; } };
+    struct Ne { template <class A, class B> bool operator()(A a, B b) const { return a != b; } };
+    struct Lt { template <class A, class B> bool operator()(A a, B b) const { return a < b; } };
+    struct Le { template <class A, class B> bool operator()(A a, B b) const { return a <= b; } };
+    struct Gt { template <class A, class B> bool operator()(A a, B b) const { return a > b; } };
+    struct Ge { template <class A, class B> bool operator()(A a, B b) const { return a >= b; } };
+
+    // Keeps the selected offsets whose value passes; branch-free so the
+    // loop does not stall on unpredictable predicates.
+    template <class Op, class T, class V>
+    static size_t filterValues(const T* data, const Offset* sel, size_t n, V value, Offset* out) {
+        Op op;
+        size_t k = 0;
+        for (size_t j = 0; j < n; j++) {
+            Offset i = sel[j];
+            out[k] = i;
+            k += op(data[i], value) ? 1 : 0;
+        }
+        return k;
+    }
+
+    template <class T, class V>
+    static size_t filterBy(CompareOp op, const T* data, const Offset* sel, size_t n, V value, Offset* out) {
+        switch (op) {
+            case CompareOp::EQ: return filterValues<Eq>(data, sel, n, value, out);
+            case CompareOp::NE: return filterValues<Ne>(data, sel, n, value, out);
+            case CompareOp::LT: return filterValues<Lt>(data, sel, n, value, out);
+            case CompareOp::LE: return filterValues<Le>(data, sel, n, value, out);
+            case CompareOp::GT: return filterValues<Gt>(data, sel, n, value, out);
+            default:            return filterValues<Ge>(data, sel, n, value, out);
+        }
+    }
+
+    // A predicate with columns resolved and the literal pre-converted to
+    // the column's type. String columns are tested through a pass/fail
+    // flag per dictionary code, computed once per query. NOT has been
+    // pushed down to the comparisons, so there are no NOT nodes.
+    struct BoundPredicate {
+        Predicate::Kind kind;
+        size_t column;
+        CompareOp op;
+        int constant;           // -1: evaluate; 0/1: same result for every row
+        bool integral;          // compare INT64 data against intValue
+        int64_t intValue;
+        double doubleValue;
+        vector<uint8_t> passCode;
+        unique_ptr<BoundPredicate> left, right;
+        BoundPredicate() : kind(Predicate::COMPARE), column(0), op(CompareOp::EQ), constant(-1),
+                           integral(false), intValue(0), doubleValue(0) {}
+    };
+
+    // Per-query view of a column for sorting and aggregation: numeric
+    // value and sort rank for every dictionary code of a STRING column.
+    struct ColumnView {
+        bool prepared;
+        vector<double> codeNumber;
+        vector<uint8_t> codeIsNumber;
+        vector<uint32_t> codeRank;
+        ColumnView() : prepared(false) {}
+    };
+
+    struct BoundAggregate {
+        AggregateKind kind;
+        int column;             // -1 for COUNT(*)
+    };
+
+    struct AggregateState {
+        uint64_t count;
+        int64_t intSum;
+        double sum;
+        bool hasBest;
+        int64_t bestInt;
+        double bestDouble;
+        uint32_t bestRank;
+        uint32_t bestCode;
+        AggregateState() : count(0), intSum(0), sum(0), hasBest(false), bestInt(0), bestDouble(0), bestRank(0), bestCode(0) {}
+    };
+
+    // What the scan measured under EXPLAIN ANALYZE; one per worker, then
+    // their sums.
+    struct Counters {
+        uint64_t visited, matched, filterBytes, aggregateBytes;
+        double passMs, filterMs, aggregateMs;
+        Counters() : visited(0), matched(0), filterBytes(0), aggregateBytes(0), passMs(0), filterMs(0), aggregateMs(0) {}
+        void add(const Counters& c) {
+            visited += c.visited;
+            matched += c.matched;
+            filterBytes += c.filterBytes;
+            aggregateBytes += c.aggregateBytes;
+            passMs += c.passMs;
+            filterMs += c.filterMs;
+            aggregateMs += c.aggregateMs;
+        }
+    };
+
+    // Time of the steps after the scan, for EXPLAIN ANALYZE.
+    struct Phases {
+        double mergeMs, sortMs, projectMs;
+        uint64_t projectBytes;
+        Phases() : mergeMs(0), sortMs(0), projectMs(0), projectBytes(0) {}
+    };
+
+    const ColumnStore& store;
+    const vector<string>& columnNames;
+    const vector<uint8_t>* visibleRows;   // rows the query may see; null for all
+    const vector<size_t>* candidates;     // rows an index found; null to scan all
+    vector<ColumnView> views;
+    string error;
+    QueryPlan* plan;                      // null unless under EXPLAIN
+    vector<Counters> counters;            // per worker, under EXPLAIN ANALYZE
+    Phases phases;
+    size_t aggregateRowBytes;             // column bytes an aggregate reads per row
+
+    // Exact name first; in a join result, whose columns are named
+    // table.column, a bare column name also works if only one table has it.
+    int findColumn(const string& name) const {
+        for (size_t i = 0; i < columnNames.size(); i++)
+            if (columnNames[i] == name) return (int)i;
+        int found = -1;
+        for (size_t i = 0; i < columnNames.size(); i++) {
+            const string& c = columnNames[i];
+            if (c.size() > name.size() && c[c.size() - name.size() - 1] == '.' &&
+                c.compare(c.size() - name.size(), name.size(), name) == 0) {
+                if (found != -1) return -1;
+                found = (int)i;
+            }
+        }
+        return found;
+    }
+
+    // Builds the ColumnView of a column. Done before the scan starts, as
+    // the worker threads only read views.
+    void prepareView(size_t column) {
+        ColumnView& v = views[column];
+        if (v.prepared) return;
+        v.prepared = true;
+        const Column& col = store.column(column);
+        if (col.getType() != ColumnType::STRING) return;
+        const vector<string>& dict = col.getDictionary();
+        vector<IndexKey> keys(dict.size());
+        vector<uint32_t> order(dict.size());
+        v.codeNumber.resize(dict.size());
+        v.codeIsNumber.resize(dict.size());
+        for (size_t c = 0; c < dict.size(); c++) {
+            keys[c] = IndexKey(dict[c]);
+            v.codeNumber[c] = keys[c].number;
+            v.codeIsNumber[c] = keys[c].numeric;
+            order[c] = (uint32_t)c;
+        }
+        // A VARCHAR column orders as text, even where its values are numbers.
+        bool text = col.getSpec().type == SqlType::VARCHAR;
+        auto compare = [&keys, text](uint32_t a, uint32_t b) {
+            return text ? keys[a].text.compare(keys[b].text) : compareSqlKeys(keys[a], keys[b]);
+        };
+        sort(order.begin(), order.end(), [&compare](uint32_t a, uint32_t b) { return compare(a, b) < 0; });
+        v.codeRank.resize(dict.size());
+        uint32_t rank = 0;
+        for (size_t i = 0; i < order.size(); i++) {
+            if (i > 0 && compare(order[i - 1], order[i]) != 0) rank++;
+            v.codeRank[order[i]] = rank;
+        }
+    }
+
+    // Binds p, or NOT p if negate is set. NOT is pushed down to the
+    // comparisons (NOT (a AND b) is NOT a OR NOT b, NOT x < 1 is x >= 1),
+    // which keeps SQL's three-valued logic: a comparison with NULL is
+    // false under NOT as well.
+    unique_ptr<BoundPredicate> bind(const Predicate& p, bool negate = false) {
+        if (p.kind == Predicate::NOT) return bind(*p.left, !negate);
+        unique_ptr<BoundPredicate> b(new BoundPredicate());
+        b->kind = p.kind;
+        if (p.kind != Predicate::COMPARE) {
+            if (negate) b->kind = p.kind == Predicate::AND ? Predicate::OR : Predicate::AND;
+            b->left = bind(*p.left, negate);
+            if (!b->left) return nullptr;
+            b->right = bind(*p.right, negate);
+            if (!b->right) return nullptr;
+            return b;
+        }
+        int column = findColumn(p.column);
+        if (column == -1) { error = "unknown column '" + p.column + "'"; return nullptr; }
+        b->column = column;
+        b->op = negate ? inverse(p.op) : p.op;
+        CompareOp op = b->op;
+        IndexKey literal(p.literal);
+        const Column& col = store.column(column);
+        const ColumnSpec& spec = col.getSpec();
+        if (op == CompareOp::IS_NULL || op == CompareOp::NOT_NULL) {
+            // Only typed columns hold NULLs.
+            if (!spec.typed()) b->constant = op == CompareOp::NOT_NULL ? 1 : 0;
+            return b;
+        }
+        if (spec.typed() && isNullText(spec, p.literal.data(), p.literal.size())) {
+            // A comparison with NULL is never true.
+            b->constant = 0;
+            return b;
+        }
+        if (spec.type == SqlType::BOOL || spec.type == SqlType::TIMESTAMP) {
+            double number;
+            if (!col.literalValue(p.literal, number)) {
+                error = "'" + p.literal + "' is not a valid " + typeName(spec) + " for column " + p.column;
+                return nullptr;
+            }
+            b->integral = true;
+            b->intValue = (int64_t)number;
+            b->doubleValue = number;
+            return b;
+        }
+        if ((spec.type == SqlType::INT || spec.type == SqlType::FLOAT) && !literal.numeric) {
+            error = "'" + p.literal + "' is not a valid " + typeName(spec) + " for column " + p.column;
+            return nullptr;
+        }
+        if (col.getType() == ColumnType::STRING) {
+            const vector<string>& dict = col.getDictionary();
+            b->passCode.resize(dict.size());
+            for (size_t c = 0; c < dict.size(); c++)
+                b->passCode[c] = spec.typed() ? compareHolds(dict[c].compare(p.literal), op)
+                                              : compareHolds(compareSqlKeys(IndexKey(dict[c]), literal), op);
+        } else if (!literal.numeric) {
+            // Numbers sort before text, so the outcome is the same for every row.
+            b->constant = compareHolds(-1, op) ? 1 : 0;
+        } else {
+            b->doubleValue = literal.number;
+            const double LIMIT = 9.2e18;
+            b->integral = col.getType() == ColumnType::INT64 && floor(literal.number) == literal.number
+                          && fabs(literal.number) < LIMIT;
+            b->intValue = b->integral ? (int64_t)literal.number : 0;
+        }
+        return b;
+    }
+
+    // Keeps the k offsets at out (in the batch at base) whose row is not
+    // NULL in col; returns how many are left.
+    static size_t dropNulls(const Column& col, size_t base, Offset* out, size_t k) {
+        size_t kept = 0;
+        for (size_t j = 0; j < k; j++) {
+            out[kept] = out[j];
+            kept += col.isNull(base + out[j]) ? 0 : 1;
+        }
+        return kept;
+    }
+
+    // The rows of the batch at base that the query may see: all n of them,
+    // or those set in the visibility mask, written to live. Sets count.
+    const Offset* visibleInBatch(size_t base, size_t n, const Offset* all, Offset* live, size_t& count) const {
+        count = n;
+        if (!visibleRows) return all;
+        const uint8_t* mask = visibleRows->data() + base;
+        count = 0;
+        for (size_t i = 0; i < n; i++) {
+            live[count] = (Offset)i;
+            count += mask[i];
+        }
+        return live;
+    }
+
+    // Calls f(base, offsets, n) for every batch of rows in [begin, end)
+    // that has rows the query reads: those the visibility mask allows
+    // and, if an index was chosen, that the index found.
+    template <typename F>
+    void forEachBatch(size_t begin, size_t end, F f) const {
+        Offset all[BATCH_SIZE], rows[BATCH_SIZE];
+        if (!candidates) {
+            for (size_t i = 0; i < BATCH_SIZE; i++) all[i] = (Offset)i;
+            for (size_t base = begin; base < end; base += BATCH_SIZE) {
+                size_t n;
+                const Offset* input = visibleInBatch(base, min(BATCH_SIZE, end - base), all, rows, n);
+                if (n) f(base, input, n);
+            }
+            return;
+        }
+        auto it = lower_bound(candidates->begin(), candidates->end(), begin);
+        while (it != candidates->end() && *it < end) {
+            size_t base = begin + (*it - begin) / BATCH_SIZE * BATCH_SIZE;
+            size_t stop = min(end, base + BATCH_SIZE), n = 0;
+            for (; it != candidates->end() && *it < stop; ++it)
+                if (!visibleRows || (*visibleRows)[*it]) rows[n++] = (Offset)(*it - base);
+            if (n) f(base, rows, n);
+        }
+    }
+
+    // Narrows sel (n offsets within the batch starting at base) to the rows
+    // that satisfy p; returns how many were written to out.
+    // Adds the column bytes it reads to bytes, if given.
+    size_t evaluate(const BoundPredicate& p, size_t base, const Offset* sel, size_t n, Offset* out, uint64_t* bytes = nullptr) const {
+        if (p.kind == Predicate::AND) {
+            Offset tmp[BATCH_SIZE];
+            size_t k = evaluate(*p.left, base, sel, n, tmp, bytes);
+            return evaluate(*p.right, base, tmp, k, out, bytes);
+        }
+        if (p.kind == Predicate::OR) {
+            Offset a[BATCH_SIZE], b[BATCH_SIZE];
+            size_t na = evaluate(*p.left, base, sel, n, a, bytes);
+            size_t nb = evaluate(*p.right, base, sel, n, b, bytes);
+            return set_union(a, a + na, b, b + nb, out) - out;
+        }
+        const Column& col = store.column(p.column);
+        if (p.constant != -1) {
+            if (p.constant == 0) return 0;
+            copy(sel, sel + n, out);
+            return col.hasNulls() ? dropNulls(col, base, out, n) : n;
+        }
+        if (p.op == CompareOp::IS_NULL || p.op == CompareOp::NOT_NULL) {
+            size_t k = 0;
+            bool wanted = p.op == CompareOp::IS_NULL;
+            for (size_t j = 0; j < n; j++) {
+                out[k] = sel[j];
+                k += col.isNull(base + sel[j]) == wanted ? 1 : 0;
+            }
+            return k;
+        }
+        if (bytes) *bytes += n * cellBytes(col);
+        size_t k;
+        if (col.getType() == ColumnType::STRING) {
+            const uint32_t* codes = col.codeData() + base;
+            const uint8_t* pass = p.passCode.data();
+            k = 0;
+            for (size_t j = 0; j < n; j++) {
+                Offset i = sel[j];
+                out[k] = i;
+                k += pass[codes[i]];
+            }
+        } else if (col.getType() == ColumnType::DOUBLE) {
+            k = filterBy(p.op, col.doubleData() + base, sel, n, p.doubleValue, out);
+        } else if (p.integral) {
+            k = filterBy(p.op, col.intData() + base, sel, n, p.intValue, out);
+        } else {
+            k = filterBy(p.op, col.intData() + base, sel, n, p.doubleValue, out);
+        }
+        // NULLs hold a placeholder value that may have passed.
+        return col.hasNulls() ? dropNulls(col, base, out, k) : k;
+    }
+
+    // Folds the selected rows of one batch into an aggregate.
+    void accumulate(AggregateState& s, const BoundAggregate& a, size_t base, const Offset* sel, size_t n) const {
+        Offset present[BATCH_SIZE];
+        if (a.column != -1 && store.column(a.column).hasNulls()) {
+            // Every aggregate but COUNT(*) leaves NULLs out.
+            copy(sel, sel + n, present);
+            n = dropNulls(store.column(a.column), base, present, n);
+            sel = present;
+        }
+        if (a.kind == AggregateKind::COUNT || a.column == -1) {
+            s.count += n;
+            return;
+        }
+        const Column& col = store.column(a.column);
+        bool summing = a.kind == AggregateKind::SUM || a.kind == AggregateKind::AVG;
+        bool wantMin = a.kind == AggregateKind::MIN;
+        if (col.getType() == ColumnType::INT64) {
+            const int64_t* data = col.intData() + base;
+            if (summing) {
+                int64_t sum = 0;
+                double dsum = 0;
+                for (size_t j = 0; j < n; j++) { sum += data[sel[j]]; dsum += (double)data[sel[j]]; }
+                s.intSum += sum;
+                s.sum += dsum;
+                s.count += n;
+                return;
+            }
+            for (size_t j = 0; j < n; j++) {
+                int64_t v = data[sel[j]];
+                if (!s.hasBest || (wantMin ? v < s.bestInt : v > s.bestInt)) { s.bestInt = v; s.hasBest = true; }
+            }
+        } else if (col.getType() == ColumnType::DOUBLE) {
+            const double* data = col.doubleData() + base;
+            if (summing) {
+                double sum = 0;
+                for (size_t j = 0; j < n; j++) sum += data[sel[j]];
+                s.sum += sum;
+                s.count += n;
+                return;
+            }
+            for (size_t j = 0; j < n; j++) {
+                double v = data[sel[j]];
+                if (!s.hasBest || (wantMin ? v < s.bestDouble : v > s.bestDouble)) { s.bestDouble = v; s.hasBest = true; }
+            }
+        } else {
+            const uint32_t* codes = col.codeData() + base;
+            const ColumnView& v = views[a.column];
+            if (summing) {
+                // Text that is not a number does not contribute to SUM/AVG.
+                for (size_t j = 0; j < n; j++) {
+                    uint32_t c = codes[sel[j]];
+                    if (v.codeIsNumber[c]) { s.sum += v.codeNumber[c]; s.count++; }
+                }
+                return;
+            }
+            for (size_t j = 0; j < n; j++) {
+                uint32_t c = codes[sel[j]];
+                uint32_t r = v.codeRank[c];
+                if (!s.hasBest || (wantMin ? r < s.bestRank : r > s.bestRank)) { s.bestRank = r; s.bestCode = c; s.hasBest = true; }
+            }
+        }
+    }
+
+    // Combines the partial state of one thread into another.
+    void merge(AggregateState& into, const AggregateState& from, const BoundAggregate& a) const {
+        into.count += from.count;
+        into.intSum += from.intSum;
+        into.sum += from.sum;
+        if (!from.hasBest) return;
+        bool wantMin = a.kind == AggregateKind::MIN;
+        bool better = !into.hasBest;
+        if (!better) {
+            ColumnType type = store.column(a.column).getType();
+            if (type == ColumnType::INT64) better = wantMin ? from.bestInt < into.bestInt : from.bestInt > into.bestInt;
+            else if (type == ColumnType::DOUBLE) better = wantMin ? from.bestDouble < into.bestDouble : from.bestDouble > into.bestDouble;
+            else better = wantMin ? from.bestRank < into.bestRank : from.bestRank > into.bestRank;
+        }
+        if (better) {
+            into.hasBest = true;
+            into.bestInt = from.bestInt;
+            into.bestDouble = from.bestDouble;
+            into.bestRank = from.bestRank;
+            into.bestCode = from.bestCode;
+        }
+    }
+
+    string finish(const AggregateState& s, const BoundAggregate& a) const {
+        if (a.kind == AggregateKind::COUNT) return to_string(s.count);
+        const Column& col = store.column(a.column);
+        if (a.kind == AggregateKind::SUM || a.kind == AggregateKind::AVG) {
+            if (s.count == 0) return "NULL";
+            if (a.kind == AggregateKind::AVG) return formatDouble(s.sum / (double)s.count);
+            if (col.getType() == ColumnType::INT64 && fabs(s.sum) < 9.2e18) return to_string(s.intSum);
+            return formatDouble(s.sum);
+        }
+        if (!s.hasBest) return "NULL";
+        if (col.getType() == ColumnType::INT64) return col.formatInt(s.bestInt);
+        if (col.getType() == ColumnType::DOUBLE) return formatDouble(s.bestDouble);
+        return col.getDictionary()[s.bestCode];
+    }
+
+    // Fixed-width key of a row's values in the given columns.
+    void groupKey(const vector<size_t>& columns, size_t row, string& key) const {
+        key.clear();
+        for (size_t i = 0; i < columns.size(); i++) {
+            const Column& col = store.column(columns[i]);
+            uint64_t bits;
+            if (col.getType() == ColumnType::INT64) bits = (uint64_t)col.intData()[row];
+            else if (col.getType() == ColumnType::DOUBLE) memcpy(&bits, &col.doubleData()[row], 8);
+            else bits = col.codeData()[row];
+            key.append((const char*)&bits, 8);
+            if (col.hasNulls()) key += col.isNull(row) ? '\1' : '\0';
+        }
+    }
+
+    // Orders two rows by one column the way SQL comparison would, NULLs
+    // first.
+    int compareRows(size_t column, size_t a, size_t b) const {
+        const Column& col = store.column(column);
+        if (col.hasNulls() && (col.isNull(a) || col.isNull(b))) return (int)col.isNull(b) - (int)col.isNull(a);
+        if (col.getType() == ColumnType::INT64) {
+            int64_t x = col.intData()[a], y = col.intData()[b];
+            return x < y ? -1 : (x > y ? 1 : 0);
+        }
+        if (col.getType() == ColumnType::DOUBLE) {
+            double x = col.doubleData()[a], y = col.doubleData()[b];
+            return x < y ? -1 : (x > y ? 1 : 0);
+        }
+        const vector<uint32_t>& rank = views[column].codeRank;
+        uint32_t x = rank[col.codeData()[a]], y = rank[col.codeData()[b]];
+        return x < y ? -1 : (x > y ? 1 : 0);
+    }
+
+    // What one worker thread has aggregated: its groups (in the order it
+    // met them), their keys and first rows, and reusable batch buffers.
+    struct Partial {
+        vector<vector<AggregateState> > groups;
+        vector<string> keys;
+        vector<size_t> firstRow;
+        unordered_map<string, size_t> ids;
+        vector<size_t> rowGroup;
+        vector<int> bucketStart, bucketFill;
+        vector<Offset> bucket;
+    };
+
+    // Filters and aggregates rows [begin, end) into p, adding what it
+    // measured to c if given.
+    void aggregateRange(Partial& p, const BoundPredicate* where, const vector<size_t>& groupColumns,
+                        const vector<BoundAggregate>& aggregates, size_t begin, size_t end, Counters* c) const {
+        Offset sel[BATCH_SIZE];
+        p.rowGroup.resize(BATCH_SIZE);
+        p.bucket.resize(BATCH_SIZE);
+        string key;
+        forEachBatch(begin, end, [&](size_t base, const Offset* input, size_t n) {
+            chrono::steady_clock::time_point start;
+            if (c) {
+                c->visited += n;
+                start = chrono::steady_clock::now();
+            }
+            size_t k = where ? evaluate(*where, base, input, n, sel, c ? &c->filterBytes : nullptr) : n;
+            const Offset* chosen = where ? sel : input;
+            if (c) {
+                if (where) c->filterMs += millisecondsSince(start);
+                c->matched += k;
+                c->aggregateBytes += k * aggregateRowBytes;
+                start = chrono::steady_clock::now();
+            }
+            if (groupColumns.empty()) {
+                for (size_t a = 0; a < aggregates.size(); a++) accumulate(p.groups[0][a], aggregates[a], base, chosen, k);
+                if (c) c->aggregateMs += millisecondsSince(start);
+                return;
+            }
+            // Hash each selected row to its group, bucket the offsets by
+            // group, then aggregate each bucket as a small selection.
+            vector<size_t> touched;
+            for (size_t j = 0; j < k; j++) {
+                groupKey(groupColumns, base + chosen[j], key);
+                auto it = p.ids.find(key);
+                if (it == p.ids.end()) {
+                    it = p.ids.emplace(key, p.groups.size()).first;
+                    p.groups.push_back(vector<AggregateState>(aggregates.size()));
+                    p.keys.push_back(key);
+                    p.firstRow.push_back(base + chosen[j]);
+                    p.bucketStart.push_back(-1);
+                    p.bucketFill.push_back(0);
+                }
+                p.rowGroup[j] = it->second;
+                if (p.bucketFill[it->second]++ == 0) touched.push_back(it->second);
+            }
+            int offset = 0;
+            for (size_t t = 0; t < touched.size(); t++) {
+                p.bucketStart[touched[t]] = offset;
+                offset += p.bucketFill[touched[t]];
+                p.bucketFill[touched[t]] = 0;
+            }
+            for (size_t j = 0; j < k; j++) {
+                size_t g = p.rowGroup[j];
+                p.bucket[p.bucketStart[g] + p.bucketFill[g]++] = chosen[j];
+            }
+            for (size_t t = 0; t < touched.size(); t++) {
+                size_t g = touched[t];
+                for (size_t a = 0; a < aggregates.size(); a++)
+                    accumulate(p.groups[g][a], aggregates[a], base, &p.bucket[p.bucketStart[g]], p.bucketFill[g]);
+                p.bucketFill[g] = 0;
+            }
+            if (c) c->aggregateMs += millisecondsSince(start);
+        });
+    }
+
+    // Puts a step on top of the plan below it and returns it.
+    static PlanNode& addStep(PlanNode& top, const string& label, double estimate = -1) {
+        PlanNode below = move(top);
+        top = PlanNode(label, estimate);
+        top.inputs.push_back(move(below));
+        return top;
+    }
+
+    static string joinNames(const vector<string>& names) {
+        string text;
+        for (size_t i = 0; i < names.size(); i++) text += (i ? ", " : "") + names[i];
+        return text;
+    }
+
+    // Stacks the steps the executor takes for s on the plan the caller
+    // started, with what they measured if the query ran.
+    void buildPlan(const SelectStatement& s, const string& aggregateLabel, uint64_t groups, const ResultSet& result) {
+        Counters sum;
+        for (size_t w = 0; w < counters.size(); w++) sum.add(counters[w]);
+        PlanNode& top = plan->root;
+        if (plan->rootIsScan) {
+            top.rowsIn = top.rowsOut = sum.visited;
+            top.ms += max(0.0, sum.passMs - sum.filterMs - sum.aggregateMs);
+        }
+        uint64_t rows = sum.visited;
+        if (s.where) {
+            PlanNode& step = addStep(top, "Filter: " + predicateText(*s.where), plan->matchEstimate);
+            step.rowsIn = rows;
+            step.rowsOut = rows = sum.matched;
+            step.bytes = sum.filterBytes;
+            step.ms = sum.filterMs;
+        }
+        if (!aggregateLabel.empty()) {
+            PlanNode& step = addStep(top, aggregateLabel);
+            step.rowsIn = rows;
+            step.rowsOut = rows = groups;
+            step.bytes = sum.aggregateBytes;
+            step.ms = sum.aggregateMs + phases.mergeMs;
+        }
+        if (!s.orderBy.empty()) {
+            vector<string> keys;
+            for (size_t i = 0; i < s.orderBy.size(); i++) keys.push_back(s.orderBy[i].key + (s.orderBy[i].descending ? " DESC" : ""));
+            PlanNode& step = addStep(top, "Sort by: " + joinNames(keys));
+            step.rowsIn = step.rowsOut = rows;
+            step.ms = phases.sortMs;
+        }
+        if (s.limit >= 0) {
+            PlanNode& step = addStep(top, "Limit: " + to_string(s.limit));
+            step.rowsIn = rows;
+            step.rowsOut = rows = min(rows, (uint64_t)s.limit);
+        }
+        if (aggregateLabel.empty()) {
+            PlanNode& step = addStep(top, "Project: " + joinNames(result.columns));
+            step.rowsIn = step.rowsOut = rows;
+            step.bytes = phases.projectBytes;
+            step.ms = phases.projectMs;
+        }
+    }
+
+    bool runAggregate(const SelectStatement& s, const BoundPredicate* where, ResultSet& result) {
+        vector<size_t> groupColumns;
+        for (size_t i = 0; i < s.groupBy.size(); i++) {
+            int c = findColumn(s.groupBy[i]);
+            if (c == -1) { error = "unknown column '" + s.groupBy[i] + "'"; return false; }
+            groupColumns.push_back(c);
+        }
+        vector<BoundAggregate> aggregates;
+        vector<int> itemGroupColumn;   // for plain items: position in groupColumns
+        for (size_t i = 0; i < s.items.size(); i++) {
+            const SelectItem& item = s.items[i];
+            BoundAggregate a = {item.aggregate, -1};
+            itemGroupColumn.push_back(-1);
+            if (item.column != "*") {
+                a.column = findColumn(item.column);
+                if (a.column == -1) { error = "unknown column '" + item.column + "'"; return false; }
+                prepareView(a.column);
+            }
+            if (item.aggregate == AggregateKind::NONE) {
+                for (size_t g = 0; g < groupColumns.size(); g++)
+                    if ((int)groupColumns[g] == a.column) itemGroupColumn.back() = (int)g;
+                if (itemGroupColumn.back() == -1) {
+                    error = "column '" + item.column + "' must appear in GROUP BY or inside an aggregate";
+                    return false;
+                }
+            }
+            aggregates.push_back(a);
+            result.columns.push_back(item.label);
+        }
+        // ORDER BY refers to output columns here.
+        vector<pair<size_t, bool> > keys;
+        for (size_t i = 0; i < s.orderBy.size(); i++) {
+            size_t c = 0;
+            while (c < result.columns.size() && result.columns[c] != s.orderBy[i].key) c++;
+            if (c == result.columns.size()) { error = "ORDER BY '" + s.orderBy[i].key + "' is not in the select list"; return false; }
+            keys.push_back(make_pair(c, s.orderBy[i].descending));
+        }
+        string label = groupColumns.empty() ? "Aggregate: " + joinNames(result.columns) : "Group by: " + joinNames(s.groupBy);
+        if (plan && !plan->analyze) {
+            buildPlan(s, label, 0, result);
+            return true;
+        }
+
+        WorkerPool& pool = WorkerPool::getInstance();
+        vector<Partial> partials(pool.size());
+        if (groupColumns.empty())
+            for (size_t w = 0; w < partials.size(); w++) partials[w].groups.push_back(vector<AggregateState>(aggregates.size()));
+        if (plan) {
+            counters.assign(pool.size(), Counters());
+            aggregateRowBytes = 0;
+            for (size_t g = 0; g < groupColumns.size(); g++) aggregateRowBytes += cellBytes(store.column(groupColumns[g]));
+            for (size_t a = 0; a < aggregates.size(); a++)
+                if (aggregates[a].column != -1 && aggregates[a].kind != AggregateKind::NONE)
+                    aggregateRowBytes += cellBytes(store.column(aggregates[a].column));
+        }
+        size_t rows = store.rowCount();
+        pool.run(morselCount(rows), [&](size_t morsel, size_t worker) {
+            size_t begin = morsel * MORSEL_ROWS;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            Counters* c = plan ? &counters[worker] : nullptr;
+            aggregateRange(partials[worker], where, groupColumns, aggregates, begin, min(rows, begin + MORSEL_ROWS), c);
+            if (c) c->passMs += millisecondsSince(start);
+        });
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        // Merge the partials. Groups are then put in order of their first
+        // row, which is the order a single thread would have met them.
+        Partial& total = partials[0];
+        for (size_t w = 1; w < partials.size(); w++) {
+            Partial& p = partials[w];
+            for (size_t g = 0; g < p.groups.size(); g++) {
+                size_t target = 0;
+                if (!groupColumns.empty()) {
+                    auto it = total.ids.find(p.keys[g]);
+                    if (it == total.ids.end()) {
+                        it = total.ids.emplace(p.keys[g], total.groups.size()).first;
+                        total.groups.push_back(vector<AggregateState>(aggregates.size()));
+                        total.firstRow.push_back(p.firstRow[g]);
+                    }
+                    target = it->second;
+                    total.firstRow[target] = min(total.firstRow[target], p.firstRow[g]);
+                }
+                for (size_t a = 0; a < aggregates.size(); a++) merge(total.groups[target][a], p.groups[g][a], aggregates[a]);
+            }
+        }
+        vector<size_t> order(total.groups.size());
+        for (size_t g = 0; g < order.size(); g++) order[g] = g;
+        if (!groupColumns.empty())
+            sort(order.begin(), order.end(), [&total](size_t x, size_t y) { return total.firstRow[x] < total.firstRow[y]; });
+
+        for (size_t o = 0; o < order.size(); o++) {
+            size_t g = order[o];
+            vector<string> row;
+            for (size_t i = 0; i < aggregates.size(); i++) {
+                if (itemGroupColumn[i] != -1) row.push_back(store.column(aggregates[i].column).get(total.firstRow[g]));
+                else row.push_back(finish(total.groups[g][i], aggregates[i]));
+            }
+            result.rows.push_back(row);
+        }
+        phases.mergeMs = millisecondsSince(start);
+
+        start = chrono::steady_clock::now();
+        if (!keys.empty()) {
+            stable_sort(result.rows.begin(), result.rows.end(), [&keys](const vector<string>& x, const vector<string>& y) {
+                for (size_t i = 0; i < keys.size(); i++) {
+                    int c = compareSqlKeys(IndexKey(x[keys[i].first]), IndexKey(y[keys[i].first]));
+                    if (c != 0) return keys[i].second ? c > 0 : c < 0;
+                }
+                return false;
+            });
+        }
+        phases.sortMs = millisecondsSince(start);
+        uint64_t groups = result.rows.size();
+        if (s.limit >= 0 && (size_t)s.limit < result.rows.size()) result.rows.resize((size_t)s.limit);
+        if (plan) buildPlan(s, label, groups, result);
+        return true;
+    }
+
+    bool runProjection(const SelectStatement& s, const BoundPredicate* where, ResultSet& result) {
+        vector<size_t> output;
+        if (s.selectAll) {
+            for (size_t c = 0; c < columnNames.size(); c++) { output.push_back(c); result.columns.push_back(columnNames[c]); }
+        } else {
+            for (size_t i = 0; i < s.items.size(); i++) {
+                int c = findColumn(s.items[i].column);
+                if (c == -1) { error = "unknown column '" + s.items[i].column + "'"; return false; }
+                output.push_back(c);
+                result.columns.push_back(s.items[i].label);
+            }
+        }
+        // ORDER BY may name a table column or an output alias.
+        vector<pair<size_t, bool> > keys;
+        for (size_t i = 0; i < s.orderBy.size(); i++) {
+            int c = -1;
+            for (size_t j = 0; j < result.columns.size() && c == -1; j++)
+                if (result.columns[j] == s.orderBy[i].key) c = (int)output[j];
+            if (c == -1) c = findColumn(s.orderBy[i].key);
+            if (c == -1) { error = "unknown ORDER BY column '" + s.orderBy[i].key + "'"; return false; }
+            keys.push_back(make_pair((size_t)c, s.orderBy[i].descending));
+        }
+
+        for (size_t i = 0; i < keys.size(); i++) prepareView(keys[i].first);
+        if (plan && !plan->analyze) {
+            buildPlan(s, "", 0, result);
+            return true;
+        }
+        if (plan) counters.assign(WorkerPool::getInstance().size(), Counters());
+
+        size_t limit = s.limit < 0 ? (size_t)-1 : (size_t)s.limit;
+        size_t rows = store.rowCount();
+        vector<vector<size_t> > found(morselCount(rows));
+        // Without ORDER BY the first LIMIT matches are the answer. Morsels
+        // are handed out in order, so once that many rows have been found
+        // every later morsel can be skipped.
+        atomic<size_t> foundCount(0);
+        WorkerPool::getInstance().run(found.size(), [&](size_t morsel, size_t worker) {
+            if (keys.empty() && foundCount.load() >= limit) return;
+            chrono::steady_clock::time_point passStart = chrono::steady_clock::now();
+            Counters* c = plan ? &counters[worker] : nullptr;
+            Offset sel[BATCH_SIZE];
+            size_t end = min(rows, (morsel + 1) * MORSEL_ROWS);
+            forEachBatch(morsel * MORSEL_ROWS, end, [&](size_t base, const Offset* input, size_t n) {
+                chrono::steady_clock::time_point start;
+                if (c) start = chrono::steady_clock::now();
+                size_t k = where ? evaluate(*where, base, input, n, sel, c ? &c->filterBytes : nullptr) : n;
+                const Offset* chosen = where ? sel : input;
+                if (c) {
+                    if (where) c->filterMs += millisecondsSince(start);
+                    c->visited += n;
+                    c->matched += k;
+                }
+                for (size_t j = 0; j < k; j++) found[morsel].push_back(base + chosen[j]);
+            });
+            foundCount += found[morsel].size();
+            if (c) c->passMs += millisecondsSince(passStart);
+        });
+        vector<size_t> matches;
+        for (size_t m = 0; m < found.size(); m++) {
+            matches.insert(matches.end(), found[m].begin(), found[m].end());
+            vector<size_t>().swap(found[m]);
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (!keys.empty()) {
+            auto before = [this, &keys](size_t a, size_t b) {
+                for (size_t i = 0; i < keys.size(); i++) {
+                    int c = compareRows(keys[i].first, a, b);
+                    if (c != 0) return keys[i].second ? c > 0 : c < 0;
+                }
+                return a < b;
+            };
+            if (limit < matches.size()) partial_sort(matches.begin(), matches.begin() + limit, matches.end(), before);
+            else sort(matches.begin(), matches.end(), before);
+        }
+        if (limit < matches.size()) matches.resize(limit);
+        phases.sortMs = millisecondsSince(start);
+
+        start = chrono::steady_clock::now();
+        result.rows.reserve(matches.size());
+        for (size_t i = 0; i < matches.size(); i++) {
+            vector<string> row;
+            row.reserve(output.size());
+            for (size_t c = 0; c < output.size(); c++) row.push_back(store.column(output[c]).get(matches[i]));
+            result.rows.push_back(row);
+        }
+        if (plan) {
+            phases.projectMs = millisecondsSince(start);
+            for (size_t c = 0; c < output.size(); c++) phases.projectBytes += matches.size() * cellBytes(store.column(output[c]));
+            buildPlan(s, "", 0, result);
+        }
+        return true;
+    }
+
+public:
+    // visible, if given, has one entry per row of columnStore; rows whose
+    // entry is 0 are skipped (they belong to no snapshot of the query).
+    // candidateRows, if given, are the only rows read, sorted and without
+    // duplicates; they must include every row the WHERE clause keeps.
+    QueryExecutor(const ColumnStore& columnStore, const vector<string>& names, const vector<uint8_t>* visible = nullptr,
+                  const vector<size_t>* candidateRows = nullptr)
+        : store(columnStore), columnNames(names), visibleRows(visible), candidates(candidateRows), views(names.size()),
+          plan(nullptr), aggregateRowBytes(0) {}
+
+    // With a plan given, the executor's steps are added to it; unless
+    // plan->analyze is set the query is checked but not run.
+    bool execute(const SelectStatement& s, ResultSet& result, string& err, QueryPlan* queryPlan = nullptr) {
+        error.clear();
+        result = ResultSet();
+        plan = queryPlan;
+        counters.clear();
+        phases = Phases();
+        unique_ptr<BoundPredicate> where;
+        if (s.where) where = bind(*s.where);
+        bool ok = !s.where || where;
+        bool aggregate = !s.groupBy.empty();
+        for (size_t i = 0; i < s.items.size(); i++)
+            if (s.items[i].aggregate != AggregateKind::NONE) aggregate = true;
+        if (ok && aggregate && s.selectAll) {
+            error = "SELECT * cannot be combined with GROUP BY";
+            ok = false;
+        }
+        if (ok) ok = aggregate ? runAggregate(s, where.get(), result) : runProjection(s, where.get(), result);
+        plan = nullptr;
+        err = error;
+        return ok;
+    }
+};
+
+#endif // QUERY_EXECUTOR_H
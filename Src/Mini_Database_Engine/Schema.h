@@ -0,0 +1,212 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Declared type of a column. Columns created with only a name are ANY:
+// they take any text and are stored in the narrowest physical type that
+// holds every value so far (see Column). A typed column takes only values
+// of its type, or NULL, and is stored in a fixed physical type:
+//
+//   INT        64-bit integers
+//   FLOAT      doubles
+//   BOOL       0 or 1, shown as true / false
+//   VARCHAR(n) dictionary-encoded text of at most n bytes (no limit
+//              without n, or as TEXT)
+//   TIMESTAMP  seconds since 1970-01-01 00:00:00 UTC, shown as
+//              YYYY-MM-DD HH:MM:SS
+enum class SqlType : uint8_t { ANY, INT, FLOAT, BOOL, VARCHAR, TIMESTAMP };
+
+struct ColumnSpec {
+    SqlType type;
+    uint32_t length;   // VARCHAR: the most bytes a value may have; 0 for no limit
+
+    ColumnSpec(SqlType t = SqlType::ANY, uint32_t n = 0) : type(t), length(n) {}
+    bool typed() const { return type != SqlType::ANY; }
+};
+
+// The type as it is written in a column definition; empty for ANY.
+inline string typeName(const ColumnSpec& spec) {
+    switch (spec.type) {
+        case SqlType::INT:       return "INT";
+        case SqlType::FLOAT:     return "FLOAT";
+        case SqlType::BOOL:      return "BOOL";
+        case SqlType::VARCHAR:   return spec.length ? "VARCHAR(" + to_string(spec.length) + ")" : "VARCHAR";
+        case SqlType::TIMESTAMP: return "TIMESTAMP";
+        default:                 return "";
+    }
+}
+
+inline bool equalsIgnoreCase(const char* text, size_t length, const char* word) {
+    size_t n = strlen(word);
+    if (length != n) return false;
+    for (size_t i = 0; i < n; i++)
+        if (toupper((unsigned char)text[i]) != word[i]) return false;
+    return true;
+}
+
+// Reads a type name such as INT or varchar(20).
+inline bool parseTypeName(const string& text, ColumnSpec& spec) {
+    string word;
+    size_t i = 0;
+    while (i < text.size() && isalpha((unsigned char)text[i])) word += (char)toupper((unsigned char)text[i++]);
+    string rest = text.substr(i);
+    if (word == "VARCHAR" || word == "TEXT") {
+        spec = ColumnSpec(SqlType::VARCHAR);
+        if (rest.empty()) return true;
+        if (word != "VARCHAR" || rest.size() < 3 || rest[0] != '(' || rest[rest.size() - 1] != ')') return false;
+        string digits = rest.substr(1, rest.size() - 2);
+        if (digits.empty() || digits.size() > 9 || digits.find_first_not_of("0123456789") != string::npos) return false;
+        spec.length = (uint32_t)strtoul(digits.c_str(), nullptr, 10);
+        return spec.length != 0;
+    }
+    if (!rest.empty()) return false;
+    if (word == "INT" || word == "INTEGER" || word == "BIGINT") spec = ColumnSpec(SqlType::INT);
+    else if (word == "FLOAT" || word == "DOUBLE" || word == "REAL") spec = ColumnSpec(SqlType::FLOAT);
+    else if (word == "BOOL" || word == "BOOLEAN") spec = ColumnSpec(SqlType::BOOL);
+    else if (word == "TIMESTAMP" || word == "DATETIME") spec = ColumnSpec(SqlType::TIMESTAMP);
+    else return false;
+    return true;
+}
+
+// Splits a column definition, "name TYPE", into its name and type. When
+// the last word is not a type the whole text is the name of an ANY
+// column, so plain names (even with spaces) keep working.
+inline void parseColumnDefinition(const string& text, string& name, ColumnSpec& spec) {
+    size_t end = text.find_last_not_of(" \t");
+    size_t space = end == string::npos ? string::npos : text.find_last_of(" \t", end);
+    spec = ColumnSpec();
+    name = text;
+    if (space == string::npos) return;
+    ColumnSpec parsed;
+    if (!parseTypeName(text.substr(space + 1, end - space), parsed)) return;
+    size_t nameEnd = text.find_last_not_of(" \t", space);
+    if (nameEnd == string::npos) return;
+    name = text.substr(0, nameEnd + 1);
+    spec = parsed;
+}
+
+inline string columnDefinition(const string& name, const ColumnSpec& spec) {
+    return spec.typed() ? name + " " + typeName(spec) : name;
+}
+
+// Input that means NULL in a typed column: NULL in any case, or for
+// types other than VARCHAR also nothing at all.
+inline bool isNullText(const ColumnSpec& spec, const char* text, size_t length) {
+    return equalsIgnoreCase(text, length, "NULL") || (length == 0 && spec.type != SqlType::VARCHAR);
+}
+
+inline bool parseBool(const char* text, size_t length, bool& out) {
+    if (equalsIgnoreCase(text, length, "TRUE") || equalsIgnoreCase(text, length, "T") ||
+        equalsIgnoreCase(text, length, "YES") || (length == 1 && text[0] == '1')) {
+        out = true;
+        return true;
+    }
+    if (equalsIgnoreCase(text, length, "FALSE") || equalsIgnoreCase(text, length, "F") ||
+        equalsIgnoreCase(text, length, "NO") || (length == 1 && text[0] == '0')) {
+        out = false;
+        return true;
+    }
+    return false;
+}
+
+// Days from 1970-01-01 to a date of the proleptic Gregorian calendar.
+inline int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+inline void civilFromDays(int64_t z, int64_t& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = (int64_t)yoe + era * 400 + (m <= 2);
+}
+
+// Reads YYYY-MM-DD, optionally followed by a space or T and HH:MM or
+// HH:MM:SS, as UTC. Years run from 0001 to 9999, so the text of two
+// timestamps orders the same way as their times.
+inline bool parseTimestamp(const char* text, size_t length, int64_t& out) {
+    auto number = [text](size_t at, size_t digits, unsigned& value) {
+        value = 0;
+        for (size_t i = at; i < at + digits; i++) {
+            if (!isdigit((unsigned char)text[i])) return false;
+            value = value * 10 + (unsigned)(text[i] - '0');
+        }
+        return true;
+    };
+    unsigned year, month, day, hour = 0, minute = 0, second = 0;
+    if (length < 10 || !number(0, 4, year) || text[4] != '-' || !number(5, 2, month) || text[7] != '-' || !number(8, 2, day))
+        return false;
+    if (length != 10) {
+        if ((text[10] != ' ' && text[10] != 'T') || (length != 16 && length != 19)) return false;
+        if (!number(11, 2, hour) || text[13] != ':' || !number(14, 2, minute)) return false;
+        if (length == 19 && (text[16] != ':' || !number(17, 2, second))) return false;
+    }
+    static const unsigned monthDays[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (year == 0 || month < 1 || month > 12 || day < 1 || day > monthDays[month - 1] || (month == 2 && day == 29 && !leap))
+        return false;
+    if (hour > 23 || minute > 59 || second > 59) return false;
+    out = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+inline string formatTimestamp(int64_t seconds) {
+    int64_t days = seconds >= 0 ? seconds / 86400 : -((-seconds + 86399) / 86400);
+    int64_t rest = seconds - days * 86400;
+    int64_t year;
+    unsigned month, day;
+    civilFromDays(days, year, month, day);
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%04lld-%02u-%02u %02u:%02u:%02u", (long long)year, month, day,
+             (unsigned)(rest / 3600), (unsigned)(rest / 60 % 60), (unsigned)(rest % 60));
+    return buf;
+}
+
+// Reads an integer with an optional sign; false if it does not fit.
+inline bool parseInt(const char* text, size_t length, int64_t& out) {
+    size_t i = length && (text[0] == '-' || text[0] == '+') ? 1 : 0;
+    if (i == length || length > 24) return false;
+    uint64_t value = 0;
+    for (size_t j = i; j < length; j++) {
+        unsigned digit = (unsigned char)text[j] - '0';
+        if (digit > 9 || value > (UINT64_MAX - digit) / 10) return false;
+        value = value * 10 + digit;
+    }
+    bool negative = text[0] == '-';
+    if (value > (uint64_t)INT64_MAX + (negative ? 1 : 0)) return false;
+    out = negative ? (int64_t)(0 - value) : (int64_t)value;
+    return true;
+}
+
+inline bool parseFloat(const char* text, size_t length, double& out) {
+    if (length == 0 || length > 64) return false;
+    char buf[65];
+    memcpy(buf, text, length);
+    buf[length] = '\0';
+    char* end = nullptr;
+    out = strtod(buf, &end);
+    if (*end != '\0' || !isfinite(out)) return false;
+    if (out == 0) out = 0;   // no negative zero
+    return true;
+}
+
+#endif // SCHEMA_H
@@ -0,0 +1,430 @@
+#ifndef SQL_PARSER_H
+#define SQL_PARSER_H
+
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Index.h"
+using namespace std;
+
+// Supported statements:
+//
+//   SELECT * | item [, item ...] FROM table [[INNER] JOIN table ON column = column]
+//       [WHERE condition] [GROUP BY column [, ...]]
+//       [ORDER BY key [ASC|DESC] [, ...]] [LIMIT n]
+//   CREATE INDEX [name] ON table (column) [USING HASH|BTREE]
+//   EXPLAIN [ANALYZE] SELECT ...
+//   ANALYZE table
+//
+// An item is a column or COUNT(*), COUNT/SUM/AVG/MIN/MAX(column), with an
+// optional AS alias. A condition combines column-versus-literal
+// comparisons (=, !=, <>, <, <=, >, >=) and column IS [NOT] NULL tests
+// with AND, OR, NOT and parentheses. In a join, columns are named
+// table.column; the table part may be left out when the name is unique.
+// Names containing spaces can be written in double quotes, text literals
+// in single quotes; TRUE and FALSE are the texts true and false. Keywords
+// are case-insensitive.
+//
+// EXPLAIN shows the plan a SELECT would run with; EXPLAIN ANALYZE runs it
+// and adds what each step did. ANALYZE refreshes the statistics the
+// planner keeps for a table and shows them.
+
+enum class CompareOp { EQ, NE, LT, LE, GT, GE, IS_NULL, NOT_NULL };
+
+struct Predicate {
+    enum Kind { COMPARE, AND, OR, NOT } kind;
+    string column;      // COMPARE
+    CompareOp op;       // COMPARE
+    string literal;     // COMPARE; empty for IS_NULL / NOT_NULL
+    unique_ptr<Predicate> left, right;   // AND/OR use both, NOT only left
+    Predicate(Kind k) : kind(k), op(CompareOp::EQ) {}
+};
+
+enum class AggregateKind { NONE, COUNT, SUM, AVG, MIN, MAX };
+
+struct SelectItem {
+    AggregateKind aggregate;
+    string column;   // "*" only for COUNT(*)
+    string label;    // output column name: alias, column, or e.g. "SUM(age)"
+};
+
+struct OrderItem {
+    string key;      // column, alias or aggregate label
+    bool descending;
+};
+
+struct SelectStatement {
+    bool selectAll = false;
+    vector<SelectItem> items;
+    string table;
+    string joinTable;                    // empty without a JOIN
+    string joinLeft, joinRight;          // the two ON columns, as written
+    unique_ptr<Predicate> where;
+    vector<string> groupBy;
+    vector<OrderItem> orderBy;
+    long long limit = -1;
+};
+
+struct CreateIndexStatement {
+    string table;
+    string column;
+    IndexType type = IndexType::BTREE;
+};
+
+struct SqlStatement {
+    enum Kind { SELECT, CREATE_INDEX, ANALYZE } kind = SELECT;
+    SelectStatement select;
+    bool explain = false;    // SELECT only
+    bool analyze = false;    // EXPLAIN ANALYZE
+    CreateIndexStatement createIndex;
+    string analyzeTable;
+};
+
+inline const char* aggregateName(AggregateKind kind) {
+    switch (kind) {
+        case AggregateKind::COUNT: return "COUNT";
+        case AggregateKind::SUM:   return "SUM";
+        case AggregateKind::AVG:   return "AVG";
+        case AggregateKind::MIN:   return "MIN";
+        case AggregateKind::MAX:   return "MAX";
+        default:                   return "";
+    }
+}
+
+class SqlParser {
+private:
+    enum TokenKind { WORD, QUOTED_NAME, NUMBER, TEXT, SYMBOL, END };
+    struct Token {
+        TokenKind kind;
+        string text;
+    };
+
+    vector<Token> tokens;
+    size_t pos;
+    string error;
+
+    static string upper(string s) {
+        for (size_t i = 0; i < s.size(); i++) s[i] = (char)toupper((unsigned char)s[i]);
+        return s;
+    }
+
+    bool tokenize(const string& sql) {
+        tokens.clear();
+        size_t i = 0;
+        while (i < sql.size()) {
+            char c = sql[i];
+            if (isspace((unsigned char)c)) { i++; continue; }
+            if (isalpha((unsigned char)c) || c == '_') {
+                size_t start = i;
+                while (i < sql.size() && (isalnum((unsigned char)sql[i]) || sql[i] == '_')) i++;
+                tokens.push_back({WORD, sql.substr(start, i - start)});
+            } else if (isdigit((unsigned char)c) || ((c == '-' || c == '.') && i + 1 < sql.size() && (isdigit((unsigned char)sql[i + 1]) || sql[i + 1] == '.'))) {
+                size_t start = i++;
+                while (i < sql.size() && (isalnum((unsigned char)sql[i]) || sql[i] == '.' ||
+                       ((sql[i] == '-' || sql[i] == '+') && (sql[i - 1] == 'e' || sql[i - 1] == 'E')))) i++;
+                tokens.push_back({NUMBER, sql.substr(start, i - start)});
+            } else if (c == '\'' || c == '"') {
+                // Quotes are escaped by doubling them, as in standard SQL.
+                string text;
+                i++;
+                while (true) {
+                    if (i >= sql.size()) { error = "unterminated quote"; return false; }
+                    if (sql[i] == c) {
+                        if (i + 1 < sql.size() && sql[i + 1] == c) { text += c; i += 2; continue; }
+                        i++;
+                        break;
+                    }
+                    text += sql[i++];
+                }
+                tokens.push_back({c == '\'' ? TEXT : QUOTED_NAME, text});
+            } else {
+                string two = sql.substr(i, 2);
+                if (two == "<=" || two == ">=" || two == "!=" || two == "<>") {
+                    tokens.push_back({SYMBOL, two});
+                    i += 2;
+                } else if (string("=<>(),*;.").find(c) != string::npos) {
+                    tokens.push_back({SYMBOL, string(1, c)});
+                    i++;
+                } else {
+                    error = string("unexpected character '") + c + "'";
+                    return false;
+                }
+            }
+        }
+        tokens.push_back({END, ""});
+        return true;
+    }
+
+    const Token& peek() const { return tokens[pos]; }
+
+    bool isKeyword(const char* word) const {
+        return peek().kind == WORD && upper(peek().text) == word;
+    }
+
+    bool acceptKeyword(const char* word) {
+        if (!isKeyword(word)) return false;
+        pos++;
+        return true;
+    }
+
+    bool acceptSymbol(const char* symbol) {
+        if (peek().kind != SYMBOL || peek().text != symbol) return false;
+        pos++;
+        return true;
+    }
+
+    bool fail(const string& expected) {
+        if (error.empty())
+            error = "expected " + expected + (peek().kind == END ? " at end of query" : " near '" + peek().text + "'");
+        return false;
+    }
+
+    bool expectKeyword(const char* word) { return acceptKeyword(word) || fail(word); }
+    bool expectSymbol(const char* symbol) { return acceptSymbol(symbol) || fail(string("'") + symbol + "'"); }
+
+    bool name(string& out) {
+        if (peek().kind != WORD && peek().kind != QUOTED_NAME) return fail("a name");
+        out = tokens[pos++].text;
+        return true;
+    }
+
+    // A column name, optionally qualified as table.column.
+    bool columnName(string& out) {
+        if (!name(out)) return false;
+        while (acceptSymbol(".")) {
+            string part;
+            if (!name(part)) return false;
+            out += "." + part;
+        }
+        return true;
+    }
+
+    // A number, 'text', or TRUE / FALSE (as the text true / false).
+    bool literal(string& out) {
+        if (peek().kind == WORD && (upper(peek().text) == "TRUE" || upper(peek().text) == "FALSE")) {
+            out = upper(tokens[pos++].text) == "TRUE" ? "true" : "false";
+            return true;
+        }
+        if (peek().kind != NUMBER && peek().kind != TEXT) return false;
+        out = tokens[pos++].text;
+        return true;
+    }
+
+    static AggregateKind aggregateFor(const string& word) {
+        string w = upper(word);
+        if (w == "COUNT") return AggregateKind::COUNT;
+        if (w == "SUM") return AggregateKind::SUM;
+        if (w == "AVG") return AggregateKind::AVG;
+        if (w == "MIN") return AggregateKind::MIN;
+        if (w == "MAX") return AggregateKind::MAX;
+        return AggregateKind::NONE;
+    }
+
+    // column, or AGG(column) / COUNT(*); label gets the canonical text.
+    bool valueExpression(SelectItem& item) {
+        item.aggregate = AggregateKind::NONE;
+        if (peek().kind == WORD && aggregateFor(peek().text) != AggregateKind::NONE &&
+            tokens[pos + 1].kind == SYMBOL && tokens[pos + 1].text == "(") {
+            item.aggregate = aggregateFor(peek().text);
+            pos += 2;
+            if (item.aggregate == AggregateKind::COUNT && acceptSymbol("*")) item.column = "*";
+            else if (!columnName(item.column)) return false;
+            if (!expectSymbol(")")) return false;
+            item.label = string(aggregateName(item.aggregate)) + "(" + item.column + ")";
+            return true;
+        }
+        if (!columnName(item.column)) return false;
+        item.label = item.column;
+        return true;
+    }
+
+    static CompareOp flip(CompareOp op) {
+        switch (op) {
+            case CompareOp::LT: return CompareOp::GT;
+            case CompareOp::LE: return CompareOp::GE;
+            case CompareOp::GT: return CompareOp::LT;
+            case CompareOp::GE: return CompareOp::LE;
+            default:            return op;
+        }
+    }
+
+    bool compareOp(CompareOp& op) {
+        if (peek().kind != SYMBOL) return fail("a comparison operator");
+        const string& s = peek().text;
+        if (s == "=") op = CompareOp::EQ;
+        else if (s == "!=" || s == "<>") op = CompareOp::NE;
+        else if (s == "<") op = CompareOp::LT;
+        else if (s == "<=") op = CompareOp::LE;
+        else if (s == ">") op = CompareOp::GT;
+        else if (s == ">=") op = CompareOp::GE;
+        else return fail("a comparison operator");
+        pos++;
+        return true;
+    }
+
+    unique_ptr<Predicate> primary() {
+        if (acceptSymbol("(")) {
+            unique_ptr<Predicate> inner = orExpression();
+            if (!inner || !expectSymbol(")")) return nullptr;
+            return inner;
+        }
+        unique_ptr<Predicate> p(new Predicate(Predicate::COMPARE));
+        // Either "column op literal" or "literal op column".
+        if (literal(p->literal)) {
+            if (!compareOp(p->op) || !columnName(p->column)) return nullptr;
+            p->op = flip(p->op);
+        } else {
+            if (!columnName(p->column)) return nullptr;
+            if (acceptKeyword("IS")) {
+                p->op = acceptKeyword("NOT") ? CompareOp::NOT_NULL : CompareOp::IS_NULL;
+                if (!expectKeyword("NULL")) return nullptr;
+                return p;
+            }
+            if (!compareOp(p->op)) return nullptr;
+            if (!literal(p->literal)) { fail("a number or 'text' literal"); return nullptr; }
+        }
+        return p;
+    }
+
+    unique_ptr<Predicate> notExpression() {
+        if (acceptKeyword("NOT")) {
+            unique_ptr<Predicate> inner = notExpression();
+            if (!inner) return nullptr;
+            unique_ptr<Predicate> p(new Predicate(Predicate::NOT));
+            p->left = move(inner);
+            return p;
+        }
+        return primary();
+    }
+
+    unique_ptr<Predicate> andExpression() {
+        unique_ptr<Predicate> left = notExpression();
+        while (left && acceptKeyword("AND")) {
+            unique_ptr<Predicate> right = notExpression();
+            if (!right) return nullptr;
+            unique_ptr<Predicate> p(new Predicate(Predicate::AND));
+            p->left = move(left);
+            p->right = move(right);
+            left = move(p);
+        }
+        return left;
+    }
+
+    unique_ptr<Predicate> orExpression() {
+        unique_ptr<Predicate> left = andExpression();
+        while (left && acceptKeyword("OR")) {
+            unique_ptr<Predicate> right = andExpression();
+            if (!right) return nullptr;
+            unique_ptr<Predicate> p(new Predicate(Predicate::OR));
+            p->left = move(left);
+            p->right = move(right);
+            left = move(p);
+        }
+        return left;
+    }
+
+    bool select(SelectStatement& s) {
+        if (acceptSymbol("*")) {
+            s.selectAll = true;
+        } else {
+            do {
+                SelectItem item;
+                if (!valueExpression(item)) return false;
+                if (acceptKeyword("AS") && !name(item.label)) return false;
+                s.items.push_back(item);
+            } while (acceptSymbol(","));
+        }
+        if (!expectKeyword("FROM") || !name(s.table)) return false;
+        if (acceptKeyword("INNER") ? expectKeyword("JOIN") : acceptKeyword("JOIN")) {
+            if (!name(s.joinTable) || !expectKeyword("ON") || !columnName(s.joinLeft) || !expectSymbol("=") ||
+                !columnName(s.joinRight))
+                return false;
+        }
+        if (acceptKeyword("WHERE")) {
+            s.where = orExpression();
+            if (!s.where) return false;
+        }
+        if (acceptKeyword("GROUP")) {
+            if (!expectKeyword("BY")) return false;
+            do {
+                string column;
+                if (!columnName(column)) return false;
+                s.groupBy.push_back(column);
+            } while (acceptSymbol(","));
+        }
+        if (acceptKeyword("ORDER")) {
+            if (!expectKeyword("BY")) return false;
+            do {
+                SelectItem key;
+                if (!valueExpression(key)) return false;
+                OrderItem item = {key.label, false};
+                if (acceptKeyword("DESC")) item.descending = true;
+                else acceptKeyword("ASC");
+                s.orderBy.push_back(item);
+            } while (acceptSymbol(","));
+        }
+        if (acceptKeyword("LIMIT")) {
+            if (peek().kind != NUMBER || peek().text.find_first_not_of("0123456789") != string::npos)
+                return fail("a row count");
+            errno = 0;
+            unsigned long long n = strtoull(peek().text.c_str(), nullptr, 10);
+            if (errno == ERANGE || n > (unsigned long long)LLONG_MAX) return fail("a row count below 2^63");
+            s.limit = (long long)n;
+            pos++;
+        }
+        return true;
+    }
+
+    bool createIndex(CreateIndexStatement& c) {
+        if (!isKeyword("ON")) {
+            string ignoredName;
+            if (!name(ignoredName)) return false;
+        }
+        if (!expectKeyword("ON") || !name(c.table) || !expectSymbol("(") || !name(c.column) || !expectSymbol(")"))
+            return false;
+        if (acceptKeyword("USING")) {
+            if (acceptKeyword("HASH")) c.type = IndexType::HASH;
+            else if (acceptKeyword("BTREE")) c.type = IndexType::BTREE;
+            else return fail("HASH or BTREE");
+        }
+        return true;
+    }
+
+public:
+    // Parses one statement. On failure returns false and sets err.
+    bool parse(const string& sql, SqlStatement& out, string& err) {
+        error.clear();
+        pos = 0;
+        bool ok = tokenize(sql);
+        if (ok) {
+            if (acceptKeyword("EXPLAIN")) {
+                out.explain = true;
+                out.analyze = acceptKeyword("ANALYZE");
+                ok = expectKeyword("SELECT") && select(out.select);
+            } else if (acceptKeyword("SELECT")) {
+                out.kind = SqlStatement::SELECT;
+                ok = select(out.select);
+            } else if (acceptKeyword("CREATE")) {
+                out.kind = SqlStatement::CREATE_INDEX;
+                ok = expectKeyword("INDEX") && createIndex(out.createIndex);
+            } else if (acceptKeyword("ANALYZE")) {
+                out.kind = SqlStatement::ANALYZE;
+                ok = name(out.analyzeTable);
+            } else {
+                ok = fail("SELECT, EXPLAIN, ANALYZE or CREATE INDEX");
+            }
+        }
+        if (ok) {
+            acceptSymbol(";");
+            if (peek().kind != END) ok = fail("end of query");
+        }
+        err = error;
+        return ok;
+    }
+};
+
+#endif // SQL_PARSER_H
@@ -0,0 +1,245 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "ColumnStore.h"
+#include "Index.h"
+#include "QueryExecutor.h"
+#include "SqlParser.h"
+using namespace std;
+
+// Rows a table's statistics are taken from, picked at random.
+const size_t STATISTICS_SAMPLE_ROWS = 10000;
+const size_t HISTOGRAM_BUCKETS = 32;
+const size_t COMMON_VALUES = 16;
+
+// What the planner knows about one column: an estimate of its distinct
+// values, its most common values with the fraction of rows holding each,
+// and an equi-depth histogram: HISTOGRAM_BUCKETS + 1 bounds with about
+// the same share of the rows between each pair. Values are compared as
+// SQL compares them, so "1" and "1.0" are one value. BOOL and TIMESTAMP
+// values are keyed by their number, with the text get() shows; NULLs are
+// only counted.
+struct ColumnStatistics {
+    ColumnSpec spec;
+    double distinct;
+    double nullFraction;
+    vector<pair<IndexKey, double> > common;
+    vector<IndexKey> bounds;
+
+    ColumnStatistics() : distinct(0), nullFraction(0) {}
+
+    // Fraction of rows equal to literal.
+    double equalFraction(const IndexKey& literal) const {
+        if (bounds.empty() || compareSqlKeys(literal, bounds.front()) < 0 || compareSqlKeys(literal, bounds.back()) > 0) return 0;
+        double rest = 1;
+        for (size_t i = 0; i < common.size(); i++) {
+            if (compareSqlKeys(common[i].first, literal) == 0) return common[i].second;
+            rest -= common[i].second;
+        }
+        return max(0.0, rest) / max(1.0, distinct - common.size());
+    }
+
+    // Fraction of rows below literal, interpolating within a bucket when
+    // its bounds and literal are numbers.
+    double belowFraction(const IndexKey& literal) const {
+        if (bounds.empty()) return 0;
+        size_t above = lower_bound(bounds.begin(), bounds.end(), literal,
+                                   [](const IndexKey& a, const IndexKey& b) { return compareSqlKeys(a, b) < 0; }) - bounds.begin();
+        if (above == 0) return 0;
+        if (above == bounds.size()) return 1;
+        const IndexKey& low = bounds[above - 1];
+        const IndexKey& high = bounds[above];
+        double within = 0.5;
+        if (low.numeric && high.numeric && literal.numeric && high.number > low.number)
+            within = (literal.number - low.number) / (high.number - low.number);
+        return (above - 1 + within) / (bounds.size() - 1);
+    }
+
+    // The key of a value of a column declared as spec, given its text and,
+    // for an INT64 column, its stored number.
+    static IndexKey valueKey(const ColumnSpec& spec, const string& text, int64_t stored) {
+        IndexKey key(text);
+        if (spec.type == SqlType::BOOL || spec.type == SqlType::TIMESTAMP) {
+            key.numeric = true;
+            key.number = (double)stored;
+        }
+        return key;
+    }
+
+    // The key of a literal compared with the column, so that "yes" is
+    // true in a BOOL column.
+    IndexKey literalKey(const string& literal) const {
+        if (spec.type != SqlType::BOOL && spec.type != SqlType::TIMESTAMP) return IndexKey(literal);
+        Column typed(spec);
+        double number;
+        if (!typed.literalValue(literal, number)) return IndexKey(literal);
+        return valueKey(spec, typed.formatInt((int64_t)number), (int64_t)number);
+    }
+
+    // Fraction of rows whose value v makes "v op literal" true.
+    double selectivity(CompareOp op, const string& text) const {
+        if (op == CompareOp::IS_NULL) return nullFraction;
+        if (op == CompareOp::NOT_NULL) return 1 - nullFraction;
+        IndexKey literal = literalKey(text);
+        double equal = equalFraction(literal), below = belowFraction(literal);
+        double fraction;
+        switch (op) {
+            case CompareOp::EQ: fraction = equal; break;
+            case CompareOp::NE: fraction = 1 - equal; break;
+            case CompareOp::LT: fraction = below; break;
+            case CompareOp::LE: fraction = below + equal; break;
+            case CompareOp::GT: fraction = 1 - below - equal; break;
+            default:            fraction = 1 - below; break;
+        }
+        return min(1.0, max(0.0, fraction)) * (1 - nullFraction);
+    }
+
+    // Fraction of rows in both of two nested ranges of the column, which
+    // hold fractions a and b of the rows: at least their sum less the
+    // rows that are not NULL.
+    double nested(double a, double b) const { return max(0.0, a + b - (1 - nullFraction)); }
+};
+
+// Statistics of a whole table, taken from a sample of its rows.
+struct TableStatistics {
+    size_t rows;
+    size_t sampled;
+    vector<ColumnStatistics> columns;
+
+    TableStatistics() : rows(0), sampled(0) {}
+
+    // n distinct rows below total, in order, chosen uniformly at random
+    // (Floyd's algorithm). Evenly spaced rows would line up with data
+    // that repeats with the stride and see only a few of its values. The
+    // generator is seeded with the table size so that a table gets the
+    // same statistics, and so the same plans, every time.
+    static vector<size_t> sampleRows(size_t total, size_t n) {
+        vector<size_t> rows;
+        rows.reserve(n);
+        if (n == total) {
+            for (size_t i = 0; i < total; i++) rows.push_back(i);
+            return rows;
+        }
+        mt19937_64 random(total);
+        unordered_set<size_t> chosen(2 * n);
+        for (size_t j = total - n; j < total; j++) {
+            size_t row = uniform_int_distribution<size_t>(0, j)(random);
+            if (!chosen.insert(row).second) chosen.insert(row = j);
+            rows.push_back(row);
+        }
+        sort(rows.begin(), rows.end());
+        return rows;
+    }
+
+    // Samples rowCount live rows of store, which may also hold deleted
+    // rows; those are few enough not to skew the sample much.
+    static TableStatistics build(const ColumnStore& store, size_t rowCount) {
+        TableStatistics s;
+        s.rows = rowCount;
+        s.columns.resize(store.columnCount());
+        size_t total = store.rowCount();
+        size_t n = min(total, STATISTICS_SAMPLE_ROWS);
+        s.sampled = n;
+        if (n == 0) return s;
+        vector<size_t> sample = sampleRows(total, n);
+        vector<IndexKey> keys;
+        for (size_t c = 0; c < store.columnCount(); c++) {
+            const Column& col = store.column(c);
+            ColumnStatistics& cs = s.columns[c];
+            cs.spec = col.getSpec();
+            keys.clear();
+            for (size_t i = 0; i < s.sampled; i++) {
+                size_t row = sample[i];
+                if (!col.isNull(row))
+                    keys.push_back(ColumnStatistics::valueKey(cs.spec, col.get(row), col.getType() == ColumnType::INT64 ? col.intData()[row] : 0));
+            }
+            cs.nullFraction = 1 - (double)keys.size() / s.sampled;
+            n = keys.size();
+            if (n == 0) continue;
+            sort(keys.begin(), keys.end(), [](const IndexKey& a, const IndexKey& b) { return compareSqlKeys(a, b) < 0; });
+
+            vector<pair<size_t, size_t> > runs;   // (count, first position) of each distinct value
+            for (size_t i = 0; i < n;) {
+                size_t j = i + 1;
+                while (j < n && compareSqlKeys(keys[i], keys[j]) == 0) j++;
+                runs.push_back(make_pair(j - i, i));
+                i = j;
+            }
+            // Guaranteed-error estimator: values seen once in the sample
+            // stand for sqrt(total / sampled) values each.
+            double distinct = (double)runs.size();
+            if (n < total) {
+                size_t once = 0;
+                for (size_t r = 0; r < runs.size(); r++) once += runs[r].first == 1;
+                distinct = sqrt((double)total / n) * once + (double)(runs.size() - once);
+            }
+            cs.distinct = max(1.0, min(distinct, (double)max<size_t>(rowCount, 1)));
+
+            sort(runs.begin(), runs.end(), [](const pair<size_t, size_t>& a, const pair<size_t, size_t>& b) {
+                return a.first != b.first ? a.first > b.first : a.second < b.second;
+            });
+            for (size_t r = 0; r < runs.size() && r < COMMON_VALUES && runs[r].first > 1; r++)
+                cs.common.push_back(make_pair(keys[runs[r].second], (double)runs[r].first / n));
+
+            size_t buckets = min(HISTOGRAM_BUCKETS, n);
+            for (size_t b = 0; b <= buckets; b++) cs.bounds.push_back(keys[min(n - 1, b * n / buckets)]);
+        }
+        return s;
+    }
+
+    // Fraction of rows that satisfy p. Conditions ANDed on one column are
+    // taken as nested ranges (see ColumnStatistics::nested). Other
+    // parts of AND and OR are taken as independent. Columns are looked up
+    // in names.
+    double selectivity(const Predicate& p, const vector<string>& names) const {
+        if (p.kind == Predicate::AND) {
+            vector<const Predicate*> parts;
+            conjuncts(p, parts);
+            vector<pair<string, double> > byColumn;   // (column, fraction) of its conditions
+            double fraction = 1;
+            for (size_t i = 0; i < parts.size(); i++) {
+                double f = selectivity(*parts[i], names);
+                if (parts[i]->kind != Predicate::COMPARE) { fraction *= f; continue; }
+                size_t c = 0;
+                while (c < byColumn.size() && byColumn[c].first != parts[i]->column) c++;
+                if (c == byColumn.size()) byColumn.push_back(make_pair(parts[i]->column, f));
+                else byColumn[c].second = nestedFraction(parts[i]->column, names, byColumn[c].second, f);
+            }
+            for (size_t c = 0; c < byColumn.size(); c++) fraction *= byColumn[c].second;
+            return fraction;
+        }
+        if (p.kind == Predicate::OR) {
+            double a = selectivity(*p.left, names), b = selectivity(*p.right, names);
+            return a + b - a * b;
+        }
+        if (p.kind == Predicate::NOT) return 1 - selectivity(*p.left, names);
+        for (size_t c = 0; c < names.size() && c < columns.size(); c++)
+            if (names[c] == p.column) return columns[c].selectivity(p.op, p.literal);
+        return 1;
+    }
+
+    double nestedFraction(const string& column, const vector<string>& names, double a, double b) const {
+        for (size_t c = 0; c < names.size() && c < columns.size(); c++)
+            if (names[c] == column) return columns[c].nested(a, b);
+        return max(0.0, a + b - 1);
+    }
+
+    // The parts of p that are ANDed together.
+    static void conjuncts(const Predicate& p, vector<const Predicate*>& out) {
+        if (p.kind == Predicate::AND) {
+            conjuncts(*p.left, out);
+            conjuncts(*p.right, out);
+        } else {
+            out.push_back(&p);
+        }
+    }
+};
+
+#endif // STATISTICS_H
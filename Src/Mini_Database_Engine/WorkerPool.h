@@ -0,0 +1,108 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Rows per morsel: the unit of work a thread takes from a scan. Large
+// enough to amortize the hand-out, small enough to balance the load.
+const size_t MORSEL_ROWS = 64 * 1024;
+
+inline size_t morselCount(size_t rows) { return (rows + MORSEL_ROWS - 1) / MORSEL_ROWS; }
+
+// Fixed set of threads for morsel-driven parallelism. run() hands out
+// morsel numbers from a shared counter; each thread keeps taking the next
+// one until none are left, so fast threads simply do more morsels. The
+// calling thread works too, as worker 0.
+//
+// One job runs at a time. A run() that finds the pool busy (another
+// query, or a nested call from inside a job) executes on its caller
+// alone instead of waiting.
+class WorkerPool {
+private:
+    vector<thread> threads;
+    mutex lock, jobLock;
+    condition_variable started, finished;
+    const function<void(size_t, size_t)>* body;
+    size_t morsels;
+    atomic<size_t> nextMorsel;
+    uint64_t generation;
+    size_t running;
+    bool stopping;
+
+    void work(size_t worker) {
+        for (size_t m = nextMorsel.fetch_add(1); m < morsels; m = nextMorsel.fetch_add(1))
+            (*body)(m, worker);
+    }
+
+    void loop(size_t worker) {
+        uint64_t seen = 0;
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            started.wait(guard, [this, &seen] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            guard.unlock();
+            work(worker);
+            guard.lock();
+            if (--running == 0) finished.notify_all();
+        }
+    }
+
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+public:
+    explicit WorkerPool(size_t workers)
+        : body(nullptr), morsels(0), nextMorsel(0), generation(0), running(0), stopping(false) {
+        for (size_t i = 1; i < workers; i++) threads.push_back(thread(&WorkerPool::loop, this, i));
+    }
+
+    ~WorkerPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        started.notify_all();
+        for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+    }
+
+    static WorkerPool& getInstance() {
+        static WorkerPool pool(max(1u, thread::hardware_concurrency()));
+        return pool;
+    }
+
+    // Worker ids passed to run() bodies are below this.
+    size_t size() const { return threads.size() + 1; }
+
+    // Calls f(morsel, worker) for every morsel in [0, count) and returns
+    // when all are done. Calls with the same worker id never overlap.
+    void run(size_t count, const function<void(size_t, size_t)>& f) {
+        unique_lock<mutex> job(jobLock, try_to_lock);
+        if (!job.owns_lock() || threads.empty() || count <= 1) {
+            for (size_t m = 0; m < count; m++) f(m, 0);
+            return;
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            body = &f;
+            morsels = count;
+            nextMorsel = 0;
+            running = threads.size();
+            generation++;
+        }
+        started.notify_all();
+        work(0);
+        unique_lock<mutex> guard(lock);
+        finished.wait(guard, [this] { return running == 0; });
+        body = nullptr;
+    }
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,299 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "PageFile.h"
+using namespace std;
+
+enum LogRecordType { LOG_CREATE_TABLE = 1, LOG_INSERT = 2, LOG_UPDATE = 3, LOG_DELETE = 4, LOG_CREATE_INDEX = 5, LOG_INSERT_BLOCK = 6 };
+
+// The largest commit a log frame can hold.
+const uint64_t MAX_LOG_COMMIT_BYTES = UINT32_MAX - 8;
+
+// One decoded log record. Which fields are set depends on type.
+struct LogRecord {
+    LogRecordType type;
+    string table;
+    uint64_t index;          // UPDATE, DELETE: record index
+    vector<string> values;   // CREATE_TABLE: columns; INSERT, UPDATE: row
+    string column;           // CREATE_INDEX
+    uint8_t indexType;       // CREATE_INDEX
+    string block;            // INSERT_BLOCK: rows as a compressed block (Compression.h)
+    LogRecord() : type(LOG_INSERT), index(0), indexType(0) {}
+};
+
+// Append-only redo log. The records of one commit are framed together as
+//
+//   u32 length, u32 CRC32 of the payload, payload
+//   payload: varint record count, the records, u64 LSN
+//
+// so replay can tell a torn final write from real data and stop there,
+// and a commit is replayed whole or not at all: a crash partway through
+// writing a transaction's records loses the transaction, never half of
+// it. The log sequence number (LSN) comes last so that the CRC of the
+// records can be taken before the LSN is known. LSNs keep counting across
+// checkpoints: a page file records the last LSN it contains, and replay
+// skips every commit at or below it, so a log that outlived its
+// checkpoint (a crash before truncate()) is not applied twice.
+//
+// Writers append a commit and then wait in commit() until it is on disk.
+// A single flusher thread writes everything appended so far with one
+// write and one fsync; while that fsync runs new records pile up and go
+// out together in the next one (group commit), so concurrent writers
+// share the sync cost instead of paying it one by one.
+class WriteAheadLog {
+private:
+    FILE* file;
+    string path;
+    mutex lock;
+    condition_variable wakeFlusher, flushed;
+    thread flusher;
+    string pending;           // framed commits not yet written
+    uint64_t appendedLsn;     // last commit handed to append()
+    uint64_t durableLsn;      // last commit known to be on disk
+    uint64_t fileBytes;
+    bool stopping, failed;
+    uint64_t checkpointBytes;
+    function<void()> checkpointHandler;
+
+    WriteAheadLog(const WriteAheadLog&);
+    WriteAheadLog& operator=(const WriteAheadLog&);
+
+    static bool syncFile(FILE* f) {
+        if (fflush(f) != 0) return false;
+#ifdef _WIN32
+        return _commit(_fileno(f)) == 0;
+#else
+        return fsync(fileno(f)) == 0;
+#endif
+    }
+
+    void flushLoop() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wakeFlusher.wait(guard, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) return;  // stopping with nothing left
+            string batch;
+            batch.swap(pending);
+            uint64_t batchLsn = appendedLsn;
+            guard.unlock();
+            bool ok = fwrite(batch.data(), 1, batch.size(), file) == batch.size() && syncFile(file);
+            guard.lock();
+            if (ok) fileBytes += batch.size();
+            else failed = true;
+            durableLsn = batchLsn;
+            flushed.notify_all();
+        }
+    }
+
+    void stopFlusher() {
+        if (!flusher.joinable()) return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wakeFlusher.notify_all();
+        flusher.join();
+        stopping = false;
+    }
+
+    static void encode(const LogRecord& r, ByteWriter& w) {
+        w.putVarint(r.type);
+        w.putString(r.table);
+        if (r.type == LOG_UPDATE || r.type == LOG_DELETE) w.putVarint(r.index);
+        if (r.type == LOG_CREATE_TABLE || r.type == LOG_INSERT || r.type == LOG_UPDATE) {
+            w.putVarint(r.values.size());
+            for (size_t i = 0; i < r.values.size(); i++) w.putString(r.values[i]);
+        }
+        if (r.type == LOG_CREATE_INDEX) {
+            w.putString(r.column);
+            w.putVarint(r.indexType);
+        }
+        if (r.type == LOG_INSERT_BLOCK) w.putString(r.block);
+    }
+
+    static bool decode(ByteReader& in, size_t payloadBytes, LogRecord& r) {
+        r = LogRecord();
+        r.type = (LogRecordType)in.getVarint();
+        in.getString(r.table);
+        if (r.type == LOG_UPDATE || r.type == LOG_DELETE) r.index = in.getVarint();
+        if (r.type == LOG_CREATE_TABLE || r.type == LOG_INSERT || r.type == LOG_UPDATE) {
+            uint64_t n = in.getVarint();
+            if (n > payloadBytes) return false;
+            r.values.resize((size_t)n);
+            for (size_t i = 0; i < r.values.size(); i++) in.getString(r.values[i]);
+        }
+        if (r.type == LOG_CREATE_INDEX) {
+            in.getString(r.column);
+            r.indexType = (uint8_t)in.getVarint();
+        }
+        if (r.type == LOG_INSERT_BLOCK) in.getString(r.block);
+        return in.ok && r.type >= LOG_CREATE_TABLE && r.type <= LOG_INSERT_BLOCK;
+    }
+
+    // The records of one commit, or false if the payload is malformed.
+    static bool decode(const string& payload, uint64_t& lsn, vector<LogRecord>& records) {
+        if (payload.size() < 8) return false;
+        size_t body = payload.size() - 8;
+        const unsigned char* tail = (const unsigned char*)payload.data() + body;
+        lsn = get32(tail) | (uint64_t)get32(tail + 4) << 32;
+        ByteReader in((const unsigned char*)payload.data(), body);
+        uint64_t n = in.getVarint();
+        if (!in.ok || n > body) return false;
+        records.resize((size_t)n);
+        for (size_t i = 0; i < records.size(); i++)
+            if (!decode(in, body, records[i])) return false;
+        return in.atEnd();
+    }
+
+public:
+    WriteAheadLog()
+        : file(nullptr), appendedLsn(0), durableLsn(0), fileBytes(0),
+          stopping(false), failed(false), checkpointBytes(16u << 20) {}
+    ~WriteAheadLog() { close(); }
+
+    // Reads the records of every intact commit of the log at logPath with
+    // an LSN above afterLsn, in order; lastLsn gets the highest LSN seen
+    // (at least afterLsn). Returns false if the log ends in a torn or
+    // corrupt commit (every commit before it has been delivered, none of
+    // it). A missing log counts as empty.
+    static bool replay(const string& logPath, uint64_t afterLsn, const function<void(const LogRecord&)>& apply, uint64_t& lastLsn) {
+        lastLsn = afterLsn;
+        ifstream in(logPath.c_str(), ios::binary);
+        if (!in) return true;
+        in.seekg(0, ios::end);
+        uint64_t left = (uint64_t)in.tellg();
+        in.seekg(0);
+        unsigned char frame[8];
+        string payload;
+        vector<LogRecord> records;
+        uint64_t lsn;
+        while (in.read((char*)frame, 8)) {
+            uint32_t length = get32(frame);
+            left -= 8;
+            // A length past the end of the file is a torn or corrupt
+            // header; it is not worth allocating for.
+            if (length < 8 || length > left) return false;
+            left -= length;
+            payload.resize(length);
+            if (!in.read(&payload[0], length)) return false;
+            if (crc32((const unsigned char*)payload.data(), length) != get32(frame + 4)) return false;
+            if (!decode(payload, lsn, records)) return false;
+            if (lsn <= afterLsn) continue;
+            for (size_t i = 0; i < records.size(); i++) apply(records[i]);
+            lastLsn = lsn;
+        }
+        return in.gcount() == 0;
+    }
+
+    // Opens the log at logPath for appending (emptied first if truncate is
+    // set); the next record gets lastLsn + 1.
+    bool open(const string& logPath, bool truncate, uint64_t lastLsn) {
+        close();
+        FILE* f = fopen(logPath.c_str(), truncate ? "wb" : "ab");
+        lock_guard<mutex> guard(lock);
+        path = logPath;
+        appendedLsn = durableLsn = lastLsn;
+        failed = false;
+        if (!f) return false;
+        file = f;
+        fseek(file, 0, SEEK_END);
+        fileBytes = (uint64_t)ftell(file);
+        flusher = thread(&WriteAheadLog::flushLoop, this);
+        return true;
+    }
+
+    void close() {
+        stopFlusher();
+        lock_guard<mutex> guard(lock);
+        if (file) fclose(file);
+        file = nullptr;
+    }
+
+    bool isOpen() const { return file != nullptr; }
+
+    // Empties the log once a checkpoint has made its records redundant.
+    // LSNs carry on from where they were.
+    bool truncate() {
+        string logPath = path;
+        return open(logPath, true, lastLsn());
+    }
+
+    // The LSN of the last commit appended. A checkpoint taken while nothing
+    // can be appended contains every commit up to it.
+    uint64_t lastLsn() {
+        lock_guard<mutex> guard(lock);
+        return appendedLsn;
+    }
+
+    // The handler runs (from commit) once the log has grown past
+    // thresholdBytes; it is expected to checkpoint and truncate().
+    void setCheckpointHandler(uint64_t thresholdBytes, const function<void()>& handler) {
+        checkpointBytes = thresholdBytes;
+        checkpointHandler = handler;
+    }
+
+    // Appends records as one commit and returns its LSN. The flusher only
+    // ever sees the commit whole. With the log closed nothing is written
+    // and committing the LSN fails.
+    uint64_t append(const vector<LogRecord>& records) {
+        ByteWriter body;
+        body.putVarint(records.size());
+        for (size_t i = 0; i < records.size(); i++) encode(records[i], body);
+        uint32_t crc = crc32((const unsigned char*)body.bytes.data(), body.bytes.size());
+        lock_guard<mutex> guard(lock);
+        uint64_t lsn = ++appendedLsn;
+        if (!file) {
+            failed = true;
+            return lsn;
+        }
+        unsigned char frame[8], tail[8];
+        put32(tail, (uint32_t)lsn);
+        put32(tail + 4, (uint32_t)(lsn >> 32));
+        put32(frame, (uint32_t)(body.bytes.size() + 8));
+        put32(frame + 4, crc32(tail, 8, crc));
+        pending.append((const char*)frame, 8);
+        pending.append(body.bytes);
+        pending.append((const char*)tail, 8);
+        wakeFlusher.notify_one();
+        return lsn;
+    }
+
+    uint64_t append(const LogRecord& record) { return append(vector<LogRecord>(1, record)); }
+
+    // Blocks until the commit with this LSN is durable. Returns false if a
+    // write or sync failed.
+    bool commit(uint64_t lsn) {
+        bool ok = flushTo(lsn), full;
+        {
+            lock_guard<mutex> guard(lock);
+            full = fileBytes >= checkpointBytes;
+        }
+        if (full && checkpointHandler) checkpointHandler();
+        return ok;
+    }
+
+    // Like commit(), but never runs the checkpoint handler, so it can be
+    // called with commitLock held. Returns false at once if the log is
+    // closed, as nothing would ever flush it.
+    bool flushTo(uint64_t lsn) {
+        unique_lock<mutex> guard(lock);
+        flushed.wait(guard, [this, lsn] { return durableLsn >= lsn || !file; });
+        return durableLsn >= lsn && !failed;
+    }
+};
+
+#endif // WRITE_AHEAD_LOG_H
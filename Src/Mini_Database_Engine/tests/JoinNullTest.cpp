@@ -0,0 +1,49 @@
+// Joins on keys that are NULL or 0: NULL matches nothing, so of
+// l(k INT) = {0, NULL} and r(k FLOAT) = {0, NULL} only 0 = 0 joins,
+// by hash and, with B+tree indexes on both keys, by merge.
+//
+//   g++ -std=c++17 -O2 -pthread tests/JoinNullTest.cpp -o JoinNullTest && ./JoinNullTest
+#define main databaseMain
+#include "../database.cpp"
+#undef main
+
+#include <cstdlib>
+
+static int failures = 0;
+
+static void expectRows(Database& db, const string& sql, size_t expected) {
+    Transaction txn(db.getTransactionManager());
+    ResultSet result;
+    string error;
+    if (!db.query(txn, sql, result, error)) {
+        cerr << "FAIL " << sql << ": " << error << endl;
+        failures++;
+    } else if (result.rows.size() != expected) {
+        cerr << "FAIL " << sql << ": " << result.rows.size() << " rows, expected " << expected << endl;
+        failures++;
+    }
+}
+
+int main() {
+    string name = "join_null_test.db";
+    remove(name.c_str());
+    remove((name + ".wal").c_str());
+    {
+        Database db;
+        db.loadDatabase(name);
+        db.createTable("l", {"k INT"});
+        db.createTable("r", {"k FLOAT"});
+        for (const char* v : {"0", "NULL"}) {
+            db.insertRecord(*db.getTable("l"), {v});
+            db.insertRecord(*db.getTable("r"), {v});
+        }
+        expectRows(db, "SELECT l.k, r.k FROM l JOIN r ON l.k = r.k", 1);
+        db.executeSql("CREATE INDEX ON l (k) USING BTREE");
+        db.executeSql("CREATE INDEX ON r (k) USING BTREE");
+        expectRows(db, "SELECT l.k, r.k FROM l JOIN r ON l.k = r.k", 1);
+    }
+    remove(name.c_str());
+    remove((name + ".wal").c_str());
+    cout << (failures ? "FAILED" : "passed") << endl;
+    return failures ? 1 : 0;
+}
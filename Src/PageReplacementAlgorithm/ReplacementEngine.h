@@ -0,0 +1,731 @@
+#ifndef REPLACEMENT_ENGINE_H
+#define REPLACEMENT_ENGINE_H
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// References between clock ticks, which clear the R bits for NRU and
+// shift them into the Aging counters.
+const size_t TICK_REFERENCES = 100;
+// WSClock's working-set window, in references.
+const size_t WORKING_SET_WINDOW = 1000;
+// References every policy is run over before the next policy's turn.
+const size_t ENGINE_CHUNK = 1 << 16;
+
+const size_t NO_NEXT_USE = SIZE_MAX;
+
+// A reference string decoded once for every policy: pages are renumbered
+// 0, 1, ... in order of first use, so the policies can index arrays by
+// page instead of searching their frames. nextUse holds, for OPT, the
+// position of the next reference to the same page.
+struct ReferenceTrace {
+    vector<int> pages;
+    vector<char> writes;
+    vector<size_t> nextUse;
+    unordered_map<long long, int> ids;
+
+    int distinct() const { return (int)ids.size(); }
+
+    void add(long long page, bool write) {
+        auto it = ids.emplace(page, (int)ids.size()).first;
+        pages.push_back(it->second);
+        writes.push_back(write);
+    }
+
+    // One backward pass: where each page is referenced next.
+    void finish() {
+        nextUse.assign(pages.size(), NO_NEXT_USE);
+        vector<size_t> seen(ids.size(), NO_NEXT_USE);
+        for (size_t i = pages.size(); i-- > 0;) {
+            nextUse[i] = seen[pages[i]];
+            seen[pages[i]] = i;
+        }
+    }
+
+    // Adds the references in text[0, n), which ends between two of them.
+    bool parse(const char* text, size_t n, const string& path, string& error) {
+        size_t i = 0;
+        while (i < n) {
+            while (i < n && isspace((unsigned char)text[i])) i++;
+            if (i == n) break;
+            if (!isdigit((unsigned char)text[i])) {
+                error = path + ": expected a page number at \"" + string(text + i, min<size_t>(16, n - i)) + "\"";
+                return false;
+            }
+            size_t start = i;
+            long long page = 0;
+            for (; i < n && isdigit((unsigned char)text[i]); i++) {
+                int digit = text[i] - '0';
+                if (page > (LLONG_MAX - digit) / 10) {
+                    while (i < n && isdigit((unsigned char)text[i])) i++;
+                    error = path + ": page number " + string(text + start, i - start) + " is too large";
+                    return false;
+                }
+                page = page * 10 + digit;
+            }
+            bool write = false;
+            if (i < n && (text[i] == 'w' || text[i] == 'W')) write = true, i++;
+            else if (i < n && (text[i] == 'r' || text[i] == 'R')) i++;
+            add(page, write);
+        }
+        return true;
+    }
+
+    // Reads whitespace-separated page numbers; a trailing w or W marks a
+    // write (so "12w" writes page 12), r or R a read. The file is read a
+    // megabyte at a time; a reference cut off at the end of one read is
+    // moved to the front of the buffer and finished by the next.
+    bool load(const string& path, string& error) {
+        ifstream in(path, ios::binary);
+        if (!in) {
+            error = "could not open " + path;
+            return false;
+        }
+        ids.reserve(1 << 16);
+        vector<char> buffer(1 << 20);
+        size_t kept = 0; // bytes carried over from the last read
+        while (true) {
+            in.read(buffer.data() + kept, buffer.size() - kept);
+            size_t n = kept + (size_t)in.gcount();
+            if (in.bad()) {
+                error = "could not read " + path;
+                return false;
+            }
+            if (!in) { // end of file: the rest is complete
+                if (!parse(buffer.data(), n, path, error)) return false;
+                finish();
+                return true;
+            }
+            size_t end = n;
+            while (end > 0 && !isspace((unsigned char)buffer[end - 1])) end--;
+            if (end == 0) { // one token fills the buffer
+                buffer.resize(buffer.size() * 2);
+                kept = n;
+                continue;
+            }
+            if (!parse(buffer.data(), end, path, error)) return false;
+            kept = n - end;
+            copy(buffer.begin() + end, buffer.begin() + n, buffer.begin());
+        }
+    }
+};
+
+// A policy with frames frames. Pages map to frames through frameOf, so
+// a reference is one array lookup; the policy only decides which frame
+// to give up on a fault (victim) and notes hits and loads.
+class PagePolicy {
+protected:
+    int frames, used;
+    vector<int> frameOf; // per page: its frame, or -1
+    vector<int> pageIn;  // per frame: its page, or -1
+    vector<char> dirty;  // per frame
+
+    // Empties the frame, writing its page back if it was modified.
+    void evict(int frame) {
+        if (pageIn[frame] < 0) return;
+        if (dirty[frame]) writebacks++;
+        frameOf[pageIn[frame]] = -1;
+        pageIn[frame] = -1;
+        dirty[frame] = 0;
+    }
+
+    void place(int page, bool write, int frame) {
+        pageIn[frame] = page;
+        frameOf[page] = frame;
+        dirty[frame] = write;
+    }
+
+    virtual int victim(size_t time) = 0;
+    virtual void onHit(int frame, size_t time) = 0;
+    virtual void onLoad(int frame, size_t time) = 0;
+    virtual void tick() {}
+
+public:
+    unsigned long long faults, writebacks;
+
+    PagePolicy(int frameCount, int pages)
+        : frames(frameCount), used(0), frameOf(pages, -1), pageIn(frameCount, -1), dirty(frameCount, 0),
+          faults(0), writebacks(0) {}
+    virtual ~PagePolicy() {}
+    virtual const char* name() const = 0;
+
+    // References page at position time of the trace; false on a fault.
+    virtual bool reference(int page, bool write, size_t time) {
+        if (time % TICK_REFERENCES == 0) tick();
+        int frame = frameOf[page];
+        if (frame >= 0) {
+            if (write) dirty[frame] = 1;
+            onHit(frame, time);
+            return true;
+        }
+        faults++;
+        frame = used < frames ? used++ : victim(time);
+        evict(frame);
+        place(page, write, frame);
+        onLoad(frame, time);
+        return false;
+    }
+};
+
+// Evicts pages in the order they were loaded.
+class FIFOPolicy : public PagePolicy {
+    int hand;
+
+protected:
+    int victim(size_t) {
+        int frame = hand;
+        hand = (hand + 1) % frames;
+        return frame;
+    }
+    void onHit(int, size_t) {}
+    void onLoad(int, size_t) {}
+
+public:
+    FIFOPolicy(int frameCount, int pages) : PagePolicy(frameCount, pages), hand(0) {}
+    const char* name() const { return "FIFO"; }
+};
+
+// Evicts the least recently used page, keeping the frames in a doubly
+// linked list from least to most recently used.
+class LRUPolicy : public PagePolicy {
+    vector<int> prev, next;
+    int head, tail;
+
+    void unlink(int f) {
+        (prev[f] < 0 ? head : next[prev[f]]) = next[f];
+        (next[f] < 0 ? tail : prev[next[f]]) = prev[f];
+    }
+    void pushBack(int f) {
+        prev[f] = tail;
+        next[f] = -1;
+        (tail < 0 ? head : next[tail]) = f;
+        tail = f;
+    }
+
+protected:
+    int victim(size_t) {
+        int frame = head;
+        unlink(frame);
+        return frame;
+    }
+    void onHit(int frame, size_t) {
+        unlink(frame);
+        pushBack(frame);
+    }
+    void onLoad(int frame, size_t) { pushBack(frame); }
+
+public:
+    LRUPolicy(int frameCount, int pages)
+        : PagePolicy(frameCount, pages), prev(frameCount, -1), next(frameCount, -1), head(-1), tail(-1) {}
+    const char* name() const { return "LRU"; }
+};
+
+// Belady's optimal policy: evicts the page referenced farthest ahead,
+// from a max-heap of (next use, frame). Entries go stale when their frame
+// is referenced again and are dropped when they reach the top.
+class OPTPolicy : public PagePolicy {
+    const vector<size_t>& nextUse;
+    vector<size_t> key; // per frame: the next use of its page
+    priority_queue<pair<size_t, int> > heap;
+
+    void touch(int frame, size_t time) {
+        key[frame] = nextUse[time];
+        heap.push(make_pair(key[frame], frame));
+        if (heap.size() > 4 * (size_t)frames + 64) {
+            priority_queue<pair<size_t, int> > fresh;
+            for (int f = 0; f < used; f++) fresh.push(make_pair(key[f], f));
+            heap.swap(fresh);
+        }
+    }
+
+protected:
+    int victim(size_t) {
+        while (heap.top().first != key[heap.top().second]) heap.pop();
+        int frame = heap.top().second;
+        heap.pop();
+        return frame;
+    }
+    void onHit(int frame, size_t time) { touch(frame, time); }
+    void onLoad(int frame, size_t time) { touch(frame, time); }
+
+public:
+    OPTPolicy(int frameCount, int pages, const vector<size_t>& next)
+        : PagePolicy(frameCount, pages), nextUse(next), key(frameCount, NO_NEXT_USE) {}
+    const char* name() const { return "OPT"; }
+};
+
+// The clock: a hand sweeps the frames, clearing R bits, and evicts the
+// first page whose R bit is already clear.
+class ClockPolicy : public PagePolicy {
+    vector<char> referenced;
+    int hand;
+
+protected:
+    int victim(size_t) {
+        while (referenced[hand]) {
+            referenced[hand] = 0;
+            hand = (hand + 1) % frames;
+        }
+        int frame = hand;
+        hand = (hand + 1) % frames;
+        return frame;
+    }
+    void onHit(int frame, size_t) { referenced[frame] = 1; }
+    void onLoad(int frame, size_t) { referenced[frame] = 1; }
+
+public:
+    ClockPolicy(int frameCount, int pages) : PagePolicy(frameCount, pages), referenced(frameCount, 0), hand(0) {}
+    const char* name() const { return "Clock"; }
+};
+
+// FIFO that gives a page with its R bit set a second chance, moving it
+// to the back of the queue. It evicts the same pages as the clock, which
+// is the same algorithm without the queue moves.
+class SecondChancePolicy : public PagePolicy {
+    vector<char> referenced;
+    deque<int> queue; // frames, oldest first
+
+protected:
+    int victim(size_t) {
+        for (;;) {
+            int frame = queue.front();
+            queue.pop_front();
+            if (!referenced[frame]) return frame;
+            referenced[frame] = 0;
+            queue.push_back(frame);
+        }
+    }
+    void onHit(int frame, size_t) { referenced[frame] = 1; }
+    void onLoad(int frame, size_t) {
+        referenced[frame] = 1;
+        queue.push_back(frame);
+    }
+
+public:
+    SecondChancePolicy(int frameCount, int pages) : PagePolicy(frameCount, pages), referenced(frameCount, 0) {}
+    const char* name() const { return "Second-Chance"; }
+};
+
+// Not recently used: R bits are cleared every tick, and a fault evicts a
+// page of the lowest class (R, M), searching from where the last search
+// stopped. R and M are kept as bitmasks, so the search for a class
+// covers 64 frames a step.
+class NRUPolicy : public PagePolicy {
+    vector<unsigned long long> referenced, modified; // bit per frame
+    int hand;
+
+    void set(vector<unsigned long long>& bits, int frame, bool on) {
+        if (on) bits[frame / 64] |= 1ULL << (frame % 64);
+        else bits[frame / 64] &= ~(1ULL << (frame % 64));
+    }
+
+    // The first frame in [from, to) of class c (2R + M), or -1.
+    int first(int c, int from, int to) const {
+        for (int w = from / 64; w * 64 < to; w++) {
+            unsigned long long bits = (c & 2 ? referenced[w] : ~referenced[w]) & (c & 1 ? modified[w] : ~modified[w]);
+            if (w == from / 64) bits &= ~0ULL << (from % 64);
+            if (bits) {
+                int f = w * 64 + __builtin_ctzll(bits);
+                return f < to ? f : -1;
+            }
+        }
+        return -1;
+    }
+
+protected:
+    int victim(size_t) {
+        for (int c = 0; c < 4; c++) {
+            int f = first(c, hand, frames);
+            if (f < 0) f = first(c, 0, hand);
+            if (f >= 0) {
+                hand = (f + 1) % frames;
+                return f;
+            }
+        }
+        return hand;
+    }
+    void onHit(int frame, size_t) {
+        set(referenced, frame, true);
+        set(modified, frame, dirty[frame] != 0);
+    }
+    void onLoad(int frame, size_t time) { onHit(frame, time); }
+    void tick() { fill(referenced.begin(), referenced.end(), 0); }
+
+public:
+    NRUPolicy(int frameCount, int pages)
+        : PagePolicy(frameCount, pages), referenced((frameCount + 63) / 64, 0), modified((frameCount + 63) / 64, 0),
+          hand(0) {}
+    const char* name() const { return "NRU"; }
+};
+
+// Least frequently used, ties going to the least recently used. Frames
+// with the same count share a bucket, in order of their last reference,
+// and the buckets are kept in increasing count order, so a reference
+// moves a frame at most one bucket along and the victim is the front of
+// the first bucket.
+class LFUPolicy : public PagePolicy {
+    vector<int> prev, next, bucketOf;        // per frame
+    vector<unsigned long long> count;        // per bucket
+    vector<int> head, tail, lower, higher;   // per bucket
+    vector<int> spare;                       // unused buckets
+    int lowest;
+
+    // A new, empty bucket for uses, placed between before and its
+    // successor (before = -1: at the front).
+    int addBucket(unsigned long long uses, int before) {
+        int b = spare.back();
+        spare.pop_back();
+        count[b] = uses;
+        head[b] = tail[b] = -1;
+        lower[b] = before;
+        higher[b] = before < 0 ? lowest : higher[before];
+        (before < 0 ? lowest : higher[before]) = b;
+        if (higher[b] >= 0) lower[higher[b]] = b;
+        return b;
+    }
+    void append(int b, int frame) {
+        prev[frame] = tail[b];
+        next[frame] = -1;
+        (tail[b] < 0 ? head[b] : next[tail[b]]) = frame;
+        tail[b] = frame;
+        bucketOf[frame] = b;
+    }
+    // Takes frame out of its bucket, dropping the bucket if that empties it.
+    void remove(int frame) {
+        int b = bucketOf[frame];
+        (prev[frame] < 0 ? head[b] : next[prev[frame]]) = next[frame];
+        (next[frame] < 0 ? tail[b] : prev[next[frame]]) = prev[frame];
+        bucketOf[frame] = -1;
+        if (head[b] >= 0) return;
+        (lower[b] < 0 ? lowest : higher[lower[b]]) = higher[b];
+        if (higher[b] >= 0) lower[higher[b]] = lower[b];
+        spare.push_back(b);
+    }
+
+protected:
+    int victim(size_t) {
+        int frame = head[lowest];
+        remove(frame);
+        return frame;
+    }
+    void onHit(int frame, size_t) {
+        int b = bucketOf[frame], up = higher[b];
+        if (up < 0 || count[up] != count[b] + 1) up = addBucket(count[b] + 1, b);
+        remove(frame);
+        append(up, frame);
+    }
+    void onLoad(int frame, size_t) {
+        int b = lowest >= 0 && count[lowest] == 1 ? lowest : addBucket(1, -1);
+        append(b, frame);
+    }
+
+public:
+    LFUPolicy(int frameCount, int pages)
+        : PagePolicy(frameCount, pages), prev(frameCount, -1), next(frameCount, -1), bucketOf(frameCount, -1),
+          count(frameCount + 1, 0), head(frameCount + 1, -1), tail(frameCount + 1, -1), lower(frameCount + 1, -1),
+          higher(frameCount + 1, -1), lowest(-1) {
+        for (int b = frameCount + 1; b-- > 0;) spare.push_back(b);
+    }
+    const char* name() const { return "LFU"; }
+};
+
+// Aging: every tick shifts each frame's R bit into the top of an 8-bit
+// counter. A fault evicts the page with the smallest counter, counting a
+// reference since the last tick above all the others. Counters only
+// change on a tick, and between ticks R bits are only set, so each tick
+// sorts the frames by counter once and faults take the next frame in
+// that order whose R bit is still clear.
+class AgingPolicy : public PagePolicy {
+    vector<unsigned char> counter;
+    vector<char> referenced;
+    vector<int> order; // frames by (counter, frame) as of the last tick
+    size_t next;       // frames of order before it are taken or referenced
+
+protected:
+    int victim(size_t) {
+        while (next < order.size() && referenced[order[next]]) next++;
+        if (next < order.size()) return order[next++];
+        // Every frame referenced since the tick.
+        int best = 0, bestKey = INT_MAX;
+        for (int f = 0; f < frames; f++) {
+            int key = referenced[f] << 8 | counter[f];
+            if (key < bestKey) best = f, bestKey = key;
+        }
+        return best;
+    }
+    void onHit(int frame, size_t) { referenced[frame] = 1; }
+    void onLoad(int frame, size_t) {
+        counter[frame] = 0;
+        referenced[frame] = 1;
+    }
+    void tick() {
+        size_t start[257] = {0};
+        for (int f = 0; f < used; f++) {
+            counter[f] = (unsigned char)(counter[f] >> 1 | referenced[f] << 7);
+            referenced[f] = 0;
+            start[counter[f] + 1]++;
+        }
+        for (int c = 0; c < 256; c++) start[c + 1] += start[c];
+        order.resize(used);
+        for (int f = 0; f < used; f++) order[start[counter[f]]++] = f;
+        next = 0;
+    }
+
+public:
+    AgingPolicy(int frameCount, int pages)
+        : PagePolicy(frameCount, pages), counter(frameCount, 0), referenced(frameCount, 0), next(0) {}
+    const char* name() const { return "Aging"; }
+};
+
+// WSClock: a clock over the frames that evicts a clean page last used
+// more than WORKING_SET_WINDOW references ago. A referenced page gets its
+// R bit cleared and its time reset; an old dirty page is written back and
+// passed over. If a whole sweep finds no victim, the first page written
+// back is taken (the hand would stop there next time round), or else the
+// first clean page seen, or else the page under the hand.
+//
+// When the frames turn over faster than the window no page is ever old
+// and every fault sweeps them all. youngest is a lower bound on the last
+// use of the pages whose R bit is clear, so while it is within the window
+// such a sweep's outcome is known without making it: clear the R bits
+// set since (kept in marked) and take the first clean page.
+class WSClockPolicy : public PagePolicy {
+    vector<char> referenced;
+    vector<size_t> lastUse;
+    vector<int> marked; // frames whose R bit was set since they were swept, and stale ones
+    size_t youngest;
+    int hand;
+
+    void mark(int frame) {
+        if (referenced[frame]) return;
+        referenced[frame] = 1;
+        if (marked.size() >= 2 * (size_t)frames) {
+            marked.clear();
+            for (int f = 0; f < frames; f++)
+                if (referenced[f]) marked.push_back(f);
+        } else {
+            marked.push_back(frame);
+        }
+    }
+
+    int sweepYoung(size_t time) {
+        for (size_t i = 0; i < marked.size(); i++) {
+            int f = marked[i];
+            if (!referenced[f]) continue;
+            referenced[f] = 0;
+            lastUse[f] = time;
+        }
+        marked.clear();
+        int clean = (int)(find(dirty.begin() + hand, dirty.end(), 0) - dirty.begin());
+        if (clean == frames) clean = (int)(find(dirty.begin(), dirty.begin() + hand, 0) - dirty.begin());
+        if (!dirty[clean]) return clean;
+        int frame = hand;
+        hand = (hand + 1) % frames;
+        return frame;
+    }
+
+protected:
+    int victim(size_t time) {
+        if (time - youngest <= WORKING_SET_WINDOW) return sweepYoung(time);
+        int written = -1, clean = -1;
+        size_t oldest = SIZE_MAX;
+        for (int step = 0; step < frames; step++) {
+            int f = hand;
+            hand = (hand + 1) % frames;
+            if (clean < 0 && !dirty[f]) clean = f;
+            if (referenced[f]) {
+                referenced[f] = 0;
+                lastUse[f] = time;
+            } else if (time - lastUse[f] > WORKING_SET_WINDOW) {
+                if (!dirty[f]) return f;
+                writebacks++;
+                dirty[f] = 0;
+                if (written < 0) written = f;
+            }
+            oldest = min(oldest, lastUse[f]);
+        }
+        // A whole sweep: every R bit is clear.
+        youngest = oldest;
+        if (written >= 0) {
+            hand = (written + 1) % frames;
+            return written;
+        }
+        if (clean >= 0) return clean;
+        int frame = hand;
+        hand = (hand + 1) % frames;
+        return frame;
+    }
+    void onHit(int frame, size_t) { mark(frame); }
+    void onLoad(int frame, size_t time) {
+        mark(frame);
+        lastUse[frame] = time;
+    }
+
+public:
+    WSClockPolicy(int frameCount, int pages)
+        : PagePolicy(frameCount, pages), referenced(frameCount, 0), lastUse(frameCount, 0), youngest(0), hand(0) {}
+    const char* name() const { return "WSClock"; }
+};
+
+// Adaptive Replacement Cache (Megiddo and Modha). Resident pages are in
+// T1 (seen once recently) or T2 (seen at least twice); B1 and B2
+// remember pages recently evicted from each. A fault on a page in B1
+// grows T1's target size p, one in B2 shrinks it, and the victim comes
+// from T1 or T2 to keep T1 near p. The four lists are threaded through
+// the pages.
+class ARCPolicy : public PagePolicy {
+    enum { NONE, T1, T2, B1, B2 };
+    vector<unsigned char> listOf; // per page
+    vector<int> prev, next;       // per page
+    int head[5], tail[5], size[5];
+    int p;
+    vector<int> freeFrames;
+
+    void unlink(int page) {
+        int l = listOf[page];
+        (prev[page] < 0 ? head[l] : next[prev[page]]) = next[page];
+        (next[page] < 0 ? tail[l] : prev[next[page]]) = prev[page];
+        size[l]--;
+        listOf[page] = NONE;
+    }
+    void pushMRU(int l, int page) {
+        prev[page] = tail[l];
+        next[page] = -1;
+        (tail[l] < 0 ? head[l] : next[tail[l]]) = page;
+        tail[l] = page;
+        size[l]++;
+        listOf[page] = l;
+    }
+    // Moves the least recently used page of from to the ghost list to,
+    // freeing its frame.
+    void demote(int from, int to) {
+        int page = head[from];
+        unlink(page);
+        int frame = frameOf[page];
+        evict(frame);
+        freeFrames.push_back(frame);
+        if (to != NONE) pushMRU(to, page);
+    }
+    void replace(bool inB2) {
+        if (size[T1] > 0 && ((inB2 && size[T1] == p) || size[T1] > p)) demote(T1, B1);
+        else demote(T2, B2);
+    }
+
+protected:
+    int victim(size_t) { return -1; }
+    void onHit(int, size_t) {}
+    void onLoad(int, size_t) {}
+
+public:
+    ARCPolicy(int frameCount, int pages)
+        : PagePolicy(frameCount, pages), listOf(pages, NONE), prev(pages, -1), next(pages, -1), p(0) {
+        for (int l = 0; l < 5; l++) head[l] = tail[l] = -1, size[l] = 0;
+        for (int f = frameCount; f-- > 0;) freeFrames.push_back(f);
+    }
+    const char* name() const { return "ARC"; }
+
+    bool reference(int page, bool write, size_t) {
+        int c = frames, l = listOf[page];
+        if (l == T1 || l == T2) {
+            if (write) dirty[frameOf[page]] = 1;
+            unlink(page);
+            pushMRU(T2, page);
+            return true;
+        }
+        faults++;
+        if (l == B1) {
+            p = min(c, p + max(size[B2] / size[B1], 1));
+            replace(false);
+            unlink(page);
+            pushMRU(T2, page);
+        } else if (l == B2) {
+            p = max(0, p - max(size[B1] / size[B2], 1));
+            replace(true);
+            unlink(page);
+            pushMRU(T2, page);
+        } else {
+            if (size[T1] + size[B1] == c) {
+                if (size[T1] < c) {
+                    unlink(head[B1]);
+                    replace(false);
+                } else {
+                    demote(T1, NONE);
+                }
+            } else {
+                int total = size[T1] + size[T2] + size[B1] + size[B2];
+                if (total >= c) {
+                    if (total == 2 * c) unlink(head[B2]);
+                    if (size[T1] + size[T2] == c) replace(false);
+                }
+            }
+            pushMRU(T1, page);
+        }
+        int frame = freeFrames.back();
+        freeFrames.pop_back();
+        place(page, write, frame);
+        return false;
+    }
+};
+
+// Runs every policy with each of frameCounts frames over the trace in
+// one pass, a chunk at a time, and prints a summary table per frame
+// count.
+inline void comparePolicies(const ReferenceTrace& trace, const vector<int>& frameCounts) {
+    vector<unique_ptr<PagePolicy> > policies;
+    int pages = max(trace.distinct(), 1);
+    for (int frames : frameCounts) {
+        policies.emplace_back(new FIFOPolicy(frames, pages));
+        policies.emplace_back(new LRUPolicy(frames, pages));
+        policies.emplace_back(new OPTPolicy(frames, pages, trace.nextUse));
+        policies.emplace_back(new ClockPolicy(frames, pages));
+        policies.emplace_back(new SecondChancePolicy(frames, pages));
+        policies.emplace_back(new NRUPolicy(frames, pages));
+        policies.emplace_back(new LFUPolicy(frames, pages));
+        policies.emplace_back(new AgingPolicy(frames, pages));
+        policies.emplace_back(new WSClockPolicy(frames, pages));
+        policies.emplace_back(new ARCPolicy(frames, pages));
+    }
+
+    auto start = chrono::steady_clock::now();
+    size_t n = trace.pages.size();
+    for (size_t first = 0; first < n; first += ENGINE_CHUNK) {
+        size_t last = min(n, first + ENGINE_CHUNK);
+        for (auto& policy : policies)
+            for (size_t t = first; t < last; t++) policy->reference(trace.pages[t], trace.writes[t], t);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "\nReferences: " << n << " | Distinct pages: " << trace.distinct() << "\n";
+    size_t perCount = policies.size() / max<size_t>(frameCounts.size(), 1);
+    for (size_t c = 0; c < frameCounts.size(); c++) {
+        cout << "\n===== " << frameCounts[c] << " Frames =====\n";
+        cout << left << setw(16) << "Policy" << right << setw(14) << "Faults" << setw(14) << "Hits"
+             << setw(12) << "Hit Ratio" << setw(14) << "Writebacks" << "\n";
+        for (size_t i = c * perCount; i < (c + 1) * perCount; i++) {
+            const PagePolicy& policy = *policies[i];
+            cout << left << setw(16) << policy.name() << right << setw(14) << policy.faults
+                 << setw(14) << n - policy.faults << setw(12) << fixed << setprecision(4)
+                 << (double)(n - policy.faults) / max<size_t>(n, 1) << setw(14) << policy.writebacks << "\n";
+        }
+    }
+    cout << "\nSimulated " << policies.size() << " policies in " << setprecision(3) << seconds << " s ("
+         << setprecision(1) << n * policies.size() / max(seconds, 1e-9) / 1e6 << "M references/s)\n";
+}
+
+#endif // REPLACEMENT_ENGINE_H
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <vector>
 #include <iomanip>
+#include <cstdlib>
+#include "ReplacementEngine.h"
 using namespace std;
 void printFrames(const vector<int>& frames) {
     cout << "Frames: ";
@@ -156,7 +158,37 @@ void simulateOptimal(int framesCount, const vector<int>& pages) {
          << (double)hits / pages.size() << endl;
 }
 
-int main() {
+// Compares every policy over a trace file with one or more frame counts:
+//   main TRACE FRAMES [FRAMES...]
+int runBatch(int argc, char* argv[]) {
+    vector<int> frameCounts;
+    for (int i = 2; i < argc; i++) {
+        int frames = atoi(argv[i]);
+        if (frames <= 0) {
+            cerr << "Error: frame counts must be positive, not " << argv[i] << endl;
+            return 1;
+        }
+        frameCounts.push_back(frames);
+    }
+    ReferenceTrace trace;
+    string error;
+    if (!trace.load(argv[1], error)) {
+        cerr << "Error: " << error << endl;
+        return 1;
+    }
+    cout << "Trace: " << argv[1];
+    comparePolicies(trace, frameCounts);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 3) return runBatch(argc, argv);
+    if (argc == 2) {
+        cerr << "usage: main                          enter frames and pages, see every step\n"
+             << "       main TRACE FRAMES [FRAMES...]  compare every policy over TRACE\n";
+        return 1;
+    }
+
     int framesCount, n, choice;
     cout << "Enter number of frames: ";
     cin >> framesCount;
@@ -169,7 +201,7 @@ int main() {
     for (int i = 0; i < n; i++) cin >> pages[i];
 
     cout << "\nChoose Algorithm:\n";
-    cout << "1. FIFO\n2. LRU\n3. Optimal\n";
+    cout << "1. FIFO\n2. LRU\n3. Optimal\n4. Compare all policies (summary only)\n";
     cout << "Enter choice: ";
     cin >> choice;
 
@@ -177,6 +209,17 @@ int main() {
         case 1: simulateFIFO(framesCount, pages); break;
         case 2: simulateLRU(framesCount, pages); break;
         case 3: simulateOptimal(framesCount, pages); break;
+        case 4: {
+            ReferenceTrace trace;
+            for (int p : pages) trace.add(p, false);
+            trace.finish();
+            if (framesCount <= 0) {
+                cout << "Error: the number of frames must be positive.\n";
+                return 1;
+            }
+            comparePolicies(trace, vector<int>(1, framesCount));
+            break;
+        }
         default: cout << "Invalid choice!\n";
     }
 